@@ -0,0 +1,276 @@
+// Benchmarks de las rutas mas usadas de GestorPedidos con historiales sinteticos.
+// Para las agrupaciones con 50 millones de lineas esta proyectoprogra --bench-analisis.
+// Imprime los resultados en JSON para comparar entre versiones:
+//   proyectoprogra_bench [--tamanos 1000,100000,10000000] [--salida resultados.json]
+#define PROYECTOPROGRA_SIN_MAIN
+#include "proyectoprogra.cpp"
+
+// Descarta todo lo que se escribe; sirve para medir los metodos que imprimen
+class BufferNulo : public streambuf {
+protected:
+    int overflow(int c) override {
+        return c;
+    }
+
+    streamsize xsputn(const char*, streamsize n) override {
+        return n;
+    }
+};
+
+struct ResultadoBenchmark {
+    string nombre;
+    size_t pedidos;
+    size_t operaciones;
+    double segundos;
+};
+
+// Repite una operacion barata hasta juntar suficientes llamadas para medirla
+const size_t OPERACIONES_MINIMAS = 1000000;
+
+vector<Pedido> generarPedidos(size_t cantidad, mt19937& generador) {
+    vector<Pedido> pedidos;
+    pedidos.reserve(cantidad);
+    for (size_t i = 0; i < cantidad; i++) {
+        pedidos.push_back(pedidoAlAzar(generador, static_cast<int>(i + 1), i % 10 == 0));
+    }
+    return pedidos;
+}
+
+// Devuelve false si lo cargado al final no coincide con lo generado
+bool medirTamano(size_t cantidad, vector<ResultadoBenchmark>& resultados) {
+    const string prefijo = "bench_";
+    mt19937 generador(12345);
+    auto agregar = [&](const string& nombre, size_t operaciones, double segundos) {
+        resultados.push_back({ nombre, cantidad, operaciones, segundos });
+        cerr << "  " << nombre << ": " << fixed << setprecision(3) << segundos << " s" << endl;
+    };
+    cerr << "Historial de " << cantidad << " pedidos" << endl;
+
+    // Construccion de Pedido (calcula total y fecha)
+    vector<Pedido> pedidos;
+    double segundos = medirSegundos([&] { pedidos = generarPedidos(cantidad, generador); });
+    agregar("construir_pedido", cantidad, segundos);
+
+    // toString y detalleCompleto sobre los mismos pedidos, en vueltas si son pocos
+    size_t vueltas = max<size_t>(1, OPERACIONES_MINIMAS / cantidad);
+    size_t caracteres = 0;
+    size_t muestra = min(cantidad, OPERACIONES_MINIMAS);
+    segundos = medirSegundos([&] {
+        for (size_t v = 0; v < vueltas; v++) {
+            for (size_t i = 0; i < muestra; i++) {
+                caracteres += pedidos[i].toString().size();
+            }
+        }
+    });
+    agregar("to_string", vueltas * muestra, segundos);
+
+    segundos = medirSegundos([&] {
+        for (size_t v = 0; v < vueltas; v++) {
+            for (size_t i = 0; i < muestra; i++) {
+                caracteres += pedidos[i].detalleCompleto().size();
+            }
+        }
+    });
+    agregar("detalle_completo", vueltas * muestra, segundos);
+
+    // Los mismos textos escritos en un buffer que se reutiliza
+    string buffer;
+    segundos = medirSegundos([&] {
+        for (size_t v = 0; v < vueltas; v++) {
+            for (size_t i = 0; i < muestra; i++) {
+                buffer.clear();
+                pedidos[i].escribirResumen(buffer);
+                caracteres += buffer.size();
+            }
+        }
+    });
+    agregar("escribir_resumen", vueltas * muestra, segundos);
+
+    segundos = medirSegundos([&] {
+        for (size_t v = 0; v < vueltas; v++) {
+            for (size_t i = 0; i < muestra; i++) {
+                buffer.clear();
+                pedidos[i].escribirDetalle(buffer);
+                caracteres += buffer.size();
+            }
+        }
+    });
+    agregar("escribir_detalle", vueltas * muestra, segundos);
+
+    // Registrar todos y dejar un 20% pendiente, como en un dia normal
+    GestorPedidos gestor(prefijo, false);
+    segundos = medirSegundos([&] {
+        for (Pedido& pedido : pedidos) {
+            gestor.registrarPedido(move(pedido));
+        }
+    });
+    agregar("registrar_pedido", cantidad, segundos);
+    vector<Pedido>().swap(pedidos);
+
+    size_t aProcesar = cantidad - cantidad / 5;
+    segundos = medirSegundos([&] {
+        for (size_t i = 0; i < aProcesar; i++) {
+            gestor.procesarSiguiente();
+        }
+    });
+    agregar("procesar_pedido", aProcesar, segundos);
+
+    // Busquedas por ID al azar, incluyendo un 10% que no existe
+    size_t busquedas = max(cantidad, OPERACIONES_MINIMAS);
+    size_t encontrados = 0;
+    uniform_int_distribution<int> ids(1, static_cast<int>(cantidad + cantidad / 10));
+    segundos = medirSegundos([&] {
+        for (size_t i = 0; i < busquedas; i++) {
+            encontrados += gestor.obtenerPedido(ids(generador)) != nullptr;
+        }
+    });
+    agregar("buscar_pedido_por_id", busquedas, segundos);
+
+    // Eliminar un 5% de los pedidos por ID, en su mayoria ya completados
+    vector<int> aEliminar(cantidad);
+    iota(aEliminar.begin(), aEliminar.end(), 1);
+    shuffle(aEliminar.begin(), aEliminar.end(), generador);
+    aEliminar.resize(max<size_t>(1, cantidad / 20));
+    size_t eliminados = 0;
+    segundos = medirSegundos([&] {
+        for (int id : aEliminar) {
+            eliminados += gestor.eliminarPedidoPorId(id);
+        }
+    });
+    agregar("eliminar_pedido", aEliminar.size(), segundos);
+
+    // Agrupaciones del historial por columnas; las operaciones son filas recorridas
+    const HistorialColumnar& columnas = gestor.historialColumnar();
+    auto medirAgrupacion = [&](const string& nombre, size_t filas, VentasPorGrupo (HistorialColumnar::*agrupacion)() const) {
+        size_t repeticiones = max<size_t>(1, OPERACIONES_MINIMAS / max<size_t>(1, filas));
+        segundos = medirSegundos([&] {
+            for (size_t i = 0; i < repeticiones; i++) {
+                encontrados += (columnas.*agrupacion)().cantidad.size();
+            }
+        });
+        agregar(nombre, repeticiones * filas, segundos);
+    };
+    medirAgrupacion("agrupar_por_producto", columnas.cantidadLineas(), &HistorialColumnar::porProducto);
+    medirAgrupacion("agrupar_por_hora", columnas.size(), &HistorialColumnar::porHora);
+    medirAgrupacion("agrupar_por_cliente", columnas.size(), &HistorialColumnar::porCliente);
+    medirAgrupacion("agrupar_por_urgencia", columnas.size(), &HistorialColumnar::porUrgencia);
+
+    // El reporte imprime con cout; se manda a un buffer nulo
+    BufferNulo bufferNulo;
+    streambuf* bufferOriginal = cout.rdbuf(&bufferNulo);
+    size_t reportes = 1000;
+    segundos = medirSegundos([&] {
+        for (size_t i = 0; i < reportes; i++) {
+            gestor.generarReporteFinanciero();
+        }
+    });
+    agregar("generar_reporte_financiero", reportes, segundos);
+
+    segundos = medirSegundos([&] {
+        gestor.mostrarPedidosPendientes();
+        gestor.mostrarPedidosCompletados();
+    });
+    agregar("listar_pedidos", cantidad, segundos);
+
+    segundos = medirSegundos([&] { gestor.guardarPedidos(); });
+    agregar("guardar_pedidos", cantidad, segundos);
+
+    // Solo la pausa del hilo que atiende; la escritura sigue en otro hilo
+    segundos = medirSegundos([&] { gestor.guardarEnSegundoPlano(); });
+    gestor.esperarRespaldo();
+    agregar("fijar_respaldo_en_segundo_plano", cantidad, segundos);
+
+    // Exportar el respaldo a CSV sin cargarlo
+    string rutaExportacion = prefijo + "exportacion.csv";
+    ResultadoExportacion exportacion;
+    segundos = medirSegundos([&] { exportacion = gestor.exportarGuardados(FormatoExportacion::Csv, FiltroExportacion(), rutaExportacion); });
+    agregar("exportar_csv", max<size_t>(1, exportacion.filas), segundos);
+    remove(rutaExportacion.c_str());
+
+    segundos = medirSegundos([&] { gestor.cargarPedidos(); });
+    agregar("cargar_pedidos", cantidad, segundos);
+    cout.rdbuf(bufferOriginal);
+
+    bool correcto = gestor.cantidadPendientes() + gestor.cantidadCompletados() + eliminados == cantidad && caracteres > 0 &&
+                    encontrados > 0 && exportacion.estado == EstadoExportacion::Correcta;
+    if (!correcto) {
+        cerr << "  Error: los datos cargados no coinciden con los generados" << endl;
+    }
+
+    remove((prefijo + "pedidos.dat").c_str());
+    return correcto;
+}
+
+// Con correcto en false los tiempos no sirven para comparar
+void escribirJson(ostream& salida, const vector<ResultadoBenchmark>& resultados, bool correcto) {
+    salida << "{\n";
+    salida << "  \"formato\": 1,\n";
+#if defined(__VERSION__)
+    salida << "  \"compilador\": \"" << __VERSION__ << "\",\n";
+#elif defined(_MSC_VER)
+    salida << "  \"compilador\": \"msvc " << _MSC_VER << "\",\n";
+#endif
+    salida << "  \"hilos\": " << thread::hardware_concurrency() << ",\n";
+    salida << "  \"metricas\": " << (METRICAS_ACTIVAS ? "true" : "false") << ",\n";
+    salida << "  \"correcto\": " << (correcto ? "true" : "false") << ",\n";
+    salida << "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < resultados.size(); i++) {
+        const ResultadoBenchmark& r = resultados[i];
+        double nsPorOperacion = r.segundos * 1e9 / r.operaciones;
+        salida << "    {\"nombre\": \"" << r.nombre << "\", \"pedidos\": " << r.pedidos
+               << ", \"operaciones\": " << r.operaciones
+               << ", \"segundos\": " << fixed << setprecision(6) << r.segundos
+               << ", \"ns_por_operacion\": " << setprecision(1) << nsPorOperacion
+               << ", \"operaciones_por_segundo\": " << setprecision(0) << (r.operaciones / r.segundos) << "}"
+               << (i + 1 < resultados.size() ? "," : "") << "\n";
+    }
+    salida << "  ]\n";
+    salida << "}\n";
+}
+
+int main(int argc, char* argv[]) {
+    vector<size_t> tamanos = { 1000, 100000, 10000000 };
+    string rutaSalida;
+
+    for (int i = 1; i < argc; i++) {
+        string argumento = argv[i];
+        if (argumento == "--tamanos" && i + 1 < argc) {
+            tamanos.clear();
+            string_view lista = argv[++i];
+            string_view campo;
+            while (siguienteCampo(lista, ',', campo)) {
+                size_t tamano;
+                if (convertirNumero(campo, tamano) && tamano > 0) {
+                    tamanos.push_back(tamano);
+                }
+            }
+        }
+        else if (argumento == "--salida" && i + 1 < argc) {
+            rutaSalida = argv[++i];
+        }
+        else {
+            cerr << "Uso: " << argv[0] << " [--tamanos 1000,100000,10000000] [--salida resultados.json]" << endl;
+            return 1;
+        }
+    }
+
+    vector<ResultadoBenchmark> resultados;
+    bool correcto = true;
+    for (size_t tamano : tamanos) {
+        correcto = medirTamano(tamano, resultados) && correcto;
+    }
+
+    // Una corrida con datos que no coinciden se escribe marcada y sale con error
+    if (rutaSalida.empty()) {
+        escribirJson(cout, resultados, correcto);
+        return correcto ? 0 : 1;
+    }
+
+    ofstream archivo(rutaSalida);
+    if (!archivo.is_open()) {
+        cerr << "No se pudo abrir " << rutaSalida << endl;
+        return 1;
+    }
+    escribirJson(archivo, resultados, correcto);
+    return correcto ? 0 : 1;
+}
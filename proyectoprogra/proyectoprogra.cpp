@@ -1,6 +1,5 @@
 #include <iostream>
-#include <queue>
-#include <stack>
+#include <deque>
 #include <vector>
 #include <string>
 #include <ctime>
@@ -9,740 +8,8616 @@
 #include <fstream>
 #include <algorithm>
 #include <map>
+#include <set>
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <string_view>
+#include <charconv>
+#include <optional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <array>
+#include <memory>
+#include <unordered_set>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <numeric>
+#include <exception>
+#include <stdexcept>
+#include <filesystem>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
-// Clase para representar un producto
-class Producto {
+// Cantidad de dinero en centavos de quetzal. Las sumas son exactas y la
+// conversion a texto (y desde texto) se hace solo con enteros.
+class Dinero {
 private:
-    string nombre;
-    double precio;
+    int64_t centavos;
+
+    explicit Dinero(int64_t _centavos) : centavos(_centavos) {}
 
 public:
-    Producto(string _nombre, double _precio) : nombre(_nombre), precio(_precio) {}
+    Dinero() : centavos(0) {}
 
-    string getNombre() const {
-        return nombre;
+    static Dinero desdeCentavos(int64_t _centavos) {
+        return Dinero(_centavos);
     }
 
-    double getPrecio() const {
-        return precio;
+    // Para montos guardados como double en formatos anteriores
+    static Dinero desdeDouble(double valor) {
+        return Dinero(llround(valor * 100.0));
     }
-};
 
-// Clase para representar un pedido
-class Pedido {
-private:
-    int id;
-    string nombreCliente;
-    vector<Producto> productos;
-    double total;
-    string fechaHora;
-    bool urgente;
+    int64_t getCentavos() const {
+        return centavos;
+    }
 
-public:
-    Pedido(int _id, string _nombreCliente, vector<Producto> _productos, bool _urgente = false)
-        : id(_id), nombreCliente(_nombreCliente), productos(_productos), urgente(_urgente) {
-        total = calcularTotal();
-        fechaHora = obtenerFechaHoraActual();
+    // Interpreta un monto decimal como "23.5", "-1.25" o "2.375e1" sin pasar
+    // por double. Lo que tenga mas de dos decimales se redondea al centavo.
+    static bool interpretar(string_view texto, Dinero& valor) {
+        size_t i = 0;
+        bool negativo = false;
+        if (i < texto.size() && (texto[i] == '-' || texto[i] == '+')) {
+            negativo = (texto[i] == '-');
+            i++;
+        }
+
+        // mantisa * 10^exponente, con a lo mucho 18 cifras significativas
+        uint64_t mantisa = 0;
+        int cifras = 0;
+        int exponente = 0;
+        bool hayDigitos = false;
+        for (; i < texto.size() && texto[i] >= '0' && texto[i] <= '9'; i++) {
+            hayDigitos = true;
+            if (cifras < 18) {
+                mantisa = mantisa * 10 + (texto[i] - '0');
+                cifras += (mantisa != 0);
+            }
+            else {
+                exponente++;
+            }
+        }
+        if (i < texto.size() && texto[i] == '.') {
+            for (i++; i < texto.size() && texto[i] >= '0' && texto[i] <= '9'; i++) {
+                hayDigitos = true;
+                if (cifras < 18) {
+                    mantisa = mantisa * 10 + (texto[i] - '0');
+                    cifras += (mantisa != 0);
+                    exponente--;
+                }
+            }
+        }
+        if (!hayDigitos) {
+            return false;
+        }
+
+        if (i < texto.size() && (texto[i] == 'e' || texto[i] == 'E')) {
+            i++;
+            bool exponenteNegativo = false;
+            if (i < texto.size() && (texto[i] == '-' || texto[i] == '+')) {
+                exponenteNegativo = (texto[i] == '-');
+                i++;
+            }
+            int valorExponente;
+            auto resultado = from_chars(texto.data() + i, texto.data() + texto.size(), valorExponente);
+            if (resultado.ec != errc() || resultado.ptr != texto.data() + texto.size() || valorExponente > 1000) {
+                return false;
+            }
+            exponente += exponenteNegativo ? -valorExponente : valorExponente;
+            i = texto.size();
+        }
+        if (i != texto.size()) {
+            return false;
+        }
+
+        // Pasar a centavos
+        exponente += 2;
+        if (mantisa == 0) {
+            exponente = 0;
+        }
+        for (; exponente > 0; exponente--) {
+            if (mantisa > static_cast<uint64_t>(INT64_MAX) / 10) {
+                return false;
+            }
+            mantisa *= 10;
+        }
+        if (exponente < 0) {
+            if (exponente < -19) {
+                mantisa = 0;
+            }
+            else {
+                uint64_t divisor = 1;
+                for (; exponente < 0; exponente++) {
+                    divisor *= 10;
+                }
+                mantisa = (mantisa + divisor / 2) / divisor;
+            }
+        }
+        if (mantisa > static_cast<uint64_t>(INT64_MAX)) {
+            return false;
+        }
+
+        valor = Dinero(negativo ? -static_cast<int64_t>(mantisa) : static_cast<int64_t>(mantisa));
+        return true;
     }
 
-    // Constructor para cargar desde archivo
-    Pedido(int _id, string _nombreCliente, vector<Producto> _productos, double _total, string _fechaHora, bool _urgente = false)
-        : id(_id), nombreCliente(_nombreCliente), productos(_productos), total(_total), fechaHora(_fechaHora), urgente(_urgente) {
+    Dinero& operator+=(Dinero otro) {
+        centavos += otro.centavos;
+        return *this;
     }
 
-    int getId() const {
-        return id;
+    Dinero& operator-=(Dinero otro) {
+        centavos -= otro.centavos;
+        return *this;
     }
 
-    string getNombreCliente() const {
-        return nombreCliente;
+    Dinero operator+(Dinero otro) const {
+        return Dinero(centavos + otro.centavos);
     }
 
-    vector<Producto> getProductos() const {
-        return productos;
+    Dinero operator-(Dinero otro) const {
+        return Dinero(centavos - otro.centavos);
     }
 
-    double getTotal() const {
-        return total;
+    Dinero operator*(int64_t factor) const {
+        return Dinero(centavos * factor);
     }
 
-    string getFechaHora() const {
-        return fechaHora;
+    // Reparte en partes iguales redondeando al centavo mas cercano
+    Dinero operator/(int64_t divisor) const {
+        int64_t mitad = (centavos >= 0 ? divisor : -divisor) / 2;
+        return Dinero((centavos + mitad) / divisor);
     }
 
-    bool esUrgente() const {
-        return urgente;
+    bool operator==(Dinero otro) const {
+        return centavos == otro.centavos;
     }
 
-    void setUrgente(bool _urgente) {
-        urgente = _urgente;
+    bool operator!=(Dinero otro) const {
+        return centavos != otro.centavos;
     }
 
-    double calcularTotal() {
-        double suma = 0.0;
-        for (const Producto& p : productos) {
-            suma += p.getPrecio();
-        }
-        return suma;
+    bool operator<(Dinero otro) const {
+        return centavos < otro.centavos;
     }
+};
 
-    string obtenerFechaHoraActual() {
-        time_t ahora = time(0);
-        tm tiempo;
+// Agrega un entero en decimal al final del texto
+inline void agregarNumero(string& destino, int64_t valor) {
+    char digitos[24];
+    auto resultado = to_chars(digitos, digitos + sizeof(digitos), valor);
+    destino.append(digitos, resultado.ptr);
+}
+
+// Agrega una cantidad en quetzales con dos decimales, sin pasar por un stream
+inline void agregarDinero(string& destino, Dinero valor) {
+    int64_t centavos = valor.getCentavos();
+    uint64_t absoluto = static_cast<uint64_t>(centavos);
+    if (centavos < 0) {
+        destino += '-';
+        absoluto = 0 - absoluto;
+    }
+    agregarNumero(destino, static_cast<int64_t>(absoluto / 100));
+    destino += '.';
+    destino += static_cast<char>('0' + absoluto % 100 / 10);
+    destino += static_cast<char>('0' + absoluto % 10);
+}
+
+inline ostream& operator<<(ostream& salida, Dinero valor) {
+    string texto;
+    agregarDinero(texto, valor);
+    return salida << texto;
+}
+
+// Producto del catalogo; su nombre se guarda una sola vez
+struct ProductoCatalogo {
+    string nombre;
+    Dinero precio;
+};
 
-#ifdef _WIN32
-        // para tomar la hora y fecha del mi computadora
-        localtime_s(&tiempo, &ahora);
+// Catalogo de productos con ids densos. Los primeros ids son el menu de la
+// cafeteria; los productos que aparecen en pedidos cargados y ya no estan en el
+// menu se agregan al final. Los ids no cambian mientras el programa corre.
+// Se puede usar desde varios hilos: registrar toma un mutex y las lecturas por
+// id no bloquean porque los bloques de productos nunca se mueven.
+class CatalogoProductos {
+private:
+    static const size_t PRODUCTOS_POR_BLOQUE = 256;
+
+    unique_ptr<ProductoCatalogo[]> bloques[PRODUCTOS_POR_BLOQUE];
+    atomic<size_t> cantidad{ 0 };
+    unordered_map<string_view, uint16_t> idPorNombre;
+    size_t productosEnMenu = 0;
+    // Nombres nuevos que no entraron y quedaron como "Otro producto"
+    atomic<size_t> rechazados{ 0 };
+    mutex mutexRegistro;
+
+    const ProductoCatalogo& producto(uint16_t id) const {
+        return bloques[id / PRODUCTOS_POR_BLOQUE][id % PRODUCTOS_POR_BLOQUE];
+    }
 
-#endif
+    CatalogoProductos() {
+        // Menu de productos (precios en centavos de quetzal), en el orden en que se muestra
+        agregarAlMenu("Capuchino de vainilla", 2300);
+        agregarAlMenu("Chocolate con leche de almendras", 2525);
+        agregarAlMenu("Encanelados", 2175);
+        agregarAlMenu("Espresso", 1500);
+        agregarAlMenu("Latte", 1950);
+        agregarAlMenu("Omelet de jamon y queso", 2750);
+        agregarAlMenu("Pan con chilerelleno", 1500);
+        agregarAlMenu("Pan dulce relleno de cajeta", 1150);
+        agregarAlMenu("Pastel de almendras", 2975);
+        agregarAlMenu("Pastel de tres leches", 3550);
+    }
 
-        stringstream ss;
-        ss << put_time(&tiempo, "%d/%m/%Y %H:%M:%S");
-        return ss.str();
+    void agregarAlMenu(const string& nombre, int64_t centavos) {
+        registrar(nombre, Dinero::desdeCentavos(centavos));
+        productosEnMenu = tamano();
     }
 
-    string toString() const {
-        stringstream ss;
-        ss << "ID: " << id << " | Cliente: " << nombreCliente;
-        if (urgente) {
-            ss << " URGENTE";
+public:
+    static const uint16_t MAXIMO_PRODUCTOS = 0xFFFF;
+
+    static CatalogoProductos& global() {
+        static CatalogoProductos catalogo;
+        return catalogo;
+    }
+
+    // Devuelve el id del producto y lo agrega si no existe. Si el catalogo se
+    // llena, los nombres nuevos comparten el ultimo id ("Otro producto") y se
+    // cuentan en nombresRechazados para que las cargas lo puedan avisar.
+    uint16_t registrar(string_view nombre, Dinero precio) {
+        lock_guard<mutex> bloqueo(mutexRegistro);
+        auto it = idPorNombre.find(nombre);
+        if (it != idPorNombre.end()) {
+            return it->second;
         }
-        ss << " | Fecha: " << fechaHora << " | Total: Q" << fixed << setprecision(2) << total;
 
-        // Agregar productos al resumen
-        ss << endl << "    Productos: ";
-        for (size_t i = 0; i < productos.size(); i++) {
-            ss << productos[i].getNombre();
-            if (i < productos.size() - 1) {
-                ss << ", ";
+        size_t siguiente = cantidad.load(memory_order_relaxed);
+        if (siguiente >= MAXIMO_PRODUCTOS - 1) {
+            rechazados.fetch_add(1, memory_order_relaxed);
+            if (siguiente >= MAXIMO_PRODUCTOS) {
+                return MAXIMO_PRODUCTOS - 1;
             }
+            nombre = "Otro producto";
+            precio = Dinero();
         }
 
-        return ss.str();
-    }
-
-    string detalleCompleto() const {
-        stringstream ss;
-        ss << "ID: " << id << " | Cliente: " << nombreCliente;
-        if (urgente) {
-            ss << " URGENTE";
+        unique_ptr<ProductoCatalogo[]>& bloque = bloques[siguiente / PRODUCTOS_POR_BLOQUE];
+        if (!bloque) {
+            bloque.reset(new ProductoCatalogo[PRODUCTOS_POR_BLOQUE]);
         }
-        ss << " | Fecha: " << fechaHora << endl;
-        ss << "Productos:" << endl;
 
-        for (const Producto& p : productos) {
-            ss << "  - " << p.getNombre() << ": Q" << fixed << setprecision(2) << p.getPrecio() << endl;
-        }
+        uint16_t id = static_cast<uint16_t>(siguiente);
+        ProductoCatalogo& nuevo = bloque[siguiente % PRODUCTOS_POR_BLOQUE];
+        nuevo.nombre = string(nombre);
+        nuevo.precio = precio;
+        idPorNombre.emplace(nuevo.nombre, id);
+        cantidad.store(siguiente + 1, memory_order_release);
+        return id;
+    }
 
-        ss << "Total a pagar: Q" << fixed << setprecision(2) << total;
-        return ss.str();
+    const string& nombre(uint16_t id) const {
+        return producto(id).nombre;
     }
-};
 
-// Clase para gestionar los pedidos
-class GestorPedidos {
-private:
-    queue<Pedido> pedidosPendientes;
-    stack<Pedido> pedidosCompletados;
-    map<string, double> catalogoProductos;
+    Dinero precio(uint16_t id) const {
+        return producto(id).precio;
+    }
 
-public:
-    GestorPedidos() {
-        // Inicializar catálogo de productos (precios en quetzales)
-        catalogoProductos["Latte"] = 19.50;
-        catalogoProductos["Capuchino de vainilla"] = 23.00;
-        catalogoProductos["Omelet de jamon y queso"] = 27.50;
-        catalogoProductos["Espresso"] = 15.00;
-        catalogoProductos["Chocolate con leche de almendras"] = 25.25;
-        catalogoProductos["Pan con chilerelleno"] = 15.00;
-        catalogoProductos["Encanelados"] = 21.75;
-        catalogoProductos["Pastel de tres leches"] = 35.50;
-        catalogoProductos["Pastel de almendras"] = 29.75;
-        catalogoProductos["Pan dulce relleno de cajeta"] = 11.50;
+    size_t tamano() const {
+        return cantidad.load(memory_order_acquire);
     }
 
-    void mostrarCatalogo() {
-        cout << "\n--- Menu de productos ---\n";
-        int contador = 1;
-        for (const auto& producto : catalogoProductos) {
-            cout << contador << ". " << producto.first << " - Q" << fixed << setprecision(2) << producto.second << endl;
-            contador++;
-        }
+    size_t tamanoMenu() const {
+        return productosEnMenu;
     }
 
-    vector<Producto> seleccionarProductos() {
-        vector<Producto> productosSeleccionados;
-        char continuar;
+    size_t nombresRechazados() const {
+        return rechazados.load(memory_order_relaxed);
+    }
+};
 
-        do {
-            mostrarCatalogo();
+// Vector que guarda los primeros N elementos dentro del propio objeto y solo
+// pide memoria si crece mas. Solo para tipos que se copian byte a byte.
+template <typename T, size_t N>
+class VectorCorto {
+    static_assert(is_trivially_copyable<T>::value, "VectorCorto copia los elementos con memcpy");
 
-            int opcion;
-            cout << "\nSeleccione un producto (1-" << catalogoProductos.size() << "): ";
-            cin >> opcion;
+private:
+    T* datos;
+    uint32_t tamano = 0;
+    uint32_t capacidad = N;
+    alignas(T) unsigned char enLinea[N * sizeof(T)];
 
-            if (opcion < 1 || opcion > static_cast<int>(catalogoProductos.size())) {
-                cout << "Opcion invalida. Intente de nuevo.\n";
-                continue;
-            }
+    T* inicioEnLinea() {
+        return reinterpret_cast<T*>(enLinea);
+    }
 
-            auto it = catalogoProductos.begin();
-            advance(it, opcion - 1);
+    bool usaEnLinea() const {
+        return datos == reinterpret_cast<const T*>(enLinea);
+    }
 
-            productosSeleccionados.push_back(Producto(it->first, it->second));
-            cout << "Producto anadido: " << it->first << " - Q" << fixed << setprecision(2) << it->second << endl;
+    void liberar() {
+        if (!usaEnLinea()) {
+            ::operator delete(datos);
+        }
+    }
 
-            cout << "Desea agregar otro producto? (s/n): ";
-            cin >> continuar;
-        } while (continuar == 's' || continuar == 'S');
+    void crecer(size_t minimo) {
+        size_t nuevaCapacidad = max<size_t>(minimo, static_cast<size_t>(capacidad) * 2);
+        T* nuevos = static_cast<T*>(::operator new(nuevaCapacidad * sizeof(T)));
+        memcpy(static_cast<void*>(nuevos), datos, tamano * sizeof(T));
+        liberar();
+        datos = nuevos;
+        capacidad = static_cast<uint32_t>(nuevaCapacidad);
+    }
 
-        return productosSeleccionados;
+    void copiarDe(const VectorCorto& otro) {
+        if (otro.tamano > capacidad) {
+            crecer(otro.tamano);
+        }
+        memcpy(static_cast<void*>(datos), otro.datos, otro.tamano * sizeof(T));
+        tamano = otro.tamano;
     }
 
-    void agregarPedido() {
-        cin.ignore();
-        string nombreCliente;
-        cout << "\nNombre del cliente: ";
-        getline(cin, nombreCliente);
+    // Los elementos en linea se copian; la memoria aparte se toma del otro
+    void moverDe(VectorCorto& otro) {
+        if (otro.usaEnLinea()) {
+            datos = inicioEnLinea();
+            capacidad = N;
+            memcpy(static_cast<void*>(datos), otro.datos, otro.tamano * sizeof(T));
+        }
+        else {
+            datos = otro.datos;
+            capacidad = otro.capacidad;
+            otro.datos = otro.inicioEnLinea();
+            otro.capacidad = N;
+        }
+        tamano = otro.tamano;
+        otro.tamano = 0;
+    }
 
-        // Permitir que el usuario especifique el ID
-        int id;
-        cout << "ID del pedido: ";
-        cin >> id;
+public:
+    VectorCorto() : datos(inicioEnLinea()) {
+    }
 
-        vector<Producto> productos = seleccionarProductos();
+    VectorCorto(initializer_list<T> elementos) : VectorCorto() {
+        reserve(elementos.size());
+        for (const T& elemento : elementos) {
+            push_back(elemento);
+        }
+    }
 
-        char opcionUrgente;
-        cout << "Es un pedido urgente? (s/n): ";
-        cin >> opcionUrgente;
-        bool esUrgente = (opcionUrgente == 's' || opcionUrgente == 'S');
+    VectorCorto(const VectorCorto& otro) : VectorCorto() {
+        copiarDe(otro);
+    }
 
-        Pedido nuevoPedido(id, nombreCliente, productos, esUrgente);
+    VectorCorto(VectorCorto&& otro) noexcept : datos(inicioEnLinea()) {
+        moverDe(otro);
+    }
 
-        if (esUrgente) {
-            // Si es urgente, procesarlo inmediatamente
-            cout << "\nPedido URGENTE registrado y procesado inmediatamente.\n";
-            cout << "Detalle del pedido:\n" << nuevoPedido.detalleCompleto() << endl;
-            pedidosCompletados.push(nuevoPedido);
-        }
-        else {
-            pedidosPendientes.push(nuevoPedido);
-            cout << "\nPedido registrado correctamente.\n";
-            cout << "Detalle del pedido:\n" << nuevoPedido.detalleCompleto() << endl;
+    VectorCorto& operator=(const VectorCorto& otro) {
+        if (this != &otro) {
+            tamano = 0;
+            copiarDe(otro);
         }
+        return *this;
     }
 
-    void procesarPedido() {
-        if (pedidosPendientes.empty()) {
-            cout << "\nNo hay pedidos pendientes para procesar.\n";
-            return;
+    VectorCorto& operator=(VectorCorto&& otro) noexcept {
+        if (this != &otro) {
+            liberar();
+            moverDe(otro);
         }
+        return *this;
+    }
 
-        Pedido pedido = pedidosPendientes.front();
-        pedidosPendientes.pop();
+    ~VectorCorto() {
+        liberar();
+    }
 
-        cout << "\nProcesando pedido:\n" << pedido.detalleCompleto() << endl;
+    void push_back(const T& valor) {
+        if (tamano == capacidad) {
+            T copia = valor;  // valor puede estar en el bloque que se libera
+            crecer(tamano + 1);
+            new (datos + tamano) T(copia);
+        }
+        else {
+            new (datos + tamano) T(valor);
+        }
+        tamano++;
+    }
 
-        pedidosCompletados.push(pedido);
-        cout << "Pedido completado y movido al historial.\n";
+    template <typename... Argumentos>
+    void emplace_back(Argumentos&&... argumentos) {
+        push_back(T(forward<Argumentos>(argumentos)...));
     }
 
-    void mostrarPedidosPendientes() {
-        if (pedidosPendientes.empty()) {
-            cout << "\nNo hay pedidos pendientes.\n";
-            return;
+    void reserve(size_t cantidad) {
+        if (cantidad > capacidad) {
+            crecer(cantidad);
         }
+    }
 
-        cout << "\n--- PEDIDOS PENDIENTES ---\n";
-
-        // Crear una copia de la cola para no modificar la original
-        queue<Pedido> copia = pedidosPendientes;
-        int contador = 1;
+    void clear() {
+        tamano = 0;
+    }
 
-        while (!copia.empty()) {
-            cout << contador << ". " << copia.front().toString() << endl << endl;
-            contador++;
-            copia.pop();
-        }
+    size_t size() const {
+        return tamano;
     }
 
-    void mostrarPedidosCompletados() {
-        if (pedidosCompletados.empty()) {
-            cout << "\nNo hay pedidos completados en el historial.\n";
-            return;
-        }
+    bool empty() const {
+        return tamano == 0;
+    }
 
-        cout << "\n--- HISTORIAL DE PEDIDOS COMPLETADOS ---\n";
+    const T& operator[](size_t i) const {
+        return datos[i];
+    }
 
-        // Crear una copia de la pila para no modificar la original
-        stack<Pedido> copia = pedidosCompletados;
-        vector<Pedido> pedidosOrdenados;
+    T& operator[](size_t i) {
+        return datos[i];
+    }
 
-        // Invertir el orden para mostrar de más reciente a más antiguo
-        while (!copia.empty()) {
-            pedidosOrdenados.push_back(copia.top());
-            copia.pop();
-        }
+    const T* begin() const {
+        return datos;
+    }
 
-        for (size_t i = 0; i < pedidosOrdenados.size(); i++) {
-            cout << (i + 1) << ". " << pedidosOrdenados[i].toString() << endl << endl;
-        }
+    const T* end() const {
+        return datos + tamano;
     }
 
-    void buscarPedidoPorId() {
-        int idBuscado;
-        cout << "\nIngrese el ID del pedido a buscar: ";
-        cin >> idBuscado;
+    T* begin() {
+        return datos;
+    }
 
-        // Buscar en pedidos completados
-        stack<Pedido> copiaCompletados = pedidosCompletados;
-        bool encontrado = false;
+    T* end() {
+        return datos + tamano;
+    }
+};
 
-        while (!copiaCompletados.empty() && !encontrado) {
-            Pedido pedido = copiaCompletados.top();
-            if (pedido.getId() == idBuscado) {
-                cout << "\nPedido encontrado (completado):\n" << pedido.detalleCompleto() << endl;
-                encontrado = true;
+// Reparte memoria para contenedores de nodos (map, unordered_map, deque) en
+// bloques grandes. Cada tamano pedido hasta TAMANO_MAXIMO tiene su propia
+// lista de espacios libres; lo liberado se reutiliza y los bloques se
+// devuelven solo al destruir el pool. No es seguro entre hilos: cada
+// contenedor usa el suyo.
+class PoolNodos {
+private:
+    static const size_t TAMANO_MAXIMO = 1024;
+    static const size_t BYTES_POR_BLOQUE = 1 << 16;
+
+    struct Clase {
+        size_t tamano;
+        void* libres = nullptr;  // cada espacio libre guarda el siguiente
+        char* siguiente = nullptr;
+        char* finBloque = nullptr;
+    };
+
+    vector<Clase> clases;
+    vector<unique_ptr<char[]>> bloques;
+
+    Clase& claseDe(size_t tamano) {
+        for (Clase& clase : clases) {
+            if (clase.tamano == tamano) {
+                return clase;
             }
-            copiaCompletados.pop();
         }
+        clases.push_back({ tamano });
+        return clases.back();
+    }
 
-        if (!encontrado) {
-            // Buscar en pedidos pendientes
-            queue<Pedido> copiaPendientes = pedidosPendientes;
-
-            while (!copiaPendientes.empty() && !encontrado) {
-                Pedido pedido = copiaPendientes.front();
-                if (pedido.getId() == idBuscado) {
-                    cout << "\nPedido encontrado (pendiente):\n" << pedido.detalleCompleto() << endl;
-                    encontrado = true;
-                }
-                copiaPendientes.pop();
-            }
+public:
+    PoolNodos() = default;
+    PoolNodos(const PoolNodos&) = delete;
+    PoolNodos& operator=(const PoolNodos&) = delete;
+
+    void* reservar(size_t tamano) {
+        // Espacios multiplos de 16 para que cualquier nodo quede alineado
+        tamano = (tamano + 15) & ~size_t(15);
+        if (tamano > TAMANO_MAXIMO) {
+            return ::operator new(tamano);
+        }
 
-            if (!encontrado) {
-                cout << "\nNo se encontro ningún pedido con el ID " << idBuscado << ".\n";
-            }
+        Clase& clase = claseDe(tamano);
+        if (clase.libres != nullptr) {
+            void* espacio = clase.libres;
+            clase.libres = *static_cast<void**>(espacio);
+            return espacio;
+        }
+        if (clase.siguiente == clase.finBloque) {
+            bloques.emplace_back(new char[BYTES_POR_BLOQUE]);
+            clase.siguiente = bloques.back().get();
+            clase.finBloque = clase.siguiente + BYTES_POR_BLOQUE / tamano * tamano;
         }
+        void* espacio = clase.siguiente;
+        clase.siguiente += tamano;
+        return espacio;
     }
 
-    void generarReporteFinanciero() {
-        if (pedidosCompletados.empty()) {
-            cout << "\nNo hay pedidos completados para generar un reporte.\n";
+    void liberar(void* espacio, size_t tamano) {
+        tamano = (tamano + 15) & ~size_t(15);
+        if (tamano > TAMANO_MAXIMO) {
+            ::operator delete(espacio);
             return;
         }
+        Clase& clase = claseDe(tamano);
+        *static_cast<void**>(espacio) = clase.libres;
+        clase.libres = espacio;
+    }
+
+    size_t cantidadBloques() const {
+        return bloques.size();
+    }
+};
 
-        double ingresoTotal = 0.0;
-        int cantidadPedidos = 0;
-        map<string, int> conteoProductos;
+// Asignador para los contenedores de la biblioteca estandar que pide la
+// memoria a un PoolNodos; el pool debe vivir mas que el contenedor
+template <typename T>
+class AsignadorPool {
+public:
+    using value_type = T;
 
-        // Crear una copia de la pila para no modificar la original
-        stack<Pedido> copia = pedidosCompletados;
+    PoolNodos* pool;
 
-        while (!copia.empty()) {
-            Pedido pedido = copia.top();
-            ingresoTotal += pedido.getTotal();
-            cantidadPedidos++;
+    explicit AsignadorPool(PoolNodos* _pool) noexcept : pool(_pool) {
+    }
 
-            // Contar productos vendidos
-            for (const Producto& p : pedido.getProductos()) {
-                conteoProductos[p.getNombre()]++;
-            }
+    template <typename U>
+    AsignadorPool(const AsignadorPool<U>& otro) noexcept : pool(otro.pool) {
+    }
 
-            copia.pop();
-        }
+    T* allocate(size_t n) {
+        return static_cast<T*>(pool->reservar(n * sizeof(T)));
+    }
 
-        cout << "\n--- REPORTE FINANCIERO ---\n";
-        cout << "Cantidad de pedidos completados: " << cantidadPedidos << endl;
-        cout << "Ingreso total: Q" << fixed << setprecision(2) << ingresoTotal << endl;
-        cout << "Promedio por pedido: Q" << fixed << setprecision(2) << (ingresoTotal / cantidadPedidos) << endl;
+    void deallocate(T* p, size_t n) noexcept {
+        pool->liberar(p, n * sizeof(T));
+    }
 
-        cout << "\nProductos vendidos:\n";
-        for (const auto& item : conteoProductos) {
-            cout << "  - " << item.first << ": " << item.second << " unidad(es)" << endl;
-        }
+    template <typename U>
+    bool operator==(const AsignadorPool<U>& otro) const noexcept {
+        return pool == otro.pool;
     }
 
-    void guardarPedidos() {
-        ofstream archivoPendientes("pedidos_pendientes.txt");
-        ofstream archivoCompletados("pedidos_completados.txt");
+    template <typename U>
+    bool operator!=(const AsignadorPool<U>& otro) const noexcept {
+        return pool != otro.pool;
+    }
+};
 
-        if (!archivoPendientes.is_open() || !archivoCompletados.is_open()) {
-            cout << "\nError al abrir los archivos para guardar los pedidos.\n";
-            return;
-        }
+// Clase para representar un producto de un pedido: id en el catalogo y precio cobrado
+class Producto {
+private:
+    uint16_t idProducto;
+    Dinero precio;
 
-        // Guardar pedidos pendientes
-        queue<Pedido> copiaPendientes = pedidosPendientes;
-        while (!copiaPendientes.empty()) {
-            Pedido p = copiaPendientes.front();
-            archivoPendientes << p.getId() << "|" << p.getNombreCliente() << "|";
+public:
+    Producto(uint16_t _idProducto, Dinero _precio) : idProducto(_idProducto), precio(_precio) {}
 
-            // Guardar productos
-            vector<Producto> productos = p.getProductos();
-            archivoPendientes << productos.size() << "|";
-            for (const Producto& prod : productos) {
-                archivoPendientes << prod.getNombre() << "," << prod.getPrecio() << "|";
-            }
+    // Para productos que vienen por nombre (archivos de texto y journal)
+    Producto(string_view _nombre, Dinero _precio)
+        : idProducto(CatalogoProductos::global().registrar(_nombre, _precio)), precio(_precio) {}
 
-            archivoPendientes << p.getTotal() << "|" << p.getFechaHora() << "|" << p.esUrgente() << endl;
-            copiaPendientes.pop();
-        }
+    uint16_t getIdProducto() const {
+        return idProducto;
+    }
 
-        // Guardar pedidos completados
-        stack<Pedido> copiaCompletados = pedidosCompletados;
-        vector<Pedido> pedidosOrdenados;
+    const string& getNombre() const {
+        return CatalogoProductos::global().nombre(idProducto);
+    }
 
-        while (!copiaCompletados.empty()) {
-            pedidosOrdenados.push_back(copiaCompletados.top());
-            copiaCompletados.pop();
-        }
+    Dinero getPrecio() const {
+        return precio;
+    }
+};
 
-        for (int i = pedidosOrdenados.size() - 1; i >= 0; i--) {
-            Pedido p = pedidosOrdenados[i];
-            archivoCompletados << p.getId() << "|" << p.getNombreCliente() << "|";
+// Lineas de un pedido; hasta 5 productos (casi todos los pedidos) van dentro
+// del Pedido sin pedir memoria aparte
+using LineasPedido = VectorCorto<Producto, 5>;
 
-            // Guardar productos
-            vector<Producto> productos = p.getProductos();
-            archivoCompletados << productos.size() << "|";
-            for (const Producto& prod : productos) {
-                archivoCompletados << prod.getNombre() << "," << prod.getPrecio() << "|";
-            }
+// El respaldo y el journal guardan la cantidad de lineas en 16 bits; los
+// pedidos con mas lineas se rechazan al registrarlos y al cargarlos
+const size_t MAXIMO_LINEAS_PEDIDO = 0xFFFF;
 
-            archivoCompletados << p.getTotal() << "|" << p.getFechaHora() << "|" << p.esUrgente() << endl;
+// Nombres de clientes con ids densos; cada pedido guarda solo el id. Igual que
+// en el catalogo, registrar toma un mutex y las lecturas por id no bloquean
+// porque los bloques de nombres nunca se mueven; los nombres que el hilo ya
+// vio salen de su cache sin tomar el mutex.
+class RegistroClientes {
+private:
+    static const size_t NOMBRES_POR_BLOQUE = 1 << 12;
+    static const size_t MAXIMO_BLOQUES = 1 << 16;
+
+    unique_ptr<unique_ptr<string[]>[]> bloques;
+    atomic<size_t> cantidad{ 0 };
+    unordered_map<string_view, uint32_t> idPorNombre;
+    // Ids ordenados por nombre para buscar por prefijo; los nombres nuevos se
+    // ordenan y se mezclan la siguiente vez que se busca
+    vector<uint32_t> idsOrdenados;
+    // Nombres nuevos que no entraron y quedaron como "Otro cliente"
+    atomic<size_t> rechazados{ 0 };
+    mutex mutexRegistro;
+
+    RegistroClientes() : bloques(new unique_ptr<string[]>[MAXIMO_BLOQUES]) {}
+
+    const string& nombreSinBloqueo(uint32_t id) const {
+        return bloques[id / NOMBRES_POR_BLOQUE][id % NOMBRES_POR_BLOQUE];
+    }
+
+    // Cache por hilo de los nombres que ese hilo ya registro o encontro: cada
+    // ranura guarda id + 1 (0 vacia) y el nombre se compara con el del
+    // registro, que no cambia una vez escrito. Asi los clientes que se repiten
+    // no toman el mutex; con varias sucursales cada hilo tiene la suya.
+    static const size_t RANURAS_CACHE = 1 << 12;
+
+    static array<uint32_t, RANURAS_CACHE>& cacheDelHilo() {
+        thread_local array<uint32_t, RANURAS_CACHE> cache{};
+        return cache;
+    }
+
+    bool buscarEnCache(string_view nombre, size_t hashNombre, uint32_t& id) const {
+        uint32_t ranura = cacheDelHilo()[hashNombre % RANURAS_CACHE];
+        if (ranura == 0 || nombreSinBloqueo(ranura - 1) != nombre) {
+            return false;
         }
+        id = ranura - 1;
+        return true;
+    }
 
-        archivoPendientes.close();
-        archivoCompletados.close();
+    static void guardarEnCache(size_t hashNombre, uint32_t id) {
+        cacheDelHilo()[hashNombre % RANURAS_CACHE] = id + 1;
+    }
 
-        cout << "\nPedidos guardados correctamente en archivos.\n";
+public:
+    static const size_t MAXIMO_CLIENTES = NOMBRES_POR_BLOQUE * MAXIMO_BLOQUES;
+
+    static RegistroClientes& global() {
+        static RegistroClientes registro;
+        return registro;
     }
 
-    void cargarPedidos() {
-        // Limpiar las estructuras actuales
-        while (!pedidosPendientes.empty()) pedidosPendientes.pop();
-        while (!pedidosCompletados.empty()) pedidosCompletados.pop();
+    // Devuelve el id del cliente y lo agrega si no existe. Si el registro se
+    // llena, los nombres nuevos comparten el ultimo id ("Otro cliente") y se
+    // cuentan en nombresRechazados.
+    uint32_t registrar(string_view nombre) {
+        size_t hashNombre = hash<string_view>()(nombre);
+        uint32_t enCache;
+        if (buscarEnCache(nombre, hashNombre, enCache)) {
+            return enCache;
+        }
 
-        ifstream archivoPendientes("pedidos_pendientes.txt");
-        ifstream archivoCompletados("pedidos_completados.txt");
+        lock_guard<mutex> bloqueo(mutexRegistro);
+        auto it = idPorNombre.find(nombre);
+        if (it != idPorNombre.end()) {
+            guardarEnCache(hashNombre, it->second);
+            return it->second;
+        }
 
-        if (!archivoPendientes.is_open() || !archivoCompletados.is_open()) {
-            cout << "\nNo se encontraron archivos de pedidos para cargar o hubo un error al abrirlos.\n";
-            return;
+        size_t siguiente = cantidad.load(memory_order_relaxed);
+        if (siguiente >= MAXIMO_CLIENTES - 1) {
+            rechazados.fetch_add(1, memory_order_relaxed);
+            if (siguiente >= MAXIMO_CLIENTES) {
+                return static_cast<uint32_t>(MAXIMO_CLIENTES - 1);
+            }
+            nombre = "Otro cliente";
         }
 
-        string linea;
+        unique_ptr<string[]>& bloque = bloques[siguiente / NOMBRES_POR_BLOQUE];
+        if (!bloque) {
+            bloque.reset(new string[NOMBRES_POR_BLOQUE]);
+        }
 
-        // Cargar pedidos pendientes
-        while (getline(archivoPendientes, linea)) {
-            stringstream ss(linea);
-            string token;
-            vector<string> datos;
+        uint32_t id = static_cast<uint32_t>(siguiente);
+        string& nuevo = bloque[siguiente % NOMBRES_POR_BLOQUE];
+        nuevo = string(nombre);
+        idPorNombre.emplace(nuevo, id);
+        cantidad.store(siguiente + 1, memory_order_release);
+        guardarEnCache(hashNombre, id);
+        return id;
+    }
+
+    // Busca un nombre sin registrarlo
+    bool buscar(string_view nombre, uint32_t& id) {
+        size_t hashNombre = hash<string_view>()(nombre);
+        if (buscarEnCache(nombre, hashNombre, id)) {
+            return true;
+        }
+        lock_guard<mutex> bloqueo(mutexRegistro);
+        auto it = idPorNombre.find(nombre);
+        if (it == idPorNombre.end()) {
+            return false;
+        }
+        id = it->second;
+        guardarEnCache(hashNombre, id);
+        return true;
+    }
 
-            while (getline(ss, token, '|')) {
-                datos.push_back(token);
+    // Ids de los clientes cuyo nombre empieza con prefijo, en orden alfabetico
+    vector<uint32_t> buscarPorPrefijo(string_view prefijo) {
+        lock_guard<mutex> bloqueo(mutexRegistro);
+        size_t ordenados = idsOrdenados.size();
+        size_t total = cantidad.load(memory_order_relaxed);
+        if (ordenados < total) {
+            auto porNombre = [&](uint32_t a, uint32_t b) {
+                return nombreSinBloqueo(a) < nombreSinBloqueo(b);
+            };
+            for (size_t id = ordenados; id < total; id++) {
+                idsOrdenados.push_back(static_cast<uint32_t>(id));
             }
+            sort(idsOrdenados.begin() + ordenados, idsOrdenados.end(), porNombre);
+            inplace_merge(idsOrdenados.begin(), idsOrdenados.begin() + ordenados, idsOrdenados.end(), porNombre);
+        }
 
-            if (datos.size() < 6) continue; // Formato inválido
+        auto it = lower_bound(idsOrdenados.begin(), idsOrdenados.end(), prefijo, [&](uint32_t id, string_view valor) {
+            return string_view(nombreSinBloqueo(id)) < valor;
+        });
+        vector<uint32_t> encontrados;
+        for (; it != idsOrdenados.end() && string_view(nombreSinBloqueo(*it)).substr(0, prefijo.size()) == prefijo; ++it) {
+            encontrados.push_back(*it);
+        }
+        return encontrados;
+    }
+
+    const string& nombre(uint32_t id) const {
+        return nombreSinBloqueo(id);
+    }
+
+    size_t tamano() const {
+        return cantidad.load(memory_order_acquire);
+    }
+
+    size_t nombresRechazados() const {
+        return rechazados.load(memory_order_relaxed);
+    }
+};
+
+// Los nombres de clientes viajan sin escapar en las respuestas del modo por
+// lotes y en el archivo de texto, separados por '|' y por lineas
+inline bool nombreClienteValido(string_view nombre) {
+    return nombre.find_first_of("|\r\n") == string_view::npos;
+}
+
+template <typename T>
+bool convertirNumero(string_view texto, T& valor) {
+    auto resultado = from_chars(texto.data(), texto.data() + texto.size(), valor);
+    return resultado.ec == errc() && resultado.ptr == texto.data() + texto.size();
+}
+
+// Hora local de un instante (segundos desde 1970)
+inline tm horaLocal(int64_t instante) {
+    time_t t = static_cast<time_t>(instante);
+    tm tiempo = {};
+#ifdef _WIN32
+    localtime_s(&tiempo, &t);
+#else
+    localtime_r(&t, &tiempo);
+#endif
+    return tiempo;
+}
+
+// Dias desde 1970-01-01 de una fecha del calendario gregoriano
+inline int64_t diasDesdeEpoca(int64_t anio, int64_t mes, int64_t dia) {
+    anio -= (mes <= 2);
+    int64_t era = (anio >= 0 ? anio : anio - 399) / 400;
+    int64_t anioDeEra = anio - era * 400;
+    int64_t diaDelAnio = (153 * (mes > 2 ? mes - 3 : mes + 9) + 2) / 5 + dia - 1;
+    int64_t diaDeEra = anioDeEra * 365 + anioDeEra / 4 - anioDeEra / 100 + diaDelAnio;
+    return era * 146097 + diaDeEra - 719468;
+}
+
+// Segundos que hay que sumar a un instante para tener la hora local en ese
+// instante (cambia con el horario de verano). Los cambios de horario caen en
+// cuartos de hora, asi que el desfase se calcula una vez por cuarto de hora y
+// se guarda en una tabla chica por hilo.
+inline int64_t desfaseHoraLocal(int64_t instante) {
+    struct Entrada {
+        int64_t cuarto = INT64_MIN;
+        int64_t desfase = 0;
+    };
+    static thread_local array<Entrada, 64> recientes;
+
+    int64_t cuarto = (instante >= 0 ? instante : instante - 899) / 900;
+    Entrada& entrada = recientes[static_cast<uint64_t>(cuarto) % recientes.size()];
+    if (entrada.cuarto != cuarto) {
+        tm local = horaLocal(instante);
+        int64_t comoUtc = diasDesdeEpoca(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday) * 86400 +
+                          local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec;
+        entrada.cuarto = cuarto;
+        entrada.desfase = comoUtc - instante;
+    }
+    return entrada.desfase;
+}
+
+// Dia local al que pertenece un instante, contado desde 1970
+inline int64_t diaDe(int64_t instante) {
+    int64_t local = instante + desfaseHoraLocal(instante);
+    return (local >= 0 ? local : local - 86399) / 86400;
+}
+
+// Agrega el instante como "dd/mm/aaaa hh:mm:ss" en hora local. El formato
+// solo se usa para mostrar; los pedidos guardan el instante.
+inline void agregarFechaHora(string& destino, int64_t instante) {
+    // Muchos pedidos caen en el mismo segundo; se reutiliza el ultimo texto
+    static thread_local int64_t ultimoInstante = INT64_MIN;
+    static thread_local char ultimoTexto[80];
+    if (instante != ultimoInstante) {
+        tm tiempo = horaLocal(instante);
+        snprintf(ultimoTexto, sizeof(ultimoTexto), "%02d/%02d/%04d %02d:%02d:%02d", tiempo.tm_mday, tiempo.tm_mon + 1,
+                 tiempo.tm_year + 1900, tiempo.tm_hour, tiempo.tm_min, tiempo.tm_sec);
+        ultimoInstante = instante;
+    }
+    destino += ultimoTexto;
+}
+
+// Escribe el instante como "aaaa-mm-ddThh:mm:ss" (ISO 8601) en hora local en
+// cursor, que debe tener lugar para 32 caracteres, y lo avanza. Al exportar casi
+// todos los instantes son distintos y localtime es caro; como los cambios de
+// horario caen en cuartos de hora, dentro de uno basta sumar los segundos a su
+// comienzo.
+inline void escribirFechaIso(char*& cursor, int64_t instante) {
+    static thread_local int64_t cuartoCacheado = INT64_MIN;
+    static thread_local char fechaHora[32];  // "aaaa-mm-ddThh:"
+    static thread_local size_t largoFechaHora = 0;
+    static thread_local int minutoInicio = 0;
+    static thread_local int segundoInicio = 0;
+
+    int64_t cuarto = (instante >= 0 ? instante : instante - 899) / 900;
+    if (cuarto != cuartoCacheado) {
+        tm tiempo = horaLocal(cuarto * 900);
+        int largo = snprintf(fechaHora, sizeof(fechaHora), "%04d-%02d-%02dT%02d:", tiempo.tm_year + 1900, tiempo.tm_mon + 1,
+                             tiempo.tm_mday, tiempo.tm_hour);
+        largoFechaHora = static_cast<size_t>(max(0, min(largo, static_cast<int>(sizeof(fechaHora)) - 1)));
+        minutoInicio = tiempo.tm_min;
+        segundoInicio = tiempo.tm_sec;
+        cuartoCacheado = cuarto;
+    }
+
+    int segundos = segundoInicio + static_cast<int>(instante - cuarto * 900);
+    int minuto = minutoInicio + segundos / 60;
+    int segundo = segundos % 60;
+    if (minuto >= 60) {
+        // Zona con un desfase que no es de cuartos de hora
+        tm tiempo = horaLocal(instante);
+        char texto[32];
+        int largo = snprintf(texto, sizeof(texto), "%04d-%02d-%02dT%02d:%02d:%02d", tiempo.tm_year + 1900, tiempo.tm_mon + 1,
+                             tiempo.tm_mday, tiempo.tm_hour, tiempo.tm_min, tiempo.tm_sec);
+        size_t copiar = static_cast<size_t>(max(0, min(largo, static_cast<int>(sizeof(texto)) - 1)));
+        memcpy(cursor, texto, copiar);
+        cursor += copiar;
+        return;
+    }
+    memcpy(cursor, fechaHora, largoFechaHora);
+    cursor += largoFechaHora;
+    cursor[0] = static_cast<char>('0' + minuto / 10);
+    cursor[1] = static_cast<char>('0' + minuto % 10);
+    cursor[2] = ':';
+    cursor[3] = static_cast<char>('0' + segundo / 10);
+    cursor[4] = static_cast<char>('0' + segundo % 10);
+    cursor += 5;
+}
+
+// mktime para una hora local; devuelve false si no se puede representar
+inline bool instanteLocal(int anio, int mes, int dia, int hora, int minuto, int segundo, int64_t& segundos) {
+    tm tiempo = {};
+    tiempo.tm_mday = dia;
+    tiempo.tm_mon = mes - 1;
+    tiempo.tm_year = anio - 1900;
+    tiempo.tm_hour = hora;
+    tiempo.tm_min = minuto;
+    tiempo.tm_sec = segundo;
+    tiempo.tm_isdst = -1;
+    time_t resultado = mktime(&tiempo);
+    if (resultado == static_cast<time_t>(-1)) {
+        return false;
+    }
+    segundos = static_cast<int64_t>(resultado);
+    return true;
+}
+
+// Convierte una fecha "dd/mm/aaaa hh:mm:ss" (hora local) a segundos desde 1970.
+// Devuelve false si el texto no tiene ese formato.
+bool interpretarFechaHora(string_view texto, int64_t& segundos) {
+    // mktime es caro y toma un candado global, lo que frena la carga en paralelo.
+    // Cada hilo guarda la medianoche del ultimo dia visto; si ese dia dura 24 horas
+    // (sin cambio de horario) basta sumar la hora.
+    static thread_local int64_t diaCacheado = -1;
+    static thread_local int64_t medianocheCacheada = 0;
+    static thread_local bool diaRegular = false;
+
+    int dia, mes, anio, hora, minuto, segundo;
+    if (texto.size() != 19 || texto[2] != '/' || texto[5] != '/' || texto[10] != ' ' || texto[13] != ':' || texto[16] != ':' ||
+        !convertirNumero(texto.substr(0, 2), dia) || !convertirNumero(texto.substr(3, 2), mes) ||
+        !convertirNumero(texto.substr(6, 4), anio) || !convertirNumero(texto.substr(11, 2), hora) ||
+        !convertirNumero(texto.substr(14, 2), minuto) || !convertirNumero(texto.substr(17, 2), segundo)) {
+        return false;
+    }
+    // mktime acepta campos fuera de rango y los pasa al dia o mes siguiente;
+    // "99/99/2024" no es una fecha
+    if (dia < 1 || dia > 31 || mes < 1 || mes > 12 || hora > 23 || minuto > 59 || segundo > 60) {
+        return false;
+    }
+
+    int64_t claveDia = static_cast<int64_t>(anio) * 10000 + mes * 100 + dia;
+    if (claveDia != diaCacheado) {
+        int64_t medianoche, siguienteMedianoche;
+        if (!instanteLocal(anio, mes, dia, 0, 0, 0, medianoche)) {
+            return instanteLocal(anio, mes, dia, hora, minuto, segundo, segundos);
+        }
+        diaCacheado = claveDia;
+        medianocheCacheada = medianoche;
+        diaRegular = instanteLocal(anio, mes, dia + 1, 0, 0, 0, siguienteMedianoche) &&
+                     siguienteMedianoche - medianoche == 86400;
+    }
+
+    if (!diaRegular) {
+        return instanteLocal(anio, mes, dia, hora, minuto, segundo, segundos);
+    }
+    segundos = medianocheCacheada + hora * 3600 + minuto * 60 + segundo;
+    return true;
+}
+
+// Clase para representar un pedido
+class Pedido {
+private:
+    int id;
+    uint32_t idCliente;  // id en RegistroClientes
+    LineasPedido productos;
+    Dinero total;
+    int64_t instante;  // segundos desde 1970 en que se registro el pedido
+    bool urgente;
+
+public:
+    // Las lineas se reciben por valor y se mueven; quien llama las pasa con move
+    Pedido(int _id, string_view _nombreCliente, LineasPedido _productos, bool _urgente = false)
+        : id(_id), idCliente(RegistroClientes::global().registrar(_nombreCliente)), productos(move(_productos)), urgente(_urgente) {
+        total = calcularTotal();
+        instante = static_cast<int64_t>(time(nullptr));
+    }
+
+    // Constructor para cargar desde archivo
+    Pedido(int _id, string_view _nombreCliente, LineasPedido _productos, Dinero _total, int64_t _instante, bool _urgente = false)
+        : Pedido(_id, RegistroClientes::global().registrar(_nombreCliente), move(_productos), _total, _instante, _urgente) {
+    }
+
+    // Para clientes que ya estan en el registro (la carga en paralelo los busca una vez por tramo)
+    Pedido(int _id, uint32_t _idCliente, LineasPedido _productos, Dinero _total, int64_t _instante, bool _urgente = false)
+        : id(_id), idCliente(_idCliente), productos(move(_productos)), total(_total), instante(_instante), urgente(_urgente) {
+    }
+
+    int getId() const {
+        return id;
+    }
+
+    uint32_t getIdCliente() const {
+        return idCliente;
+    }
+
+    const string& getNombreCliente() const {
+        return RegistroClientes::global().nombre(idCliente);
+    }
+
+    const LineasPedido& getProductos() const {
+        return productos;
+    }
+
+    Dinero getTotal() const {
+        return total;
+    }
+
+    int64_t getInstante() const {
+        return instante;
+    }
+
+    // Fecha y hora local para mostrar
+    string getFechaHora() const {
+        string texto;
+        agregarFechaHora(texto, instante);
+        return texto;
+    }
+
+    bool esUrgente() const {
+        return urgente;
+    }
+
+    void setUrgente(bool _urgente) {
+        urgente = _urgente;
+    }
+
+    Dinero calcularTotal() {
+        Dinero suma;
+        for (const Producto& p : productos) {
+            suma += p.getPrecio();
+        }
+        return suma;
+    }
+
+    // Agrega el resumen de dos lineas al final de destino; los listados
+    // reutilizan el mismo buffer para todos los pedidos
+    void escribirResumen(string& destino) const {
+        destino += "ID: ";
+        agregarNumero(destino, id);
+        destino += " | Cliente: ";
+        destino += getNombreCliente();
+        if (urgente) {
+            destino += " URGENTE";
+        }
+        destino += " | Fecha: ";
+        agregarFechaHora(destino, instante);
+        destino += " | Total: Q";
+        agregarDinero(destino, total);
+
+        // Agregar productos al resumen
+        destino += "\n    Productos: ";
+        for (size_t i = 0; i < productos.size(); i++) {
+            destino += productos[i].getNombre();
+            if (i < productos.size() - 1) {
+                destino += ", ";
+            }
+        }
+    }
+
+    // Agrega el detalle con un producto por linea y el total a pagar
+    void escribirDetalle(string& destino) const {
+        destino += "ID: ";
+        agregarNumero(destino, id);
+        destino += " | Cliente: ";
+        destino += getNombreCliente();
+        if (urgente) {
+            destino += " URGENTE";
+        }
+        destino += " | Fecha: ";
+        agregarFechaHora(destino, instante);
+        destino += "\nProductos:\n";
+
+        for (const Producto& p : productos) {
+            destino += "  - ";
+            destino += p.getNombre();
+            destino += ": Q";
+            agregarDinero(destino, p.getPrecio());
+            destino += '\n';
+        }
+
+        destino += "Total a pagar: Q";
+        agregarDinero(destino, total);
+    }
+
+    string toString() const {
+        string texto;
+        escribirResumen(texto);
+        return texto;
+    }
+
+    string detalleCompleto() const {
+        string texto;
+        escribirDetalle(texto);
+        return texto;
+    }
+};
+
+// Historial de completados en memoria; sus bloques salen de un PoolNodos
+using HistorialEnMemoria = deque<Pedido, AsignadorPool<Pedido>>;
+
+// Escribe valores de ancho fijo y textos con su longitud al final de un buffer.
+// Se usa el orden de bytes de la maquina (little-endian en x86 y ARM).
+class EscritorBinario {
+private:
+    string& datos;
+
+public:
+    explicit EscritorBinario(string& _datos) : datos(_datos) {}
+
+    template <typename T>
+    void escribir(T valor) {
+        char bytes[sizeof(T)];
+        memcpy(bytes, &valor, sizeof(T));
+        datos.append(bytes, sizeof(T));
+    }
+
+    void escribirTexto(const string& texto) {
+        escribir<uint32_t>(static_cast<uint32_t>(texto.size()));
+        datos.append(texto);
+    }
+
+    // Entero sin signo en bloques de 7 bits; los valores chicos ocupan un byte
+    void escribirVarint(uint64_t valor) {
+        while (valor >= 0x80) {
+            datos += static_cast<char>((valor & 0x7F) | 0x80);
+            valor >>= 7;
+        }
+        datos += static_cast<char>(valor);
+    }
+
+    // Entero con signo como varint: 0, -1, 1, -2... pasan a 0, 1, 2, 3...
+    void escribirZigzag(int64_t valor) {
+        escribirVarint((static_cast<uint64_t>(valor) << 1) ^ static_cast<uint64_t>(valor >> 63));
+    }
+};
+
+// Lee lo que escribe EscritorBinario; cada lectura falla si se pasa del final
+class LectorBinario {
+private:
+    const char* actual;
+    const char* fin;
+
+public:
+    LectorBinario(const char* inicio, const char* _fin) : actual(inicio), fin(_fin) {}
+
+    template <typename T>
+    bool leer(T& valor) {
+        if (static_cast<size_t>(fin - actual) < sizeof(T)) {
+            return false;
+        }
+        memcpy(&valor, actual, sizeof(T));
+        actual += sizeof(T);
+        return true;
+    }
+
+    bool leerTexto(string& texto) {
+        uint32_t longitud;
+        if (!leer(longitud) || static_cast<size_t>(fin - actual) < longitud) {
+            return false;
+        }
+        texto.assign(actual, longitud);
+        actual += longitud;
+        return true;
+    }
+
+    // Igual que leerTexto pero sin copiar: el texto apunta a los datos leidos
+    bool leerTexto(string_view& texto) {
+        uint32_t longitud;
+        if (!leer(longitud) || static_cast<size_t>(fin - actual) < longitud) {
+            return false;
+        }
+        texto = string_view(actual, longitud);
+        actual += longitud;
+        return true;
+    }
+
+    bool saltar(size_t bytes) {
+        if (static_cast<size_t>(fin - actual) < bytes) {
+            return false;
+        }
+        actual += bytes;
+        return true;
+    }
+
+    const char* posicion() const {
+        return actual;
+    }
+
+    // Bytes sin leer; sirve para descartar cantidades que no caben en lo que queda
+    size_t restante() const {
+        return static_cast<size_t>(fin - actual);
+    }
+
+    bool leerVarint(uint64_t& valor) {
+        valor = 0;
+        for (int desplazamiento = 0; desplazamiento < 64; desplazamiento += 7) {
+            if (actual == fin) {
+                return false;
+            }
+            uint8_t byte = static_cast<uint8_t>(*actual++);
+            valor |= static_cast<uint64_t>(byte & 0x7F) << desplazamiento;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool leerZigzag(int64_t& valor) {
+        uint64_t codificado;
+        if (!leerVarint(codificado)) {
+            return false;
+        }
+        valor = static_cast<int64_t>(codificado >> 1) ^ -static_cast<int64_t>(codificado & 1);
+        return true;
+    }
+
+    bool terminado() const {
+        return actual == fin;
+    }
+};
+
+// Checksum de 64 bits que avanza de 8 en 8 bytes para no frenar la carga
+uint64_t calcularChecksum(const char* datos, size_t tamano) {
+    const uint64_t primo = 0x100000001b3ULL;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i = 0;
+
+    for (; i + 8 <= tamano; i += 8) {
+        uint64_t palabra;
+        memcpy(&palabra, datos + i, 8);
+        h = (h ^ palabra) * primo;
+        h ^= h >> 29;
+    }
+    for (; i < tamano; i++) {
+        h = (h ^ static_cast<unsigned char>(datos[i])) * primo;
+    }
+    return h;
+}
+
+// calcularChecksum por partes: da lo mismo que sobre todos los datos juntos,
+// sin importar donde se corten. Sirve para escribir un archivo mientras se arma.
+class ChecksumIncremental {
+private:
+    static const uint64_t PRIMO = 0x100000001b3ULL;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    char pendiente[8];
+    size_t cantidadPendiente = 0;
+
+    void agregarPalabra(const char* datos) {
+        uint64_t palabra;
+        memcpy(&palabra, datos, 8);
+        h = (h ^ palabra) * PRIMO;
+        h ^= h >> 29;
+    }
+
+public:
+    void agregar(const char* datos, size_t tamano) {
+        size_t i = 0;
+        if (cantidadPendiente > 0) {
+            i = min(8 - cantidadPendiente, tamano);
+            memcpy(pendiente + cantidadPendiente, datos, i);
+            cantidadPendiente += i;
+            if (cantidadPendiente < 8) {
+                return;
+            }
+            agregarPalabra(pendiente);
+            cantidadPendiente = 0;
+        }
+        for (; i + 8 <= tamano; i += 8) {
+            agregarPalabra(datos + i);
+        }
+        cantidadPendiente = tamano - i;
+        memcpy(pendiente, datos + i, cantidadPendiente);
+    }
+
+    uint64_t valor() const {
+        uint64_t resultado = h;
+        for (size_t i = 0; i < cantidadPendiente; i++) {
+            resultado = (resultado ^ static_cast<unsigned char>(pendiente[i])) * PRIMO;
+        }
+        return resultado;
+    }
+};
+
+// Archivo de solo lectura mapeado en memoria. Un archivo vacio se considera
+// abierto pero sin contenido.
+class ArchivoMapeado {
+private:
+    const char* datos = nullptr;
+    size_t tamano = 0;
+    bool abierto = false;
+#ifdef _WIN32
+    HANDLE manejador = INVALID_HANDLE_VALUE;
+    HANDLE mapeo = nullptr;
+#endif
+
+public:
+    explicit ArchivoMapeado(const string& ruta) {
+#ifdef _WIN32
+        manejador = CreateFileA(ruta.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (manejador == INVALID_HANDLE_VALUE) {
+            return;
+        }
+
+        LARGE_INTEGER tamanoArchivo;
+        if (!GetFileSizeEx(manejador, &tamanoArchivo)) {
+            return;
+        }
+        tamano = static_cast<size_t>(tamanoArchivo.QuadPart);
+        abierto = true;
+        if (tamano == 0) {
+            return;
+        }
+
+        mapeo = CreateFileMappingA(manejador, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapeo != nullptr) {
+            datos = static_cast<const char*>(MapViewOfFile(mapeo, FILE_MAP_READ, 0, 0, 0));
+        }
+#else
+        int descriptor = open(ruta.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            return;
+        }
+
+        struct stat informacion;
+        if (fstat(descriptor, &informacion) == 0) {
+            tamano = static_cast<size_t>(informacion.st_size);
+            abierto = true;
+            if (tamano > 0) {
+                void* direccion = mmap(nullptr, tamano, PROT_READ, MAP_PRIVATE, descriptor, 0);
+                if (direccion != MAP_FAILED) {
+                    datos = static_cast<const char*>(direccion);
+                    madvise(direccion, tamano, MADV_SEQUENTIAL);
+                }
+            }
+        }
+        close(descriptor);
+#endif
+        if (tamano > 0 && datos == nullptr) {
+            abierto = false;
+        }
+    }
+
+    ~ArchivoMapeado() {
+#ifdef _WIN32
+        if (datos != nullptr) UnmapViewOfFile(datos);
+        if (mapeo != nullptr) CloseHandle(mapeo);
+        if (manejador != INVALID_HANDLE_VALUE) CloseHandle(manejador);
+#else
+        if (datos != nullptr) munmap(const_cast<char*>(datos), tamano);
+#endif
+    }
+
+    ArchivoMapeado(const ArchivoMapeado&) = delete;
+    ArchivoMapeado& operator=(const ArchivoMapeado&) = delete;
+
+    bool estaAbierto() const {
+        return abierto;
+    }
+
+    string_view contenido() const {
+        return datos == nullptr ? string_view() : string_view(datos, tamano);
+    }
+};
+
+// Separa el siguiente campo hasta 'separador' y avanza el resto
+bool siguienteCampo(string_view& resto, char separador, string_view& campo) {
+    if (resto.data() == nullptr) {
+        return false;
+    }
+
+    size_t fin = resto.find(separador);
+    if (fin == string_view::npos) {
+        campo = resto;
+        resto = string_view();
+    }
+    else {
+        campo = resto.substr(0, fin);
+        resto = resto.substr(fin + 1);
+    }
+    return true;
+}
+
+// Interpreta una linea "id|cliente|n|producto,precio|...|total|fecha|urgente".
+// idsVistos guarda los ids de catalogo de los nombres ya encontrados, asi no se
+// toma el mutex del catalogo en cada linea. Devuelve false si la linea no tiene
+// el formato esperado.
+bool interpretarLineaPedido(string_view linea, int& id, string_view& nombreCliente, LineasPedido& productos,
+                            Dinero& total, string_view& fechaHora, bool& urgente,
+                            unordered_map<string_view, uint16_t>& idsVistos) {
+    string_view resto = linea;
+    string_view campo;
+    int numProductos;
+
+    if (!siguienteCampo(resto, '|', campo) || !convertirNumero(campo, id)) return false;
+    if (!siguienteCampo(resto, '|', nombreCliente)) return false;
+    if (!siguienteCampo(resto, '|', campo) || !convertirNumero(campo, numProductos) || numProductos < 0 ||
+        static_cast<size_t>(numProductos) > MAXIMO_LINEAS_PEDIDO) return false;
+    // Cada producto es un campo; un numero mayor que los campos que quedan es una linea danada
+    if (static_cast<size_t>(numProductos) > static_cast<size_t>(count(resto.begin(), resto.end(), '|'))) return false;
+
+    productos.clear();
+    productos.reserve(numProductos);
+    for (int i = 0; i < numProductos; i++) {
+        string_view nombreProd, precioProd;
+        Dinero precio;
+        if (!siguienteCampo(resto, '|', campo)) return false;
+        siguienteCampo(campo, ',', nombreProd);
+        if (!siguienteCampo(campo, ',', precioProd) || !Dinero::interpretar(precioProd, precio)) return false;
+
+        auto visto = idsVistos.find(nombreProd);
+        if (visto == idsVistos.end()) {
+            visto = idsVistos.emplace(nombreProd, CatalogoProductos::global().registrar(nombreProd, precio)).first;
+        }
+        productos.push_back(Producto(visto->second, precio));
+    }
+
+    if (!siguienteCampo(resto, '|', campo) || !Dinero::interpretar(campo, total)) return false;
+    if (!siguienteCampo(resto, '|', fechaHora)) return false;
+    if (!siguienteCampo(resto, '|', campo)) return false;
+    urgente = (campo == "1");
+    return true;
+}
+
+// Hilos que puede usar el trabajo en paralelo que se lanza desde este hilo:
+// todos los del hardware, salvo dentro de un reparto que le asigna una parte
+// (PresupuestoHilos), asi las sucursales en paralelo no multiplican los hilos
+inline size_t& presupuestoDelHilo() {
+    thread_local size_t presupuesto = 0;
+    return presupuesto;
+}
+
+inline size_t hilosDisponibles() {
+    size_t presupuesto = presupuestoDelHilo();
+    return presupuesto > 0 ? presupuesto : max<size_t>(1, thread::hardware_concurrency());
+}
+
+// Limita hilosDisponibles() en este hilo mientras exista
+class PresupuestoHilos {
+private:
+    size_t anterior;
+
+public:
+    explicit PresupuestoHilos(size_t hilos) : anterior(presupuestoDelHilo()) {
+        presupuestoDelHilo() = max<size_t>(1, hilos);
+    }
+
+    ~PresupuestoHilos() {
+        presupuestoDelHilo() = anterior;
+    }
+
+    PresupuestoHilos(const PresupuestoHilos&) = delete;
+    PresupuestoHilos& operator=(const PresupuestoHilos&) = delete;
+};
+
+// Produce los tramos 0..cantidadTramos-1 con producir(tramo) en hasta `hilos`
+// hilos y entrega cada resultado a consumir(tramo, resultado) en el hilo que
+// llama y en orden de tramo. Los hilos no se adelantan mas de dos tramos por
+// hilo a lo ya consumido, asi la memoria no crece con el tamano del archivo.
+// Si producir o consumir lanzan una excepcion no se empiezan mas tramos, se
+// espera a los hilos y la excepcion se relanza en el hilo que llama; los
+// tramos anteriores ya se consumieron.
+template <typename Resultado, typename Producir, typename Consumir>
+void procesarTramosEnOrden(size_t cantidadTramos, size_t hilos, Producir producir, Consumir consumir) {
+    hilos = min(max<size_t>(1, hilos), cantidadTramos);
+    if (hilos <= 1) {
+        for (size_t tramo = 0; tramo < cantidadTramos; tramo++) {
+            consumir(tramo, producir(tramo));
+        }
+        return;
+    }
+
+    size_t ventana = 2 * hilos;
+    vector<optional<Resultado>> resultados(cantidadTramos);
+    mutex mutexTramos;
+    condition_variable tramoListo, hayEspacio;
+    size_t siguiente = 0;
+    size_t consumidos = 0;
+    // Primera excepcion de un trabajador o del consumidor; detiene a todos
+    exception_ptr fallo;
+
+    auto detener = [&](exception_ptr excepcion) {
+        {
+            lock_guard<mutex> bloqueo(mutexTramos);
+            if (!fallo) {
+                fallo = excepcion;
+            }
+        }
+        hayEspacio.notify_all();
+        tramoListo.notify_all();
+    };
+
+    auto trabajar = [&] {
+        while (true) {
+            size_t tramo;
+            {
+                unique_lock<mutex> bloqueo(mutexTramos);
+                hayEspacio.wait(bloqueo, [&] { return fallo || siguiente >= cantidadTramos || siguiente < consumidos + ventana; });
+                if (fallo || siguiente >= cantidadTramos) {
+                    return;
+                }
+                tramo = siguiente++;
+            }
+
+            try {
+                Resultado resultado = producir(tramo);
+                {
+                    lock_guard<mutex> bloqueo(mutexTramos);
+                    resultados[tramo] = move(resultado);
+                }
+                tramoListo.notify_one();
+            }
+            catch (...) {
+                detener(current_exception());
+                return;
+            }
+        }
+    };
+
+    vector<thread> trabajadores;
+    for (size_t i = 0; i < hilos; i++) {
+        trabajadores.emplace_back(trabajar);
+    }
+
+    for (size_t tramo = 0; tramo < cantidadTramos; tramo++) {
+        Resultado resultado;
+        {
+            unique_lock<mutex> bloqueo(mutexTramos);
+            tramoListo.wait(bloqueo, [&] { return fallo || resultados[tramo].has_value(); });
+            if (fallo) {
+                break;
+            }
+            resultado = move(*resultados[tramo]);
+            resultados[tramo].reset();
+            consumidos++;
+        }
+        hayEspacio.notify_all();
+        try {
+            consumir(tramo, move(resultado));
+        }
+        catch (...) {
+            detener(current_exception());
+            break;
+        }
+    }
+
+    for (thread& trabajador : trabajadores) {
+        trabajador.join();
+    }
+    if (fallo) {
+        rethrow_exception(fallo);
+    }
+}
+
+// Bytes de archivo de texto que interpreta cada hilo de una vez
+const size_t BYTES_POR_TRAMO_TEXTO = 1 << 22;
+
+// Posiciones donde empieza cada tramo de texto (y al final el tamano); cada
+// tramo termina en un salto de linea
+vector<size_t> cortarEnLineas(string_view contenido) {
+    vector<size_t> cortes = { 0 };
+    while (cortes.back() < contenido.size()) {
+        size_t corte = cortes.back() + BYTES_POR_TRAMO_TEXTO;
+        if (corte >= contenido.size()) {
+            corte = contenido.size();
+        }
+        else {
+            size_t finLinea = contenido.find('\n', corte);
+            corte = (finLinea == string_view::npos) ? contenido.size() : finLinea + 1;
+        }
+        cortes.push_back(corte);
+    }
+    return cortes;
+}
+
+// Recorre un archivo de pedidos en texto mapeado en memoria y entrega cada pedido
+// valido a alLeerPedido(pedido) en el orden del archivo. El archivo se corta en
+// tramos en los saltos de linea y los tramos se interpretan en paralelo.
+// Devuelve false si no se pudo abrir o si la lectura fallo a mitad (por
+// ejemplo, sin memoria); en ese caso solo se entrego una parte de los pedidos.
+// Si se pasa fechasInvalidas, se agregan ahi los IDs de los pedidos cuya fecha
+// no se entendio.
+template <typename Funcion>
+bool leerPedidosTexto(const string& ruta, Funcion alLeerPedido, vector<int>* fechasInvalidas = nullptr) {
+    ArchivoMapeado archivo(ruta);
+    if (!archivo.estaAbierto()) {
+        return false;
+    }
+
+    string_view contenido = archivo.contenido();
+    vector<size_t> cortes = cortarEnLineas(contenido);
+
+    // Pedidos del tramo y los IDs de los que quedaron sin fecha
+    using TramoPedidos = pair<vector<Pedido>, vector<int>>;
+    auto interpretarTramo = [&](size_t tramo) {
+        TramoPedidos resultado;
+        vector<Pedido>& pedidos = resultado.first;
+        unordered_map<string_view, uint16_t> idsVistos;
+        unordered_map<string_view, uint32_t> clientesVistos;
+        LineasPedido productos;
+        string_view resto = contenido.substr(cortes[tramo], cortes[tramo + 1] - cortes[tramo]);
+        string_view linea;
+
+        while (!resto.empty() && siguienteCampo(resto, '\n', linea)) {
+            if (!linea.empty() && linea.back() == '\r') {
+                linea.remove_suffix(1);
+            }
+
+            int id;
+            string_view nombreCliente, fechaHora;
+            Dinero total;
+            bool urgente;
+            if (!interpretarLineaPedido(linea, id, nombreCliente, productos, total, fechaHora, urgente, idsVistos)) {
+                continue; // Formato inválido
+            }
+
+            // Una fecha que no se entiende queda en 0 (01/01/1970) en lugar de perder
+            // el pedido; se informa para que no pase desapercibido
+            int64_t instante = 0;
+            if (!interpretarFechaHora(fechaHora, instante)) {
+                instante = 0;
+                resultado.second.push_back(id);
+            }
+            auto cliente = clientesVistos.find(nombreCliente);
+            if (cliente == clientesVistos.end()) {
+                cliente = clientesVistos.emplace(nombreCliente, RegistroClientes::global().registrar(nombreCliente)).first;
+            }
+            pedidos.push_back(Pedido(id, cliente->second, move(productos), total, instante, urgente));
+        }
+        return resultado;
+    };
+
+    try {
+        procesarTramosEnOrden<TramoPedidos>(cortes.size() - 1, hilosDisponibles(), interpretarTramo,
+                                            [&](size_t, TramoPedidos&& tramo) {
+                                                for (Pedido& pedido : tramo.first) {
+                                                    alLeerPedido(move(pedido));
+                                                }
+                                                if (fechasInvalidas != nullptr) {
+                                                    fechasInvalidas->insert(fechasInvalidas->end(), tramo.second.begin(),
+                                                                            tramo.second.end());
+                                                }
+                                            });
+    }
+    catch (const exception&) {
+        return false;
+    }
+    return true;
+}
+
+// Formato binario del respaldo (pedidos.dat):
+//   encabezado: "PEDB", version (u16), reservado (u16), productos en la tabla (u32),
+//               pendientes (u64), completados (u64), bytes de datos (u64), checksum (u64)
+//   datos:      tabla de productos (nombre, precio f64) seguida de los pedidos
+//               pendientes y completados. Cada pedido guarda id (i32), urgente (u8),
+//               cliente, fecha, total (f64) y sus lineas como indice en la tabla (u16)
+//               mas el precio cobrado (f64). Los textos van precedidos de su longitud (u32).
+// Desde la version 2 el encabezado incluye, antes de los bytes de datos, la secuencia
+// (u64) del ultimo evento del journal que ya esta incluido en el respaldo.
+// Desde la version 3 los precios y totales son centavos (i64) en lugar de f64.
+// Desde la version 4 la fecha es un instante (i64, segundos desde 1970) en lugar de texto.
+// Desde la version 5 despues de los pedidos van los segmentos del historial archivado
+// (u32 y el numero de cada uno, u32) y los pedidos eliminados de ellos (u32 y por cada
+// uno el segmento, u32, y el ID, i32).
+const char MAGICO_SNAPSHOT[4] = { 'P', 'E', 'D', 'B' };
+const uint16_t VERSION_SNAPSHOT = 5;
+const size_t TAMANO_ENCABEZADO_SNAPSHOT_V1 = 44;
+const size_t TAMANO_ENCABEZADO_SNAPSHOT = 52;
+
+// Los montos se escriben en centavos; los formatos anteriores los guardaban en f64
+void escribirMonto(EscritorBinario& escritor, Dinero monto) {
+    escritor.escribir<int64_t>(monto.getCentavos());
+}
+
+bool leerMonto(LectorBinario& lector, bool enCentavos, Dinero& monto) {
+    if (enCentavos) {
+        int64_t centavos;
+        if (!lector.leer(centavos)) {
+            return false;
+        }
+        monto = Dinero::desdeCentavos(centavos);
+        return true;
+    }
+
+    double valor;
+    if (!lector.leer(valor)) {
+        return false;
+    }
+    monto = Dinero::desdeDouble(valor);
+    return true;
+}
+
+// Los formatos anteriores guardaban la fecha como texto "dd/mm/aaaa hh:mm:ss"
+bool leerInstante(LectorBinario& lector, bool comoTexto, int64_t& instante) {
+    if (!comoTexto) {
+        return lector.leer(instante);
+    }
+
+    string fechaHora;
+    if (!lector.leerTexto(fechaHora)) {
+        return false;
+    }
+    instante = 0;
+    interpretarFechaHora(fechaHora, instante);
+    return true;
+}
+
+bool esArchivoSnapshot(const string& ruta) {
+    ifstream archivo(ruta, ios::binary);
+    char magico[4];
+    if (!archivo.read(magico, sizeof(magico))) {
+        return false;
+    }
+    return memcmp(magico, MAGICO_SNAPSHOT, sizeof(magico)) == 0;
+}
+
+// Fuerza que lo escrito en el archivo llegue al disco
+void sincronizarArchivo(FILE* archivo) {
+    fflush(archivo);
+#ifdef _WIN32
+    _commit(_fileno(archivo));
+#else
+    fsync(fileno(archivo));
+#endif
+}
+
+// Reemplaza destino por origen en un solo paso
+bool reemplazarArchivo(const string& origen, const string& destino) {
+#ifdef _WIN32
+    return MoveFileExA(origen.c_str(), destino.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(origen.c_str(), destino.c_str()) == 0;
+#endif
+}
+
+// Hilo que ejecuta un trabajo a la vez (los respaldos en segundo plano). Quien
+// lo lanza pregunta con terminado() sin bloquear y despues llama a recoger()
+// para tomar el resultado; recoger() espera si todavia no termino. El hilo se
+// crea con el primer trabajo. Un trabajo que lanza una excepcion da false.
+class TrabajoEnSegundoPlano {
+private:
+    mutex mutexTrabajo;
+    condition_variable aviso;
+    function<bool()> trabajo;
+    bool hayTrabajo = false;
+    bool detener = false;
+    bool resultado = false;
+    atomic<bool> listo{ false };
+    bool lanzado = false;
+    thread hilo;
+
+    void ejecutar() {
+        unique_lock<mutex> candado(mutexTrabajo);
+        while (true) {
+            aviso.wait(candado, [&] { return hayTrabajo || detener; });
+            if (!hayTrabajo) {
+                return;
+            }
+            function<bool()> actual = move(trabajo);
+            candado.unlock();
+            // Una excepcion aqui terminaria el proceso; cuenta como trabajo fallido
+            bool correcto = false;
+            try {
+                correcto = actual();
+            }
+            catch (...) {
+                correcto = false;
+            }
+            candado.lock();
+            resultado = correcto;
+            hayTrabajo = false;
+            listo.store(true, memory_order_release);
+            aviso.notify_all();
+        }
+    }
+
+public:
+    TrabajoEnSegundoPlano() = default;
+    TrabajoEnSegundoPlano(const TrabajoEnSegundoPlano&) = delete;
+    TrabajoEnSegundoPlano& operator=(const TrabajoEnSegundoPlano&) = delete;
+
+    ~TrabajoEnSegundoPlano() {
+        if (!hilo.joinable()) {
+            return;
+        }
+        {
+            lock_guard<mutex> candado(mutexTrabajo);
+            detener = true;
+        }
+        aviso.notify_all();
+        hilo.join();
+    }
+
+    // No debe haber otro trabajo lanzado sin recoger
+    void lanzar(function<bool()> nuevo) {
+        if (!hilo.joinable()) {
+            hilo = thread(&TrabajoEnSegundoPlano::ejecutar, this);
+        }
+        {
+            lock_guard<mutex> candado(mutexTrabajo);
+            trabajo = move(nuevo);
+            hayTrabajo = true;
+            listo.store(false, memory_order_relaxed);
+        }
+        lanzado = true;
+        aviso.notify_all();
+    }
+
+    bool terminado() const {
+        return lanzado && listo.load(memory_order_acquire);
+    }
+
+    bool recoger() {
+        if (!lanzado) {
+            return false;
+        }
+        unique_lock<mutex> candado(mutexTrabajo);
+        aviso.wait(candado, [&] { return listo.load(memory_order_relaxed); });
+        lanzado = false;
+        return resultado;
+    }
+};
+
+// Exportacion del historial para analizarlo con otras herramientas, en CSV o en
+// JSON Lines (un objeto por linea). Los filtros se revisan sobre los campos tal
+// como salen del archivo: las filas que no pasan se saltan sin armar un Pedido.
+enum class FormatoExportacion {
+    Csv,
+    JsonLines
+};
+
+// "csv" o "jsonl"
+bool interpretarFormatoExportacion(string_view texto, FormatoExportacion& formato) {
+    if (texto == "csv") {
+        formato = FormatoExportacion::Csv;
+    }
+    else if (texto == "jsonl") {
+        formato = FormatoExportacion::JsonLines;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+// Lo que no se indica no filtra. desde y hasta son instantes (segundos desde
+// 1970) e incluyen los extremos; cliente y producto son nombres exactos y un
+// pedido pasa por producto si alguna de sus lineas lo tiene.
+struct FiltroExportacion {
+    int64_t desde = numeric_limits<int64_t>::min();
+    int64_t hasta = numeric_limits<int64_t>::max();
+    int urgencia = -1;  // -1 todos, 0 solo normales, 1 solo urgentes
+    string cliente;
+    string producto;
+
+    bool admiteInstante(int64_t instante) const {
+        return instante >= desde && instante <= hasta;
+    }
+
+    // Si algun pedido con fecha entre minimo y maximo puede pasar
+    bool admiteRango(int64_t minimo, int64_t maximo) const {
+        return maximo >= desde && minimo <= hasta;
+    }
+
+    bool admiteUrgencia(bool urgente) const {
+        return urgencia < 0 || urgencia == (urgente ? 1 : 0);
+    }
+
+    bool admiteCliente(string_view nombre) const {
+        return cliente.empty() || nombre == cliente;
+    }
+};
+
+// Un pedido como lo ve la exportacion. Los textos apuntan a donde se leyeron
+// (archivo mapeado, catalogo o registro de clientes) y la misma fila se
+// reutiliza de un pedido al siguiente.
+struct FilaExportada {
+    int id = 0;
+    bool pendiente = false;
+    string_view cliente;
+    int64_t instante = 0;
+    bool urgente = false;
+    Dinero total;
+    vector<pair<string_view, Dinero>> productos;  // nombre y precio cobrado
+};
+
+// La exportacion escribe cada fila con un cursor sobre lugar ya reservado: con
+// cientos de millones de campos, pasar por string::append en cada uno cuesta
+// mas que leer el archivo.
+inline void escribirTexto(char*& cursor, string_view texto) {
+    memcpy(cursor, texto.data(), texto.size());
+    cursor += texto.size();
+}
+
+inline void escribirNumero(char*& cursor, int64_t valor) {
+    cursor = to_chars(cursor, cursor + 24, valor).ptr;
+}
+
+inline void escribirDinero(char*& cursor, Dinero valor) {
+    int64_t centavos = valor.getCentavos();
+    uint64_t absoluto = static_cast<uint64_t>(centavos);
+    if (centavos < 0) {
+        *cursor++ = '-';
+        absoluto = 0 - absoluto;
+    }
+    cursor = to_chars(cursor, cursor + 24, absoluto / 100).ptr;
+    cursor[0] = '.';
+    cursor[1] = static_cast<char>('0' + absoluto % 100 / 10);
+    cursor[2] = static_cast<char>('0' + absoluto % 10);
+    cursor += 3;
+}
+
+inline bool necesitaComillasCsv(string_view campo) {
+    for (char c : campo) {
+        if (c == ',' || c == '"' || c == '\n' || c == '\r') {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Sin las comillas de los extremos; duplica las de adentro
+inline void escribirEscapadoCsv(char*& cursor, string_view campo) {
+    for (char c : campo) {
+        if (c == '"') {
+            *cursor++ = '"';
+        }
+        *cursor++ = c;
+    }
+}
+
+inline void escribirCampoCsv(char*& cursor, string_view campo) {
+    if (!necesitaComillasCsv(campo)) {
+        escribirTexto(cursor, campo);
+        return;
+    }
+    *cursor++ = '"';
+    escribirEscapadoCsv(cursor, campo);
+    *cursor++ = '"';
+}
+
+inline void escribirTextoJson(char*& cursor, string_view texto) {
+    static const char HEXADECIMAL[] = "0123456789abcdef";
+    *cursor++ = '"';
+    for (char c : texto) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            cursor[0] = '\\';
+            cursor[1] = c;
+            cursor += 2;
+        }
+        else if (byte < 0x20) {
+            memcpy(cursor, "\\u00", 4);
+            cursor[4] = HEXADECIMAL[byte >> 4];
+            cursor[5] = HEXADECIMAL[byte & 0xF];
+            cursor += 6;
+        }
+        else {
+            *cursor++ = c;
+        }
+    }
+    *cursor++ = '"';
+}
+
+// Columnas del CSV; productos va como "nombre:precio;nombre:precio"
+const char ENCABEZADO_CSV[] = "id,estado,cliente,fecha,instante,urgente,total,productos\n";
+
+// Lo mas que puede ocupar la fila formateada; un texto crece hasta 6 veces al
+// escaparse en JSON
+inline size_t cotaFilaExportada(const FilaExportada& fila) {
+    size_t cota = 256 + 6 * fila.cliente.size();
+    for (const auto& producto : fila.productos) {
+        cota += 64 + 6 * producto.first.size();
+    }
+    return cota;
+}
+
+// Escribe la fila en CSV o JSON Lines; cursor debe tener lugar para
+// cotaFilaExportada(fila). La fecha va en ISO 8601 (hora local) y tambien como
+// instante.
+void escribirFilaExportada(char*& cursor, FormatoExportacion formato, const FilaExportada& fila) {
+    string_view estado = fila.pendiente ? "pendiente" : "completado";
+
+    if (formato == FormatoExportacion::Csv) {
+        escribirNumero(cursor, fila.id);
+        *cursor++ = ',';
+        escribirTexto(cursor, estado);
+        *cursor++ = ',';
+        escribirCampoCsv(cursor, fila.cliente);
+        *cursor++ = ',';
+        escribirFechaIso(cursor, fila.instante);
+        *cursor++ = ',';
+        escribirNumero(cursor, fila.instante);
+        escribirTexto(cursor, fila.urgente ? ",1," : ",0,");
+        escribirDinero(cursor, fila.total);
+        *cursor++ = ',';
+
+        bool comillas = false;
+        for (const auto& producto : fila.productos) {
+            comillas = comillas || necesitaComillasCsv(producto.first);
+        }
+        if (comillas) {
+            *cursor++ = '"';
+        }
+        for (size_t i = 0; i < fila.productos.size(); i++) {
+            if (i > 0) {
+                *cursor++ = ';';
+            }
+            if (comillas) {
+                escribirEscapadoCsv(cursor, fila.productos[i].first);
+            }
+            else {
+                escribirTexto(cursor, fila.productos[i].first);
+            }
+            *cursor++ = ':';
+            escribirDinero(cursor, fila.productos[i].second);
+        }
+        if (comillas) {
+            *cursor++ = '"';
+        }
+        *cursor++ = '\n';
+    }
+    else {
+        escribirTexto(cursor, "{\"id\":");
+        escribirNumero(cursor, fila.id);
+        escribirTexto(cursor, ",\"estado\":\"");
+        escribirTexto(cursor, estado);
+        escribirTexto(cursor, "\",\"cliente\":");
+        escribirTextoJson(cursor, fila.cliente);
+        escribirTexto(cursor, ",\"fecha\":\"");
+        escribirFechaIso(cursor, fila.instante);
+        escribirTexto(cursor, "\",\"instante\":");
+        escribirNumero(cursor, fila.instante);
+        escribirTexto(cursor, fila.urgente ? ",\"urgente\":true,\"total\":" : ",\"urgente\":false,\"total\":");
+        escribirDinero(cursor, fila.total);
+        escribirTexto(cursor, ",\"productos\":[");
+        for (size_t i = 0; i < fila.productos.size(); i++) {
+            escribirTexto(cursor, (i == 0) ? "{\"nombre\":" : ",{\"nombre\":");
+            escribirTextoJson(cursor, fila.productos[i].first);
+            escribirTexto(cursor, ",\"precio\":");
+            escribirDinero(cursor, fila.productos[i].second);
+            *cursor++ = '}';
+        }
+        escribirTexto(cursor, "]}\n");
+    }
+}
+
+// Agrega la fila despues de los primeros `usado` bytes de destino. destino crece
+// al doble cuando no alcanza, asi no se inicializa memoria en cada fila.
+inline void agregarFilaExportada(string& destino, size_t& usado, FormatoExportacion formato, const FilaExportada& fila) {
+    size_t cota = cotaFilaExportada(fila);
+    if (destino.size() < usado + cota) {
+        destino.resize(max(2 * destino.size(), usado + cota));
+    }
+    char* cursor = &destino[usado];
+    escribirFilaExportada(cursor, formato, fila);
+    usado = static_cast<size_t>(cursor - destino.data());
+}
+
+// Junta las filas en un bloque y lo escribe cuando se llena, asi la memoria no
+// depende de cuantas filas se exportan
+class EscritorExportacion {
+private:
+    static const size_t BYTES_POR_ESCRITURA = 1 << 20;
+
+    FILE* destino;
+    FormatoExportacion formato;
+    string bloque;
+    size_t usado = 0;  // bytes de bloque que faltan escribir
+    size_t filas = 0;
+    uint64_t bytes = 0;
+    bool correcto = true;
+
+    void escribirBytes(const char* datos, size_t tamano) {
+        correcto = correcto && fwrite(datos, 1, tamano, destino) == tamano;
+        bytes += tamano;
+    }
+
+public:
+    EscritorExportacion(FILE* _destino, FormatoExportacion _formato) : destino(_destino), formato(_formato) {
+        bloque.resize(BYTES_POR_ESCRITURA + (1 << 12));
+        if (formato == FormatoExportacion::Csv) {
+            usado = sizeof(ENCABEZADO_CSV) - 1;
+            memcpy(&bloque[0], ENCABEZADO_CSV, usado);
+        }
+    }
+
+    FormatoExportacion getFormato() const {
+        return formato;
+    }
+
+    void escribir(const FilaExportada& fila) {
+        agregarFilaExportada(bloque, usado, formato, fila);
+        filas++;
+        if (usado >= BYTES_POR_ESCRITURA) {
+            vaciar();
+        }
+    }
+
+    // Filas que ya se formatearon en otro hilo
+    void escribirFormateadas(string_view texto, size_t cantidad) {
+        vaciar();
+        escribirBytes(texto.data(), texto.size());
+        filas += cantidad;
+    }
+
+    void vaciar() {
+        escribirBytes(bloque.data(), usado);
+        usado = 0;
+    }
+
+    // Devuelve false si alguna escritura fallo
+    bool terminar() {
+        vaciar();
+        return correcto && fflush(destino) == 0;
+    }
+
+    size_t cantidadFilas() const {
+        return filas;
+    }
+
+    uint64_t bytesEscritos() const {
+        return bytes;
+    }
+};
+
+// Lee una linea del formato de texto en fila si pasa el filtro, sin armar el
+// Pedido. La urgencia (el ultimo campo) y el cliente se revisan antes de
+// separar los productos, y la fecha se interpreta solo si lo demas paso.
+// fechaValida queda en false si la fecha no se entendio.
+bool filtrarLineaPedido(string_view linea, const FiltroExportacion& filtro, FilaExportada& fila, bool& fechaValida) {
+    size_t ultimoSeparador = linea.rfind('|');
+    if (ultimoSeparador == string_view::npos) {
+        return false;
+    }
+    fila.urgente = (linea.substr(ultimoSeparador + 1) == "1");
+    if (!filtro.admiteUrgencia(fila.urgente)) {
+        return false;
+    }
+
+    string_view resto = linea.substr(0, ultimoSeparador);
+    string_view campo, fechaHora;
+    int numProductos;
+    if (!siguienteCampo(resto, '|', campo) || !convertirNumero(campo, fila.id)) return false;
+    if (!siguienteCampo(resto, '|', fila.cliente) || !filtro.admiteCliente(fila.cliente)) return false;
+    if (!siguienteCampo(resto, '|', campo) || !convertirNumero(campo, numProductos) || numProductos < 0 ||
+        static_cast<size_t>(numProductos) > MAXIMO_LINEAS_PEDIDO) return false;
+
+    fila.productos.clear();
+    bool tieneProducto = filtro.producto.empty();
+    for (int i = 0; i < numProductos; i++) {
+        string_view nombreProd, precioProd;
+        Dinero precio;
+        if (!siguienteCampo(resto, '|', campo)) return false;
+        siguienteCampo(campo, ',', nombreProd);
+        if (!siguienteCampo(campo, ',', precioProd) || !Dinero::interpretar(precioProd, precio)) return false;
+        fila.productos.emplace_back(nombreProd, precio);
+        tieneProducto = tieneProducto || nombreProd == filtro.producto;
+    }
+    if (!tieneProducto) return false;
+
+    if (!siguienteCampo(resto, '|', campo) || !Dinero::interpretar(campo, fila.total)) return false;
+    if (!siguienteCampo(resto, '|', fechaHora)) return false;
+    // Como en la carga, una fecha que no se entiende queda en 0
+    fechaValida = interpretarFechaHora(fechaHora, fila.instante);
+    if (!fechaValida) {
+        fila.instante = 0;
+    }
+    return filtro.admiteInstante(fila.instante);
+}
+
+// Recorre un archivo de pedidos en texto y entrega a alTerminarTramo(texto, filas),
+// en el orden del archivo, las filas que pasan el filtro ya formateadas. Los
+// tramos se interpretan en paralelo como en leerPedidosTexto. Suma a
+// fechasInvalidas las filas entregadas cuya fecha no se entendio. Devuelve
+// false si no se pudo abrir o si la lectura fallo a mitad.
+template <typename Funcion>
+bool filtrarPedidosTexto(const string& ruta, bool pendientes, const FiltroExportacion& filtro, FormatoExportacion formato,
+                         size_t& fechasInvalidas, Funcion alTerminarTramo) {
+    ArchivoMapeado archivo(ruta);
+    if (!archivo.estaAbierto()) {
+        return false;
+    }
+
+    string_view contenido = archivo.contenido();
+    vector<size_t> cortes = cortarEnLineas(contenido);
+    struct TramoExportado {
+        string texto;
+        size_t filas = 0;
+        size_t fechasInvalidas = 0;
+    };
+    auto filtrarTramo = [&](size_t tramo) {
+        TramoExportado resultado;
+        size_t usado = 0;
+        bool fechaValida = true;
+        FilaExportada fila;
+        fila.pendiente = pendientes;
+        string_view resto = contenido.substr(cortes[tramo], cortes[tramo + 1] - cortes[tramo]);
+        string_view linea;
+        while (!resto.empty() && siguienteCampo(resto, '\n', linea)) {
+            if (!linea.empty() && linea.back() == '\r') {
+                linea.remove_suffix(1);
+            }
+            if (filtrarLineaPedido(linea, filtro, fila, fechaValida)) {
+                agregarFilaExportada(resultado.texto, usado, formato, fila);
+                resultado.filas++;
+                resultado.fechasInvalidas += fechaValida ? 0 : 1;
+            }
+        }
+        resultado.texto.resize(usado);
+        return resultado;
+    };
+
+    try {
+        procesarTramosEnOrden<TramoExportado>(cortes.size() - 1, hilosDisponibles(), filtrarTramo,
+                                              [&](size_t, TramoExportado&& resultado) {
+                                                  alTerminarTramo(resultado.texto, resultado.filas);
+                                                  fechasInvalidas += resultado.fechasInvalidas;
+                                              });
+    }
+    catch (const exception&) {
+        return false;
+    }
+    return true;
+}
+
+// Metricas de operacion: contadores, indicadores e histogramas de latencia que
+// se pueden leer en cualquier momento (Metricas::global().instantanea()) o
+// volcar a un archivo en el formato de texto de Prometheus. Compilando con
+// PROYECTOPROGRA_SIN_METRICAS las clases quedan vacias y las llamadas desaparecen.
+#ifdef PROYECTOPROGRA_SIN_METRICAS
+const bool METRICAS_ACTIVAS = false;
+#else
+const bool METRICAS_ACTIVAS = true;
+#endif
+
+// Las operaciones baratas (registrar, procesar, eliminar) miden la latencia en
+// una de cada tantas llamadas; leer el reloj cuesta mas de lo que se puede
+// gastar en cada una. Debe ser potencia de 2.
+const uint32_t MUESTREO_RUTA_CALIENTE = 64;
+
+// Cuantiles que se reportan de cada histograma
+const double CUANTILES_METRICAS[] = { 0.5, 0.9, 0.99, 0.999 };
+const size_t CANTIDAD_CUANTILES = sizeof(CUANTILES_METRICAS) / sizeof(CUANTILES_METRICAS[0]);
+
+#ifndef PROYECTOPROGRA_SIN_METRICAS
+
+// Ranuras por contador; los hilos que no alcanzan ranura propia comparten la ultima
+const size_t RANURAS_CONTADOR = 16;
+const size_t SIN_RANURA = numeric_limits<size_t>::max();
+
+// Cada hilo escribe en su propia linea de cache sin instrucciones atomicas de
+// lectura-modificacion (un solo escritor por ranura); leer suma las ranuras
+class ContadorMetrica {
+private:
+    struct alignas(64) Ranura {
+        atomic<uint64_t> valor{ 0 };
+    };
+    Ranura ranuras[RANURAS_CONTADOR];
+
+    static size_t ranuraDelHilo() {
+        static atomic<size_t> siguiente{ 0 };
+        static thread_local size_t ranura = SIN_RANURA;
+        if (ranura == SIN_RANURA) {
+            ranura = min(siguiente.fetch_add(1, memory_order_relaxed), RANURAS_CONTADOR - 1);
+        }
+        return ranura;
+    }
+
+public:
+    void sumar(uint64_t cantidad = 1) {
+        size_t ranura = ranuraDelHilo();
+        atomic<uint64_t>& valor = ranuras[ranura].valor;
+        if (ranura < RANURAS_CONTADOR - 1) {
+            valor.store(valor.load(memory_order_relaxed) + cantidad, memory_order_relaxed);
+        }
+        else {
+            valor.fetch_add(cantidad, memory_order_relaxed);
+        }
+    }
+
+    uint64_t valor() const {
+        uint64_t total = 0;
+        for (const Ranura& ranura : ranuras) {
+            total += ranura.valor.load(memory_order_relaxed);
+        }
+        return total;
+    }
+};
+
+// Valor que sube y baja (tamanos de colas). Cada gestor suma la diferencia
+// con lo que publico antes, asi con varias sucursales queda el total.
+class IndicadorMetrica {
+private:
+    atomic<int64_t> actual{ 0 };
+
+public:
+    void sumar(int64_t diferencia) {
+        actual.fetch_add(diferencia, memory_order_relaxed);
+    }
+
+    int64_t valor() const {
+        return actual.load(memory_order_relaxed);
+    }
+};
+
+// Histograma log-lineal al estilo HDR en nanosegundos: cada potencia de 2 se
+// parte en 16 cubetas iguales, asi el error relativo es menor a 1/16 en todo el
+// rango de 64 bits. Registrar son dos sumas atomicas relajadas.
+class HistogramaLatencia {
+private:
+    static const unsigned BITS_SUBCUBETA = 4;
+    static const size_t SUBCUBETAS = size_t(1) << BITS_SUBCUBETA;
+    static const size_t CUBETAS = (64 - BITS_SUBCUBETA + 1) * SUBCUBETAS;
+
+    atomic<uint64_t> cubetas[CUBETAS] = {};
+    atomic<uint64_t> suma{ 0 };
+    atomic<uint64_t> maximo{ 0 };
+
+    static unsigned bitMasAlto(uint64_t valor) {
+        unsigned bit = 0;
+        for (unsigned paso = 32; paso > 0; paso /= 2) {
+            if (valor >> paso) {
+                valor >>= paso;
+                bit += paso;
+            }
+        }
+        return bit;
+    }
+
+    static size_t cubeta(uint64_t valor) {
+        if (valor < SUBCUBETAS) {
+            return static_cast<size_t>(valor);
+        }
+        unsigned exponente = bitMasAlto(valor);
+        size_t sub = static_cast<size_t>(valor >> (exponente - BITS_SUBCUBETA)) - SUBCUBETAS;
+        return (exponente - BITS_SUBCUBETA + 1) * SUBCUBETAS + sub;
+    }
+
+    // Mayor valor que cae en la cubeta
+    static uint64_t limiteSuperior(size_t indice) {
+        if (indice < SUBCUBETAS) {
+            return indice;
+        }
+        unsigned exponente = static_cast<unsigned>(indice / SUBCUBETAS) + BITS_SUBCUBETA - 1;
+        uint64_t sub = indice % SUBCUBETAS;
+        return ((SUBCUBETAS + sub + 1) << (exponente - BITS_SUBCUBETA)) - 1;
+    }
+
+public:
+    void registrar(uint64_t nanosegundos) {
+        cubetas[cubeta(nanosegundos)].fetch_add(1, memory_order_relaxed);
+        suma.fetch_add(nanosegundos, memory_order_relaxed);
+        uint64_t anterior = maximo.load(memory_order_relaxed);
+        while (nanosegundos > anterior && !maximo.compare_exchange_weak(anterior, nanosegundos, memory_order_relaxed)) {
+        }
+    }
+
+    // Cantidad, suma, maximo y los CUANTILES_METRICAS, todo en nanosegundos.
+    // Se lee sin detener a los que registran, asi que es aproximado.
+    void resumir(uint64_t& cantidad, uint64_t& total, uint64_t& mayor, uint64_t* cuantiles) const {
+        vector<uint64_t> copia(CUBETAS);
+        cantidad = 0;
+        for (size_t i = 0; i < CUBETAS; i++) {
+            copia[i] = cubetas[i].load(memory_order_relaxed);
+            cantidad += copia[i];
+        }
+        total = suma.load(memory_order_relaxed);
+        mayor = maximo.load(memory_order_relaxed);
+
+        for (size_t c = 0; c < CANTIDAD_CUANTILES; c++) {
+            uint64_t objetivo = static_cast<uint64_t>(ceil(CUANTILES_METRICAS[c] * static_cast<double>(cantidad)));
+            uint64_t acumulado = 0;
+            cuantiles[c] = 0;
+            for (size_t i = 0; i < CUBETAS && cantidad > 0; i++) {
+                acumulado += copia[i];
+                if (acumulado >= max<uint64_t>(objetivo, 1)) {
+                    cuantiles[c] = min(limiteSuperior(i), mayor);
+                    break;
+                }
+            }
+        }
+    }
+};
+
+// Mide desde que se construye; con un histograma registra al destruirse. Con
+// muestreo > 1 solo mide, en promedio, una de cada muestreo llamadas.
+class CronometroMetrica {
+private:
+    HistogramaLatencia* histograma = nullptr;
+    chrono::steady_clock::time_point inicio;
+    bool midiendo = true;
+
+    // Al azar (xorshift) y no cada tantas llamadas: con un contador, operaciones
+    // que se alternan caerian siempre en la misma posicion y una nunca se mediria
+    static bool tocaMuestra(uint32_t muestreo) {
+        static thread_local uint32_t estado = 0x9e3779b9;
+        estado ^= estado << 13;
+        estado ^= estado >> 17;
+        estado ^= estado << 5;
+        return (estado & (muestreo - 1)) == 0;
+    }
+
+public:
+    CronometroMetrica() : inicio(chrono::steady_clock::now()) {}
+
+    explicit CronometroMetrica(HistogramaLatencia& _histograma, uint32_t muestreo = 1)
+        : histograma(&_histograma), midiendo(muestreo <= 1 || tocaMuestra(muestreo)) {
+        if (midiendo) {
+            inicio = chrono::steady_clock::now();
+        }
+    }
+
+    CronometroMetrica(const CronometroMetrica&) = delete;
+    CronometroMetrica& operator=(const CronometroMetrica&) = delete;
+
+    ~CronometroMetrica() {
+        if (midiendo && histograma != nullptr) {
+            histograma->registrar(transcurrido());
+        }
+    }
+
+    // Indica si esta llamada quedo en la muestra
+    bool activo() const {
+        return midiendo;
+    }
+
+    uint64_t transcurrido() const {
+        auto nanosegundos = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - inicio).count();
+        return nanosegundos > 0 ? static_cast<uint64_t>(nanosegundos) : 0;
+    }
+};
+
+#else
+
+// Sin metricas las mismas clases no guardan nada y el compilador quita las llamadas
+class ContadorMetrica {
+public:
+    void sumar(uint64_t = 1) {}
+    uint64_t valor() const { return 0; }
+};
+
+class IndicadorMetrica {
+public:
+    void sumar(int64_t) {}
+    int64_t valor() const { return 0; }
+};
+
+class HistogramaLatencia {
+public:
+    void registrar(uint64_t) {}
+    void resumir(uint64_t& cantidad, uint64_t& total, uint64_t& mayor, uint64_t* cuantiles) const {
+        cantidad = total = mayor = 0;
+        fill(cuantiles, cuantiles + CANTIDAD_CUANTILES, 0);
+    }
+};
+
+class CronometroMetrica {
+public:
+    CronometroMetrica() {}
+    explicit CronometroMetrica(HistogramaLatencia&, uint32_t = 1) {}
+    bool activo() const { return false; }
+    uint64_t transcurrido() const { return 0; }
+};
+
+#endif
+
+// Valor de un contador o indicador en una instantanea
+struct ValorMetrica {
+    const char* nombre;
+    const char* ayuda;
+    int64_t valor;
+};
+
+// Resumen de un histograma en una instantanea; los tiempos en nanosegundos
+struct ResumenLatencia {
+    const char* nombre;
+    const char* ayuda;
+    uint64_t cantidad;
+    uint64_t suma;
+    uint64_t maximo;
+    uint64_t cuantiles[CANTIDAD_CUANTILES];
+};
+
+struct InstantaneaMetricas {
+    vector<ValorMetrica> contadores;
+    vector<ValorMetrica> indicadores;
+    vector<ResumenLatencia> latencias;
+};
+
+// Todas las metricas del programa. Los indicadores suman los tamanos de todos
+// los GestorPedidos vivos; en la ruta caliente se actualizan con la muestra.
+class Metricas {
+private:
+    Metricas() = default;
+
+public:
+    ContadorMetrica pedidosRegistrados;
+    ContadorMetrica pedidosRechazados;
+    ContadorMetrica pedidosProcesados;
+    ContadorMetrica pedidosEliminados;
+    ContadorMetrica pedidosArchivados;
+    ContadorMetrica eventosJournal;
+    ContadorMetrica bytesJournal;
+    ContadorMetrica sincronizacionesJournal;
+    ContadorMetrica respaldosEscritos;
+    ContadorMetrica respaldosFallidos;
+    ContadorMetrica purgasHistorial;
+    ContadorMetrica totalesIncorrectos;
+    ContadorMetrica filasExportadas;
+
+    IndicadorMetrica pendientes;
+    IndicadorMetrica completadosEnMemoria;
+    IndicadorMetrica archivados;
+    IndicadorMetrica lapidas;
+
+    HistogramaLatencia latenciaRegistrar;
+    HistogramaLatencia latenciaProcesar;
+    HistogramaLatencia latenciaEliminar;
+    HistogramaLatencia esperaEnCola;
+    HistogramaLatencia latenciaGuardar;
+    HistogramaLatencia respaldoFormato;
+    HistogramaLatencia respaldoEscritura;
+    HistogramaLatencia respaldoFoto;
+    HistogramaLatencia latenciaCargar;
+    HistogramaLatencia cargarLectura;
+    HistogramaLatencia cargarInterpretacion;
+    HistogramaLatencia validarCarga;
+    HistogramaLatencia latenciaSincronizar;
+    HistogramaLatencia latenciaArchivar;
+    HistogramaLatencia archivarPausa;
+    HistogramaLatencia latenciaExportar;
+
+    Metricas(const Metricas&) = delete;
+    Metricas& operator=(const Metricas&) = delete;
+
+    static Metricas& global() {
+        static Metricas metricas;
+        return metricas;
+    }
+
+    InstantaneaMetricas instantanea() const {
+        InstantaneaMetricas resultado;
+        if (!METRICAS_ACTIVAS) {
+            return resultado;
+        }
+
+        auto contador = [&](const char* nombre, const char* ayuda, const ContadorMetrica& c) {
+            resultado.contadores.push_back({ nombre, ayuda, static_cast<int64_t>(c.valor()) });
+        };
+        contador("pedidos_registrados_total", "Pedidos aceptados en la cola", pedidosRegistrados);
+        contador("pedidos_rechazados_total", "Pedidos rechazados por ID repetido", pedidosRechazados);
+        contador("pedidos_procesados_total", "Pedidos que pasaron al historial", pedidosProcesados);
+        contador("pedidos_eliminados_total", "Pedidos eliminados por ID", pedidosEliminados);
+        contador("pedidos_archivados_total", "Completados que pasaron a segmentos en disco", pedidosArchivados);
+        contador("eventos_journal_total", "Registros agregados al journal", eventosJournal);
+        contador("journal_bytes_total", "Bytes agregados al journal", bytesJournal);
+        contador("sincronizaciones_journal_total", "Veces que el journal se forzo a disco", sincronizacionesJournal);
+        contador("respaldos_total", "Respaldos escritos al guardar o compactar el journal", respaldosEscritos);
+        contador("respaldos_fallidos_total", "Respaldos en segundo plano que no se pudieron escribir", respaldosFallidos);
+        contador("purgas_historial_total", "Purgas de pedidos eliminados del historial", purgasHistorial);
+        contador("totales_incorrectos_total", "Pedidos cargados cuyo total no es la suma de sus productos", totalesIncorrectos);
+        contador("filas_exportadas_total", "Pedidos escritos al exportar a CSV o JSON Lines", filasExportadas);
+
+        auto indicador = [&](const char* nombre, const char* ayuda, const IndicadorMetrica& i) {
+            resultado.indicadores.push_back({ nombre, ayuda, i.valor() });
+        };
+        indicador("pedidos_pendientes", "Pedidos en la cola", pendientes);
+        indicador("pedidos_completados_en_memoria", "Completados en el historial en memoria", completadosEnMemoria);
+        indicador("pedidos_archivados", "Completados en segmentos en disco", archivados);
+        indicador("lapidas_historial", "Ranuras eliminadas del historial que esperan la purga", lapidas);
+
+        auto latencia = [&](const char* nombre, const char* ayuda, const HistogramaLatencia& h) {
+            ResumenLatencia resumen{ nombre, ayuda, 0, 0, 0, {} };
+            h.resumir(resumen.cantidad, resumen.suma, resumen.maximo, resumen.cuantiles);
+            resultado.latencias.push_back(resumen);
+        };
+        latencia("registrar_segundos", "Registrar un pedido (muestreado)", latenciaRegistrar);
+        latencia("procesar_segundos", "Procesar el siguiente pedido (muestreado)", latenciaProcesar);
+        latencia("eliminar_segundos", "Eliminar un pedido por ID (muestreado)", latenciaEliminar);
+        latencia("espera_en_cola_segundos", "Desde la fecha del pedido hasta procesarlo, con resolucion de segundos (muestreado)", esperaEnCola);
+        latencia("guardar_segundos", "Guardar: archivar lo que sobra y escribir el respaldo", latenciaGuardar);
+        latencia("respaldo_formato_segundos", "Armar el respaldo y pasarlo al archivo por bloques", respaldoFormato);
+        latencia("respaldo_escritura_segundos", "Sincronizar y reemplazar el respaldo", respaldoEscritura);
+        latencia("respaldo_foto_segundos", "Pausa del hilo principal para fijar un respaldo en segundo plano", respaldoFoto);
+        latencia("cargar_segundos", "Cargar respaldo, journal o archivos de texto", latenciaCargar);
+        latencia("cargar_lectura_segundos", "Parte de la carga leyendo archivos; los mapeados se leen al interpretarlos", cargarLectura);
+        latencia("cargar_interpretacion_segundos", "Parte de la carga interpretando y armando los indices", cargarInterpretacion);
+        latencia("validar_carga_segundos", "Revision de totales y precios de los pedidos cargados", validarCarga);
+        latencia("sincronizar_journal_segundos", "Forzar el journal a disco", latenciaSincronizar);
+        latencia("archivar_segundos", "Escribir y sincronizar un segmento del historial, en su hilo", latenciaArchivar);
+        latencia("archivar_pausa_segundos", "Pausa del hilo principal para armar un segmento y esperar el anterior", archivarPausa);
+        latencia("exportar_segundos", "Exportar el historial a CSV o JSON Lines", latenciaExportar);
+        return resultado;
+    }
+};
+
+// Agrega un numero al texto; los tiempos van en segundos como pide Prometheus
+void agregarValorPrometheus(string& texto, double valor) {
+    char numero[32];
+    snprintf(numero, sizeof(numero), "%.9g", valor);
+    texto += numero;
+}
+
+// Formato de texto de Prometheus; los histogramas van como summary con cuantiles
+string textoPrometheus(const InstantaneaMetricas& instantanea) {
+    const string prefijo = "proyectoprogra_";
+    string texto;
+    auto encabezado = [&](const char* nombre, const char* ayuda, const char* tipo) {
+        texto.append("# HELP ").append(prefijo).append(nombre).append(" ").append(ayuda).append("\n");
+        texto.append("# TYPE ").append(prefijo).append(nombre).append(" ").append(tipo).append("\n");
+    };
+
+    for (const ValorMetrica& contador : instantanea.contadores) {
+        encabezado(contador.nombre, contador.ayuda, "counter");
+        texto.append(prefijo).append(contador.nombre).append(" ").append(to_string(contador.valor)).append("\n");
+    }
+    for (const ValorMetrica& indicador : instantanea.indicadores) {
+        encabezado(indicador.nombre, indicador.ayuda, "gauge");
+        texto.append(prefijo).append(indicador.nombre).append(" ").append(to_string(indicador.valor)).append("\n");
+    }
+    for (const ResumenLatencia& latencia : instantanea.latencias) {
+        encabezado(latencia.nombre, latencia.ayuda, "summary");
+        for (size_t c = 0; c < CANTIDAD_CUANTILES; c++) {
+            texto.append(prefijo).append(latencia.nombre).append("{quantile=\"");
+            agregarValorPrometheus(texto, CUANTILES_METRICAS[c]);
+            texto.append("\"} ");
+            agregarValorPrometheus(texto, latencia.cuantiles[c] / 1e9);
+            texto.append("\n");
+        }
+        texto.append(prefijo).append(latencia.nombre).append("_sum ");
+        agregarValorPrometheus(texto, latencia.suma / 1e9);
+        texto.append("\n").append(prefijo).append(latencia.nombre).append("_count ").append(to_string(latencia.cantidad)).append("\n");
+    }
+    return texto;
+}
+
+// Escribe las metricas en ruta cada intervalo desde un hilo propio (sirve para
+// el textfile collector de node_exporter). El archivo se reemplaza en un solo
+// paso para que nunca se lea a medias; al destruirse escribe una ultima vez.
+class VolcadoMetricas {
+private:
+    string ruta;
+    chrono::seconds intervalo;
+    mutex mutexVolcado;
+    condition_variable avisoDetener;
+    bool detener = false;
+    thread hilo;
+
+    void ejecutar() {
+        unique_lock<mutex> candado(mutexVolcado);
+        while (!avisoDetener.wait_for(candado, intervalo, [&] { return detener; })) {
+            escribir();
+        }
+    }
+
+public:
+    VolcadoMetricas(const string& _ruta, int64_t segundos)
+        : ruta(_ruta), intervalo(max<int64_t>(1, segundos)) {
+        hilo = thread(&VolcadoMetricas::ejecutar, this);
+    }
+
+    VolcadoMetricas(const VolcadoMetricas&) = delete;
+    VolcadoMetricas& operator=(const VolcadoMetricas&) = delete;
+
+    ~VolcadoMetricas() {
+        {
+            lock_guard<mutex> candado(mutexVolcado);
+            detener = true;
+        }
+        avisoDetener.notify_one();
+        hilo.join();
+        escribir();
+    }
+
+    bool escribir() const {
+        string texto = textoPrometheus(Metricas::global().instantanea());
+        string rutaTemporal = ruta + ".tmp";
+        FILE* archivo = fopen(rutaTemporal.c_str(), "wb");
+        if (archivo == nullptr) {
+            return false;
+        }
+        bool escrito = fwrite(texto.data(), 1, texto.size(), archivo) == texto.size();
+        fclose(archivo);
+        if (!escrito || !reemplazarArchivo(rutaTemporal, ruta)) {
+            remove(rutaTemporal.c_str());
+            return false;
+        }
+        return true;
+    }
+};
+
+// Journal de cambios (pedidos.journal). Cada registro es:
+//   longitud (u32) | tipo (u8) | secuencia (u64) | datos | checksum (u64)
+// La longitud cubre tipo, secuencia y datos, que es lo que protege el checksum.
+// Un registro incompleto al final (corte de luz a mitad de escritura) se descarta.
+enum class TipoEvento : uint8_t {
+    AltaAnterior = 1,  // datos: pedido que entra a pendientes, montos en f64 (journals anteriores)
+    AltaUrgente = 2,   // datos: pedido que entra directo al historial (journals anteriores al planificador)
+    Procesar = 3,      // datos: id (i32) del pedido que paso al historial
+    Eliminar = 4,      // datos: id (i32) del pedido eliminado
+    AltaCentavos = 5,  // datos: pedido que entra a pendientes, montos en centavos y fecha en texto
+    Alta = 6           // datos: pedido que entra a pendientes, montos en centavos y fecha como instante
+};
+
+// Eventos que se acumulan antes de forzar la escritura a disco y antes de compactar
+const size_t EVENTOS_POR_SINCRONIZACION = 64;
+const size_t EVENTOS_POR_COMPACTACION = 100000;
+
+// En el journal los productos se guardan por nombre para que cada evento sea independiente
+void escribirPedidoJournal(EscritorBinario& escritor, const Pedido& p) {
+    escritor.escribir<int32_t>(p.getId());
+    escritor.escribir<uint8_t>(p.esUrgente() ? 1 : 0);
+    escritor.escribirTexto(p.getNombreCliente());
+    escritor.escribir<int64_t>(p.getInstante());
+    escribirMonto(escritor, p.getTotal());
+    escritor.escribir<uint16_t>(static_cast<uint16_t>(p.getProductos().size()));
+    for (const Producto& prod : p.getProductos()) {
+        escritor.escribirTexto(prod.getNombre());
+        escribirMonto(escritor, prod.getPrecio());
+    }
+}
+
+optional<Pedido> leerPedidoJournal(LectorBinario& lector, bool enCentavos, bool fechaComoTexto) {
+    int32_t id;
+    uint8_t urgente;
+    string nombreCliente;
+    int64_t instante;
+    Dinero total;
+    uint16_t numProductos;
+
+    if (!lector.leer(id) || !lector.leer(urgente) || !lector.leerTexto(nombreCliente) ||
+        !leerInstante(lector, fechaComoTexto, instante) || !leerMonto(lector, enCentavos, total) || !lector.leer(numProductos)) {
+        return nullopt;
+    }
+
+    // Cada linea ocupa varios bytes; una cantidad mayor que lo que queda es un registro danado
+    if (numProductos > lector.restante()) {
+        return nullopt;
+    }
+    LineasPedido productos;
+    productos.reserve(numProductos);
+    for (uint16_t i = 0; i < numProductos; i++) {
+        string nombre;
+        Dinero precio;
+        if (!lector.leerTexto(nombre) || !leerMonto(lector, enCentavos, precio)) {
+            return nullopt;
+        }
+        productos.push_back(Producto(string_view(nombre), precio));
+    }
+
+    return Pedido(id, move(nombreCliente), move(productos), total, instante, urgente != 0);
+}
+
+enum class EstadoPedido {
+    Pendiente,
+    Completado
+};
+
+// Ubicacion de un pedido dentro del gestor, guardada en el indice por ID
+// Las posiciones en las listas del cliente y del dia permiten sacar el id
+// de ellas sin buscarlo
+struct UbicacionPedido {
+    EstadoPedido estado;
+    size_t ranura;  // solo completados: posicion en el historial
+    uint32_t posicionCliente;  // en la lista de ids del cliente
+    uint32_t posicionDia;  // solo completados: en la lista de ids del dia
+};
+
+// Plazo de atencion de cada clase de pedido, en segundos desde que llega.
+// El planificador atiende primero el limite mas cercano, asi un urgente pasa
+// adelante de los normales que llegaron poco antes, pero un normal que ya
+// espero mas de la diferencia entre plazos no puede ser rebasado (envejecimiento).
+const int64_t PLAZO_URGENTE = 5 * 60;
+const int64_t PLAZO_NORMAL = 20 * 60;
+
+inline int64_t limiteAtencion(int64_t llegada, bool urgente) {
+    return llegada + (urgente ? PLAZO_URGENTE : PLAZO_NORMAL);
+}
+
+// Posicion de un pedido en la cola: primero el limite mas cercano y, con el
+// mismo limite, el que se encolo antes
+struct TurnoPedido {
+    int64_t limite;
+    uint64_t orden;
+
+    bool operator<(const TurnoPedido& otro) const {
+        return limite != otro.limite ? limite < otro.limite : orden < otro.orden;
+    }
+};
+
+// Cola de pedidos pendientes ordenada por limite de atencion. Encolar,
+// desencolar y quitar por ID cuestan O(log n); recorrerla da el orden en que
+// se van a atender.
+class PlanificadorPedidos {
+private:
+    using Cola = map<TurnoPedido, Pedido, less<TurnoPedido>, AsignadorPool<pair<const TurnoPedido, Pedido>>>;
+    using TurnosPorId = unordered_map<int, Cola::iterator, hash<int>, equal_to<int>, AsignadorPool<pair<const int, Cola::iterator>>>;
+
+    // Los nodos de la cola y del indice salen de bloques grandes, no de un malloc por pedido
+    PoolNodos poolCola;
+    PoolNodos poolTurnos;
+    Cola cola;
+    TurnosPorId turnoPorId;
+    uint64_t encolados = 0;
+
+public:
+    PlanificadorPedidos()
+        : cola(less<TurnoPedido>(), Cola::allocator_type(&poolCola)),
+          turnoPorId(0, hash<int>(), equal_to<int>(), TurnosPorId::allocator_type(&poolTurnos)) {
+    }
+
+    PlanificadorPedidos(const PlanificadorPedidos&) = delete;
+    PlanificadorPedidos& operator=(const PlanificadorPedidos&) = delete;
+
+    // Recorre los pedidos en orden de atencion
+    class const_iterator {
+    private:
+        Cola::const_iterator it;
+
+    public:
+        explicit const_iterator(Cola::const_iterator _it) : it(_it) {
+        }
+
+        const Pedido& operator*() const {
+            return it->second;
+        }
+
+        const Pedido* operator->() const {
+            return &it->second;
+        }
+
+        const_iterator& operator++() {
+            ++it;
+            return *this;
+        }
+
+        bool operator!=(const const_iterator& otro) const {
+            return it != otro.it;
+        }
+
+        bool operator==(const const_iterator& otro) const {
+            return it == otro.it;
+        }
+    };
+
+    // El pedido se atiende antes que todos los que tengan un limite mayor
+    void encolar(Pedido pedido, int64_t limite) {
+        int id = pedido.getId();
+        auto resultado = cola.emplace(TurnoPedido{ limite, encolados++ }, move(pedido));
+        turnoPorId[id] = resultado.first;
+    }
+
+    const Pedido& frente() const {
+        return cola.begin()->second;
+    }
+
+    int64_t limiteFrente() const {
+        return cola.begin()->first.limite;
+    }
+
+    Pedido desencolar() {
+        auto it = cola.begin();
+        Pedido pedido = move(it->second);
+        turnoPorId.erase(pedido.getId());
+        cola.erase(it);
+        return pedido;
+    }
+
+    // Saca de la cola el pedido con ese ID, este donde este
+    optional<Pedido> quitar(int id) {
+        auto it = turnoPorId.find(id);
+        if (it == turnoPorId.end()) {
+            return nullopt;
+        }
+
+        Pedido pedido = move(it->second->second);
+        cola.erase(it->second);
+        turnoPorId.erase(it);
+        return pedido;
+    }
+
+    const Pedido* buscar(int id) const {
+        auto it = turnoPorId.find(id);
+        return it == turnoPorId.end() ? nullptr : &it->second->second;
+    }
+
+    bool empty() const {
+        return cola.empty();
+    }
+
+    size_t size() const {
+        return cola.size();
+    }
+
+    const_iterator begin() const {
+        return const_iterator(cola.begin());
+    }
+
+    const_iterator end() const {
+        return const_iterator(cola.end());
+    }
+
+    void clear() {
+        cola.clear();
+        turnoPorId.clear();
+        encolados = 0;
+    }
+};
+
+// Arma la salida en un buffer y la escribe en bloques grandes. Los listados y
+// el modo por lotes la usan en lugar de mandar cada linea a cout con endl.
+class SalidaBuffer {
+private:
+    static const size_t TAMANO_BLOQUE = 1 << 16;
+
+    ostream& destino;
+    string buffer;
+
+public:
+    explicit SalidaBuffer(ostream& _destino) : destino(_destino) {
+        buffer.reserve(TAMANO_BLOQUE * 2);
+    }
+
+    ~SalidaBuffer() {
+        vaciar();
+    }
+
+    SalidaBuffer(const SalidaBuffer&) = delete;
+    SalidaBuffer& operator=(const SalidaBuffer&) = delete;
+
+    SalidaBuffer& texto(string_view valor) {
+        buffer.append(valor.data(), valor.size());
+        return *this;
+    }
+
+    SalidaBuffer& numero(int64_t valor) {
+        agregarNumero(buffer, valor);
+        return *this;
+    }
+
+    // Campos separados por '|' para el modo por lotes
+    SalidaBuffer& campo(string_view valor) {
+        buffer += '|';
+        return texto(valor);
+    }
+
+    SalidaBuffer& campo(int64_t valor) {
+        buffer += '|';
+        return numero(valor);
+    }
+
+    SalidaBuffer& dinero(Dinero valor) {
+        agregarDinero(buffer, valor);
+        return *this;
+    }
+
+    SalidaBuffer& campoDinero(Dinero valor) {
+        buffer += '|';
+        return dinero(valor);
+    }
+
+    // Renglon de un listado: "n. resumen" seguido de una linea en blanco
+    SalidaBuffer& pedidoNumerado(size_t numero, const Pedido& pedido) {
+        agregarNumero(buffer, static_cast<int64_t>(numero));
+        buffer += ". ";
+        pedido.escribirResumen(buffer);
+        buffer += "\n\n";
+        revisar();
+        return *this;
+    }
+
+    void terminarLinea() {
+        buffer += '\n';
+        revisar();
+    }
+
+    void revisar() {
+        if (buffer.size() >= TAMANO_BLOQUE) {
+            vaciar();
+        }
+    }
+
+    void vaciar() {
+        destino.write(buffer.data(), static_cast<streamsize>(buffer.size()));
+        buffer.clear();
+    }
+};
+
+// Totales del historial de pedidos completados; las unidades van por id de catalogo
+struct ResumenFinanciero {
+    size_t cantidadPedidos = 0;
+    Dinero ingresoTotal;
+    vector<long long> unidadesVendidas;
+};
+
+// Resultado de una agrupacion: cantidad e ingreso por grupo
+struct VentasPorGrupo {
+    vector<long long> cantidad;
+    vector<Dinero> ingreso;
+};
+
+// Suma origen en destino grupo por grupo; signo = -1 para restar
+void sumarVentas(VentasPorGrupo& destino, const VentasPorGrupo& origen, int signo = 1) {
+    if (destino.cantidad.size() < origen.cantidad.size()) {
+        destino.cantidad.resize(origen.cantidad.size(), 0);
+        destino.ingreso.resize(origen.cantidad.size());
+    }
+    for (size_t g = 0; g < origen.cantidad.size(); g++) {
+        destino.cantidad[g] += origen.cantidad[g] * signo;
+        destino.ingreso[g] += origen.ingreso[g] * signo;
+    }
+}
+
+// Hora local del dia (0 a 23) de un instante
+inline size_t horaDelDia(int64_t instante) {
+    int64_t segundoDelDia = (instante + desfaseHoraLocal(instante)) % 86400;
+    return static_cast<size_t>((segundoDelDia < 0 ? segundoDelDia + 86400 : segundoDelDia) / 3600);
+}
+
+// Pedidos completados e ingreso dentro de un rango de fechas
+struct ResumenRango {
+    size_t cantidadPedidos = 0;
+    Dinero ingresoTotal;
+};
+
+// Copia del historial de completados guardada por columnas (un vector por campo)
+// para las consultas de analisis. La fila i corresponde al pedido i del
+// historial. Las lineas de todos los pedidos van seguidas; inicioLineas marca
+// donde empiezan las de cada fila. Una fila eliminada queda con peso 0 (lapida)
+// hasta que se purga, asi las demas no cambian de numero.
+class HistorialColumnar {
+private:
+    // Por debajo de esto no vale la pena repartir el recorrido entre hilos
+    static const size_t FILAS_POR_HILO = 1 << 16;
+
+    vector<int> ids;
+    vector<int64_t> instantes;
+    vector<int64_t> totales;  // centavos
+    vector<uint8_t> urgentes;
+    vector<uint32_t> clientes;  // id en RegistroClientes
+    vector<uint8_t> pesos;  // 1 si la fila esta viva, 0 si se elimino
+    vector<size_t> inicioLineas;  // una entrada por fila mas el final
+
+    vector<uint16_t> productos;
+    vector<int64_t> precios;  // centavos
+    vector<uint8_t> pesosLineas;
+    size_t eliminadas = 0;
+
+    struct Parcial {
+        vector<long long> cantidad;
+        vector<int64_t> centavos;
+    };
+
+    // Suma peso[i] unidades y valor(i) en el grupo clave(i) para i en [0, filas).
+    // Las lapidas tienen peso y valor 0. Cada hilo acumula un tramo contiguo en
+    // sus propios vectores y al final se juntan.
+    template <typename Clave, typename Valor>
+    static VentasPorGrupo agrupar(size_t filas, size_t grupos, const uint8_t* peso, Clave clave, Valor valor) {
+        size_t hilos = hilosDisponibles();
+        hilos = min(hilos, max<size_t>(1, filas / FILAS_POR_HILO));
+
+        vector<Parcial> parciales(hilos, Parcial{ vector<long long>(grupos, 0), vector<int64_t>(grupos, 0) });
+        auto recorrer = [&](size_t tramo) {
+            size_t inicio = filas * tramo / hilos;
+            size_t fin = filas * (tramo + 1) / hilos;
+            long long* cantidad = parciales[tramo].cantidad.data();
+            int64_t* centavos = parciales[tramo].centavos.data();
+            for (size_t i = inicio; i < fin; i++) {
+                size_t grupo = clave(i);
+                cantidad[grupo] += peso[i];
+                centavos[grupo] += valor(i);
+            }
+        };
+
+        vector<thread> trabajadores;
+        for (size_t tramo = 1; tramo < hilos; tramo++) {
+            trabajadores.emplace_back(recorrer, tramo);
+        }
+        recorrer(0);
+        for (thread& trabajador : trabajadores) {
+            trabajador.join();
+        }
+
+        VentasPorGrupo resultado;
+        resultado.cantidad.assign(grupos, 0);
+        vector<int64_t> centavos(grupos, 0);
+        for (const Parcial& parcial : parciales) {
+            for (size_t g = 0; g < grupos; g++) {
+                resultado.cantidad[g] += parcial.cantidad[g];
+                centavos[g] += parcial.centavos[g];
+            }
+        }
+        resultado.ingreso.reserve(grupos);
+        for (int64_t valorGrupo : centavos) {
+            resultado.ingreso.push_back(Dinero::desdeCentavos(valorGrupo));
+        }
+        return resultado;
+    }
+
+public:
+    HistorialColumnar() {
+        inicioLineas.push_back(0);
+    }
+
+    void agregar(const Pedido& pedido) {
+        ids.push_back(pedido.getId());
+        instantes.push_back(pedido.getInstante());
+        totales.push_back(pedido.getTotal().getCentavos());
+        urgentes.push_back(pedido.esUrgente() ? 1 : 0);
+        clientes.push_back(pedido.getIdCliente());
+        pesos.push_back(1);
+        for (const Producto& p : pedido.getProductos()) {
+            productos.push_back(p.getIdProducto());
+            precios.push_back(p.getPrecio().getCentavos());
+            pesosLineas.push_back(1);
+        }
+        inicioLineas.push_back(productos.size());
+    }
+
+    // Deja la fila como lapida: deja de contar en las agrupaciones pero
+    // conserva su numero hasta purgar
+    void quitar(size_t fila) {
+        pesos[fila] = 0;
+        totales[fila] = 0;
+        for (size_t i = inicioLineas[fila]; i < inicioLineas[fila + 1]; i++) {
+            pesosLineas[i] = 0;
+            precios[i] = 0;
+        }
+        eliminadas++;
+    }
+
+    bool estaViva(size_t fila) const {
+        return pesos[fila] != 0;
+    }
+
+    // Saca las lapidas en una sola pasada; las filas vivas conservan su orden
+    void purgar() {
+        if (eliminadas == 0) {
+            return;
+        }
+
+        size_t destino = 0;
+        size_t destinoLineas = 0;
+        for (size_t fila = 0; fila < ids.size(); fila++) {
+            if (pesos[fila] == 0) {
+                continue;
+            }
+            ids[destino] = ids[fila];
+            instantes[destino] = instantes[fila];
+            totales[destino] = totales[fila];
+            urgentes[destino] = urgentes[fila];
+            clientes[destino] = clientes[fila];
+            pesos[destino] = 1;
+            size_t inicio = inicioLineas[fila];
+            size_t fin = inicioLineas[fila + 1];
+            inicioLineas[destino] = destinoLineas;
+            for (size_t i = inicio; i < fin; i++) {
+                productos[destinoLineas] = productos[i];
+                precios[destinoLineas] = precios[i];
+                pesosLineas[destinoLineas] = 1;
+                destinoLineas++;
+            }
+            destino++;
+        }
+
+        ids.resize(destino);
+        instantes.resize(destino);
+        totales.resize(destino);
+        urgentes.resize(destino);
+        clientes.resize(destino);
+        pesos.resize(destino);
+        inicioLineas.resize(destino + 1);
+        inicioLineas[destino] = destinoLineas;
+        productos.resize(destinoLineas);
+        precios.resize(destinoLineas);
+        pesosLineas.resize(destinoLineas);
+        eliminadas = 0;
+    }
+
+    // Quita las primeras n filas (las que pasan al archivo)
+    void quitarPrimeras(size_t n) {
+        size_t lineas = inicioLineas[n];
+        for (size_t fila = 0; fila < n; fila++) {
+            eliminadas -= (pesos[fila] == 0);
+        }
+        ids.erase(ids.begin(), ids.begin() + n);
+        instantes.erase(instantes.begin(), instantes.begin() + n);
+        totales.erase(totales.begin(), totales.begin() + n);
+        urgentes.erase(urgentes.begin(), urgentes.begin() + n);
+        clientes.erase(clientes.begin(), clientes.begin() + n);
+        pesos.erase(pesos.begin(), pesos.begin() + n);
+        productos.erase(productos.begin(), productos.begin() + lineas);
+        precios.erase(precios.begin(), precios.begin() + lineas);
+        pesosLineas.erase(pesosLineas.begin(), pesosLineas.begin() + lineas);
+
+        inicioLineas.erase(inicioLineas.begin(), inicioLineas.begin() + n);
+        for (size_t& inicio : inicioLineas) {
+            inicio -= lineas;
+        }
+    }
+
+    void clear() {
+        ids.clear();
+        instantes.clear();
+        totales.clear();
+        urgentes.clear();
+        clientes.clear();
+        pesos.clear();
+        inicioLineas.assign(1, 0);
+        productos.clear();
+        precios.clear();
+        pesosLineas.clear();
+        eliminadas = 0;
+    }
+
+    // Cuenta tambien las lapidas
+    size_t size() const {
+        return ids.size();
+    }
+
+    size_t cantidadEliminadas() const {
+        return eliminadas;
+    }
+
+    // Revisa las filas desde la indicada hasta el final: agrega a idsIncorrectos
+    // las que tienen un total distinto a la suma de sus lineas y devuelve cuantas
+    // lineas tienen un precio distinto a precioCatalogo[producto]. Las lapidas
+    // tienen total y precios en 0 y peso 0, asi que no se marcan.
+    size_t validar(size_t desde, const int64_t* precioCatalogo, vector<int>& idsIncorrectos) const {
+        const uint16_t* producto = productos.data();
+        const int64_t* precio = precios.data();
+        const uint8_t* peso = pesosLineas.data();
+        const size_t* inicio = inicioLineas.data();
+
+        // Sin saltos para que el compilador pueda vectorizar la comparacion
+        size_t distintas = 0;
+        for (size_t i = inicio[desde]; i < productos.size(); i++) {
+            distintas += static_cast<size_t>(precioCatalogo[producto[i]] != precio[i]) & peso[i];
+        }
+
+        // Suma de las lineas de cada fila; casi todas tienen pocas lineas, asi
+        // que lo que pesa es recorrer las columnas seguidas
+        for (size_t fila = desde; fila < ids.size(); fila++) {
+            int64_t suma = 0;
+            for (size_t i = inicio[fila]; i < inicio[fila + 1]; i++) {
+                suma += precio[i];
+            }
+            if (suma != totales[fila]) {
+                idsIncorrectos.push_back(ids[fila]);
+            }
+        }
+        return distintas;
+    }
+
+    size_t cantidadLineas() const {
+        return productos.size();
+    }
+
+    // Unidades e ingreso por id de catalogo
+    VentasPorGrupo porProducto() const {
+        const uint16_t* producto = productos.data();
+        const int64_t* precio = precios.data();
+        return agrupar(productos.size(), CatalogoProductos::global().tamano(), pesosLineas.data(),
+                       [=](size_t i) { return static_cast<size_t>(producto[i]); },
+                       [=](size_t i) { return precio[i]; });
+    }
+
+    // Pedidos e ingreso por hora local del dia (0 a 23)
+    VentasPorGrupo porHora() const {
+        const int64_t* instante = instantes.data();
+        const int64_t* total = totales.data();
+        return agrupar(ids.size(), 24, pesos.data(),
+                       [=](size_t i) { return horaDelDia(instante[i]); },
+                       [=](size_t i) { return total[i]; });
+    }
+
+    // Pedidos e ingreso por cliente; el grupo es el id en RegistroClientes
+    VentasPorGrupo porCliente() const {
+        const uint32_t* cliente = clientes.data();
+        const int64_t* total = totales.data();
+        return agrupar(ids.size(), RegistroClientes::global().tamano(), pesos.data(),
+                       [=](size_t i) { return static_cast<size_t>(cliente[i]); },
+                       [=](size_t i) { return total[i]; });
+    }
+
+    // Grupo 0: normales, grupo 1: urgentes
+    VentasPorGrupo porUrgencia() const {
+        const uint8_t* urgente = urgentes.data();
+        const int64_t* total = totales.data();
+        return agrupar(ids.size(), 2, pesos.data(),
+                       [=](size_t i) { return static_cast<size_t>(urgente[i]); },
+                       [=](size_t i) { return total[i]; });
+    }
+};
+
+// Archivo de un segmento del historial (pedidos_archivo_NNNNNN.seg). Un segmento
+// no cambia despues de escrito.
+//   encabezado: "PEDS", version (u16), reservado (u16), bytes del resumen (u64),
+//               bytes de las columnas (u64), checksum del resumen (u64), checksum de las columnas (u64)
+//   resumen:    pedidos (u64), id minimo y maximo (i32), instante minimo y maximo (i64),
+//               productos (u32) con nombre, unidades (u64) e ingreso (i64), pedidos (u64)
+//               e ingreso (i64) por hora (24) y por urgencia (normal, urgente), los
+//               dias (u32) con dia (i64), pedidos (u64) e ingreso (i64), el filtro
+//               de Bloom de los ids (u32 y las palabras de 64 bits) y, desde la
+//               version 2, los clientes (u32) con nombre, pedidos (u64), gasto (i64)
+//               e id (i32) e instante (i64) de su pedido mas reciente
+//   columnas:   ids e instantes como diferencia con el anterior, totales, un bit de
+//               urgente por pedido, tabla de clientes (u32 y textos) con el indice de
+//               cada pedido, y las lineas: cantidad por pedido, indice en la tabla de
+//               productos del resumen y precio. Los enteros de las columnas van en
+//               varint y los que pueden ser negativos en zigzag.
+const char MAGICO_SEGMENTO[4] = { 'P', 'E', 'D', 'S' };
+const uint16_t VERSION_SEGMENTO = 2;
+const size_t TAMANO_ENCABEZADO_SEGMENTO = 40;
+// Pedidos por segmento cuando el limite en memoria es grande
+const size_t PEDIDOS_POR_SEGMENTO = 100000;
+
+// Pedidos archivados de un cliente: cantidad, gasto y el de fecha mas reciente
+struct ArchivadosCliente {
+    size_t cantidad = 0;
+    Dinero gasto;
+    int ultimoId = 0;
+    int64_t ultimoInstante = 0;
+
+    void sumar(const Pedido& pedido) {
+        juntar({ 1, pedido.getTotal(), pedido.getId(), pedido.getInstante() });
+    }
+
+    void juntar(const ArchivadosCliente& otro) {
+        if (otro.cantidad == 0) {
+            return;
+        }
+        if (cantidad == 0 || otro.ultimoInstante > ultimoInstante ||
+            (otro.ultimoInstante == ultimoInstante && otro.ultimoId > ultimoId)) {
+            ultimoId = otro.ultimoId;
+            ultimoInstante = otro.ultimoInstante;
+        }
+        cantidad += otro.cantidad;
+        gasto += otro.gasto;
+    }
+};
+
+// Lo que queda en memoria de un segmento archivado; descuenta los pedidos
+// eliminados despues de archivar
+struct ResumenSegmento {
+    uint32_t numero = 0;
+    size_t cantidad = 0;
+    int idMinimo = 0;
+    int idMaximo = 0;
+    int64_t instanteMinimo = 0;
+    int64_t instanteMaximo = 0;
+    VentasPorGrupo porProducto;  // unidades por id de catalogo
+    VentasPorGrupo porHora;
+    VentasPorGrupo porUrgencia;  // grupo 0: normales, grupo 1: urgentes
+    map<int64_t, ResumenRango> porDia;
+    vector<uint64_t> filtroIds;  // filtro de Bloom de los ids
+    // Por id en RegistroClientes, ordenado por id; solo los clientes del segmento
+    vector<pair<uint32_t, ArchivadosCliente>> porCliente;
+
+    Dinero ingreso() const {
+        return porUrgencia.ingreso[0] + porUrgencia.ingreso[1];
+    }
+
+    // Posicion del cliente en porCliente, o porCliente.size() si no esta
+    size_t posicionCliente(uint32_t idCliente) const {
+        auto it = lower_bound(porCliente.begin(), porCliente.end(), idCliente,
+                              [](const pair<uint32_t, ArchivadosCliente>& entrada, uint32_t id) { return entrada.first < id; });
+        return (it != porCliente.end() && it->first == idCliente) ? static_cast<size_t>(it - porCliente.begin()) : porCliente.size();
+    }
+};
+
+// Pedidos completados que ya salieron de la memoria. Cada segmento es un archivo
+// inmutable y en memoria solo queda su resumen, asi los reportes no leen el disco.
+// Buscar por ID lee solo la columna de ids de los segmentos cuyo rango y filtro
+// de Bloom lo admiten.
+// Los pedidos eliminados despues de archivados se anotan aparte, con su segmento
+// porque un ID eliminado se puede volver a usar.
+class HistorialArchivado {
+private:
+    string prefijo;
+    vector<ResumenSegmento> segmentos;  // del mas antiguo al mas reciente
+    unordered_set<uint64_t> eliminados;  // claveEliminado(numero, id)
+
+    // Ids ordenados del ultimo segmento consultado, para no releerlo en cada busqueda
+    mutable uint32_t segmentoEnCache = 0;
+    mutable vector<int> idsEnCache;
+
+    // El ultimo segmento de archivar lo escribe y sincroniza otro hilo; su
+    // resumen ya esta en segmentos. Lo que lee el disco lo espera antes
+    // (esperarEscritura) y si fallo se reintenta ahi mismo. El hilo va al
+    // final para que se detenga antes de liberar lo demas.
+    mutable string porEscribir;
+    mutable uint32_t numeroPorEscribir = 0;
+    mutable bool escrituraPendiente = false;
+    mutable TrabajoEnSegundoPlano hiloEscritura;
+
+    static uint64_t claveEliminado(uint32_t numero, int id) {
+        return (static_cast<uint64_t>(numero) << 32) | static_cast<uint32_t>(id);
+    }
+
+    bool estaEliminado(uint32_t numero, int id) const {
+        return eliminados.count(claveEliminado(numero, id)) > 0;
+    }
+
+    // Con 16 bits por pedido y 6 posiciones por id el filtro casi nunca deja
+    // pasar un id que no esta, asi buscar no lee segmentos de mas
+    static const size_t BITS_FILTRO_POR_PEDIDO = 16;
+    static const size_t POSICIONES_FILTRO = 6;
+
+    template <typename Funcion>
+    static void posicionesFiltro(const vector<uint64_t>& filtro, int id, Funcion alPosicion) {
+        uint64_t mezcla = static_cast<uint32_t>(id) + 0x9E3779B97F4A7C15ULL;
+        mezcla = (mezcla ^ (mezcla >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        mezcla = (mezcla ^ (mezcla >> 27)) * 0x94D049BB133111EBULL;
+        mezcla ^= mezcla >> 31;
+        uint64_t bits = filtro.size() * 64;
+        uint64_t paso = (mezcla >> 32) | 1;
+        for (size_t i = 0; i < POSICIONES_FILTRO; i++) {
+            alPosicion(static_cast<size_t>((mezcla + i * paso) % bits));
+        }
+    }
+
+    static bool puedeEstarEnFiltro(const vector<uint64_t>& filtro, int id) {
+        if (filtro.empty()) {
+            return true;
+        }
+        bool presente = true;
+        posicionesFiltro(filtro, id, [&](size_t bit) { presente = presente && ((filtro[bit / 64] >> (bit % 64)) & 1); });
+        return presente;
+    }
+
+    static ResumenSegmento resumenVacio() {
+        ResumenSegmento resumen;
+        resumen.porProducto.cantidad.assign(CatalogoProductos::global().tamano(), 0);
+        resumen.porProducto.ingreso.assign(CatalogoProductos::global().tamano(), Dinero());
+        resumen.porHora.cantidad.assign(24, 0);
+        resumen.porHora.ingreso.assign(24, Dinero());
+        resumen.porUrgencia.cantidad.assign(2, 0);
+        resumen.porUrgencia.ingreso.assign(2, Dinero());
+        return resumen;
+    }
+
+    // signo = 1 al archivar y -1 al eliminar un pedido ya archivado
+    static void sumarAlResumen(ResumenSegmento& resumen, const Pedido& pedido, int signo) {
+        resumen.cantidad += signo;
+        for (const Producto& p : pedido.getProductos()) {
+            if (p.getIdProducto() >= resumen.porProducto.cantidad.size()) {
+                resumen.porProducto.cantidad.resize(CatalogoProductos::global().tamano(), 0);
+                resumen.porProducto.ingreso.resize(CatalogoProductos::global().tamano());
+            }
+            resumen.porProducto.cantidad[p.getIdProducto()] += signo;
+            resumen.porProducto.ingreso[p.getIdProducto()] += p.getPrecio() * signo;
+        }
+
+        size_t hora = horaDelDia(pedido.getInstante());
+        resumen.porHora.cantidad[hora] += signo;
+        resumen.porHora.ingreso[hora] += pedido.getTotal() * signo;
+        size_t urgencia = pedido.esUrgente() ? 1 : 0;
+        resumen.porUrgencia.cantidad[urgencia] += signo;
+        resumen.porUrgencia.ingreso[urgencia] += pedido.getTotal() * signo;
+
+        int64_t dia = diaDe(pedido.getInstante());
+        ResumenRango& delDia = resumen.porDia[dia];
+        delDia.cantidadPedidos += signo;
+        delDia.ingresoTotal += pedido.getTotal() * signo;
+        if (delDia.cantidadPedidos == 0) {
+            resumen.porDia.erase(dia);
+        }
+    }
+
+    // Valida el encabezado y los checksums y separa las dos secciones. Al abrir
+    // solo se revisa el resumen para no leer las columnas del disco.
+    static bool separarSecciones(string_view contenido, bool revisarColumnas, string_view& resumen, string_view& columnas,
+                                 uint16_t* versionLeida = nullptr) {
+        if (contenido.size() < TAMANO_ENCABEZADO_SEGMENTO || memcmp(contenido.data(), MAGICO_SEGMENTO, sizeof(MAGICO_SEGMENTO)) != 0) {
+            return false;
+        }
+
+        LectorBinario encabezado(contenido.data() + sizeof(MAGICO_SEGMENTO), contenido.data() + TAMANO_ENCABEZADO_SEGMENTO);
+        uint16_t version = 0, reservado = 0;
+        uint64_t bytesResumen = 0, bytesColumnas = 0, checksumResumen = 0, checksumColumnas = 0;
+        encabezado.leer(version);
+        encabezado.leer(reservado);
+        encabezado.leer(bytesResumen);
+        encabezado.leer(bytesColumnas);
+        encabezado.leer(checksumResumen);
+        encabezado.leer(checksumColumnas);
+        if (version < 1 || version > VERSION_SEGMENTO || bytesResumen + bytesColumnas != contenido.size() - TAMANO_ENCABEZADO_SEGMENTO) {
+            return false;
+        }
+        if (versionLeida != nullptr) {
+            *versionLeida = version;
+        }
+
+        resumen = contenido.substr(TAMANO_ENCABEZADO_SEGMENTO, bytesResumen);
+        columnas = contenido.substr(TAMANO_ENCABEZADO_SEGMENTO + bytesResumen);
+        return calcularChecksum(resumen.data(), resumen.size()) == checksumResumen &&
+               (!revisarColumnas || calcularChecksum(columnas.data(), columnas.size()) == checksumColumnas);
+    }
+
+    // idsProducto traduce el indice de la tabla del segmento al id del catalogo
+    // actual. Los clientes solo se leen con conClientes; los segmentos de la
+    // version 1 no los tienen y quedan sin clientes.
+    static bool leerResumen(string_view seccion, uint16_t version, bool conClientes, ResumenSegmento& resumen,
+                            vector<uint16_t>& idsProducto) {
+        LectorBinario lector(seccion.data(), seccion.data() + seccion.size());
+        uint64_t cantidad;
+        int32_t idMinimo, idMaximo;
+        uint32_t cantidadProductos;
+        if (!lector.leer(cantidad) || !lector.leer(idMinimo) || !lector.leer(idMaximo) || !lector.leer(resumen.instanteMinimo) ||
+            !lector.leer(resumen.instanteMaximo) || !lector.leer(cantidadProductos)) {
+            return false;
+        }
+        resumen.cantidad = static_cast<size_t>(cantidad);
+        resumen.idMinimo = idMinimo;
+        resumen.idMaximo = idMaximo;
+
+        auto leerGrupo = [&](VentasPorGrupo& ventas, size_t grupo) {
+            uint64_t pedidos;
+            int64_t centavos;
+            if (!lector.leer(pedidos) || !lector.leer(centavos)) {
+                return false;
+            }
+            if (grupo >= ventas.cantidad.size()) {
+                ventas.cantidad.resize(grupo + 1, 0);
+                ventas.ingreso.resize(grupo + 1);
+            }
+            ventas.cantidad[grupo] += static_cast<long long>(pedidos);
+            ventas.ingreso[grupo] += Dinero::desdeCentavos(centavos);
+            return true;
+        };
+
+        // Las cantidades del archivo se comparan con los bytes que quedan antes de
+        // pedir memoria; un archivo danado no puede pedir gigabytes
+        if (cantidadProductos > lector.restante()) {
+            return false;
+        }
+        idsProducto.assign(cantidadProductos, 0);
+        for (uint32_t i = 0; i < cantidadProductos; i++) {
+            string nombre;
+            if (!lector.leerTexto(nombre)) {
+                return false;
+            }
+            idsProducto[i] = CatalogoProductos::global().registrar(nombre, Dinero());
+            if (!leerGrupo(resumen.porProducto, idsProducto[i])) {
+                return false;
+            }
+        }
+        for (size_t hora = 0; hora < 24; hora++) {
+            if (!leerGrupo(resumen.porHora, hora)) {
+                return false;
+            }
+        }
+        for (size_t urgencia = 0; urgencia < 2; urgencia++) {
+            if (!leerGrupo(resumen.porUrgencia, urgencia)) {
+                return false;
+            }
+        }
+
+        uint32_t cantidadDias;
+        if (!lector.leer(cantidadDias)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < cantidadDias; i++) {
+            int64_t dia, centavos;
+            uint64_t pedidos;
+            if (!lector.leer(dia) || !lector.leer(pedidos) || !lector.leer(centavos)) {
+                return false;
+            }
+            resumen.porDia[dia] = { static_cast<size_t>(pedidos), Dinero::desdeCentavos(centavos) };
+        }
+
+        uint32_t palabrasFiltro;
+        if (!lector.leer(palabrasFiltro) || palabrasFiltro > lector.restante() / sizeof(uint64_t)) {
+            return false;
+        }
+        resumen.filtroIds.resize(palabrasFiltro);
+        for (uint64_t& palabra : resumen.filtroIds) {
+            if (!lector.leer(palabra)) {
+                return false;
+            }
+        }
+        if (version < 2) {
+            return lector.terminado();
+        }
+        if (!conClientes) {
+            return true;
+        }
+
+        uint32_t cantidadClientes;
+        if (!lector.leer(cantidadClientes) || cantidadClientes > lector.restante()) {
+            return false;
+        }
+        resumen.porCliente.resize(cantidadClientes);
+        for (auto& entrada : resumen.porCliente) {
+            string nombre;
+            uint64_t pedidos;
+            int64_t centavos;
+            int32_t ultimoId;
+            if (!lector.leerTexto(nombre) || !lector.leer(pedidos) || !lector.leer(centavos) || !lector.leer(ultimoId) ||
+                !lector.leer(entrada.second.ultimoInstante)) {
+                return false;
+            }
+            entrada.first = RegistroClientes::global().registrar(nombre);
+            entrada.second.cantidad = static_cast<size_t>(pedidos);
+            entrada.second.gasto = Dinero::desdeCentavos(centavos);
+            entrada.second.ultimoId = ultimoId;
+        }
+        sort(resumen.porCliente.begin(), resumen.porCliente.end(),
+             [](const pair<uint32_t, ArchivadosCliente>& a, const pair<uint32_t, ArchivadosCliente>& b) { return a.first < b.first; });
+        return lector.terminado();
+    }
+
+    // Lee las columnas del segmento. Deja los ids en ids y, si alLeerPedido no es
+    // nulo, arma cada pedido (incluidos los eliminados) y se lo entrega.
+    bool leerSegmento(uint32_t numero, vector<int>& ids, const function<void(Pedido&&)>& alLeerPedido) const {
+        if (!esperarEscritura()) {
+            return false;
+        }
+        ArchivoMapeado archivo(rutaSegmento(numero));
+        string_view seccionResumen, seccionColumnas;
+        ResumenSegmento resumen = resumenVacio();
+        vector<uint16_t> idsProducto;
+        uint16_t version;
+        if (!archivo.estaAbierto() || !separarSecciones(archivo.contenido(), true, seccionResumen, seccionColumnas, &version) ||
+            !leerResumen(seccionResumen, version, false, resumen, idsProducto)) {
+            return false;
+        }
+
+        LectorBinario lector(seccionColumnas.data(), seccionColumnas.data() + seccionColumnas.size());
+        size_t cantidad = resumen.cantidad;
+        if (cantidad > seccionColumnas.size()) {
+            return false;
+        }
+        ids.resize(cantidad);
+        int64_t anterior = 0;
+        for (size_t i = 0; i < cantidad; i++) {
+            int64_t diferencia;
+            if (!lector.leerZigzag(diferencia)) {
+                return false;
+            }
+            anterior += diferencia;
+            ids[i] = static_cast<int>(anterior);
+        }
+        if (!alLeerPedido) {
+            return true;
+        }
+
+        vector<int64_t> instantes(cantidad), totales(cantidad);
+        anterior = 0;
+        for (size_t i = 0; i < cantidad; i++) {
+            int64_t diferencia;
+            if (!lector.leerZigzag(diferencia)) {
+                return false;
+            }
+            anterior += diferencia;
+            instantes[i] = anterior;
+        }
+        for (size_t i = 0; i < cantidad; i++) {
+            if (!lector.leerZigzag(totales[i])) {
+                return false;
+            }
+        }
+
+        vector<uint8_t> marcasUrgente((cantidad + 7) / 8);
+        for (uint8_t& marcas : marcasUrgente) {
+            if (!lector.leer(marcas)) {
+                return false;
+            }
+        }
+
+        uint32_t cantidadClientes;
+        if (!lector.leer(cantidadClientes)) {
+            return false;
+        }
+        vector<uint32_t> idsCliente(cantidadClientes);
+        for (uint32_t& idCliente : idsCliente) {
+            string nombre;
+            if (!lector.leerTexto(nombre)) {
+                return false;
+            }
+            idCliente = RegistroClientes::global().registrar(nombre);
+        }
+        vector<uint32_t> clientes(cantidad);
+        for (size_t i = 0; i < cantidad; i++) {
+            uint64_t indice;
+            if (!lector.leerVarint(indice) || indice >= idsCliente.size()) {
+                return false;
+            }
+            clientes[i] = idsCliente[indice];
+        }
+
+        for (size_t i = 0; i < cantidad; i++) {
+            uint64_t numProductos;
+            if (!lector.leerVarint(numProductos) || numProductos > MAXIMO_LINEAS_PEDIDO || numProductos > lector.restante()) {
+                return false;
+            }
+            LineasPedido productos;
+            productos.reserve(numProductos);
+            for (uint64_t j = 0; j < numProductos; j++) {
+                uint64_t indice;
+                int64_t precio;
+                if (!lector.leerVarint(indice) || indice >= idsProducto.size() || !lector.leerZigzag(precio)) {
+                    return false;
+                }
+                productos.push_back(Producto(idsProducto[indice], Dinero::desdeCentavos(precio)));
+            }
+            bool urgente = (marcasUrgente[i / 8] >> (i % 8)) & 1;
+            alLeerPedido(Pedido(ids[i], clientes[i], move(productos), Dinero::desdeCentavos(totales[i]), instantes[i], urgente));
+        }
+        return lector.terminado();
+    }
+
+    // Entrega a alFila(fila) los pedidos del segmento que pasan el filtro, sin
+    // armarlos. El resumen descarta el segmento entero sin leer las columnas si
+    // su rango de fechas, la urgencia o el producto no pueden pasar; despues las
+    // columnas de fecha, urgencia y cliente eligen las filas y solo de esas se
+    // guardan las lineas. La memoria es la de un segmento. Devuelve false si el
+    // archivo no es valido; saltado queda en true si el resumen lo descarto.
+    template <typename Funcion>
+    static bool filtrarSegmento(const string& ruta, uint32_t numero, const unordered_set<uint64_t>& eliminados,
+                                const FiltroExportacion& filtro, bool& saltado, Funcion alFila) {
+        saltado = false;
+        ArchivoMapeado archivo(ruta);
+        string_view seccionResumen, seccionColumnas;
+        if (!archivo.estaAbierto() || !separarSecciones(archivo.contenido(), false, seccionResumen, seccionColumnas)) {
+            return false;
+        }
+
+        // Del resumen solo hace falta el principio: cantidad, fechas, productos y urgencia
+        LectorBinario resumen(seccionResumen.data(), seccionResumen.data() + seccionResumen.size());
+        uint64_t cantidad;
+        int32_t idMinimo, idMaximo;
+        int64_t instanteMinimo, instanteMaximo;
+        uint32_t cantidadProductos;
+        if (!resumen.leer(cantidad) || !resumen.leer(idMinimo) || !resumen.leer(idMaximo) || !resumen.leer(instanteMinimo) ||
+            !resumen.leer(instanteMaximo) || !resumen.leer(cantidadProductos) || cantidadProductos > resumen.restante()) {
+            return false;
+        }
+        vector<string_view> nombresProducto(cantidadProductos);
+        uint32_t indiceProducto = cantidadProductos;
+        uint64_t unidadesProducto = 0;
+        for (uint32_t i = 0; i < cantidadProductos; i++) {
+            uint64_t unidades;
+            if (!resumen.leerTexto(nombresProducto[i]) || !resumen.leer(unidades) || !resumen.saltar(sizeof(int64_t))) {
+                return false;
+            }
+            if (nombresProducto[i] == filtro.producto) {
+                indiceProducto = i;
+                unidadesProducto = unidades;
+            }
+        }
+        uint64_t pedidosPorUrgencia[2];
+        if (!resumen.saltar(24 * (sizeof(uint64_t) + sizeof(int64_t))) || !resumen.leer(pedidosPorUrgencia[0]) ||
+            !resumen.saltar(sizeof(int64_t)) || !resumen.leer(pedidosPorUrgencia[1])) {
+            return false;
+        }
+
+        if (cantidad == 0 || !filtro.admiteRango(instanteMinimo, instanteMaximo) ||
+            (filtro.urgencia >= 0 && pedidosPorUrgencia[filtro.urgencia] == 0) ||
+            (!filtro.producto.empty() && unidadesProducto == 0)) {
+            saltado = true;
+            return true;
+        }
+        if (!separarSecciones(archivo.contenido(), true, seccionResumen, seccionColumnas)) {
+            return false;
+        }
+
+        if (cantidad > seccionColumnas.size()) {
+            return false;
+        }
+        LectorBinario lector(seccionColumnas.data(), seccionColumnas.data() + seccionColumnas.size());
+        size_t filas = static_cast<size_t>(cantidad);
+        vector<int> ids(filas);
+        vector<int64_t> instantes(filas), totales(filas);
+        int64_t anterior = 0;
+        for (size_t i = 0; i < filas; i++) {
+            int64_t diferencia;
+            if (!lector.leerZigzag(diferencia)) {
+                return false;
+            }
+            anterior += diferencia;
+            ids[i] = static_cast<int>(anterior);
+        }
+        anterior = 0;
+        for (size_t i = 0; i < filas; i++) {
+            int64_t diferencia;
+            if (!lector.leerZigzag(diferencia)) {
+                return false;
+            }
+            anterior += diferencia;
+            instantes[i] = anterior;
+        }
+        for (size_t i = 0; i < filas; i++) {
+            if (!lector.leerZigzag(totales[i])) {
+                return false;
+            }
+        }
+        vector<uint8_t> marcasUrgente((filas + 7) / 8);
+        for (uint8_t& marcas : marcasUrgente) {
+            if (!lector.leer(marcas)) {
+                return false;
+            }
+        }
+
+        uint32_t cantidadClientes;
+        if (!lector.leer(cantidadClientes)) {
+            return false;
+        }
+        vector<string_view> nombresCliente(cantidadClientes);
+        vector<uint8_t> clienteAdmitido(cantidadClientes);
+        for (uint32_t i = 0; i < cantidadClientes; i++) {
+            if (!lector.leerTexto(nombresCliente[i])) {
+                return false;
+            }
+            clienteAdmitido[i] = filtro.admiteCliente(nombresCliente[i]);
+        }
+
+        // Filas elegidas por las columnas; el producto se revisa al leer sus lineas
+        vector<uint32_t> clientes(filas);
+        vector<uint8_t> elegidas(filas);
+        for (size_t i = 0; i < filas; i++) {
+            uint64_t indice;
+            if (!lector.leerVarint(indice) || indice >= cantidadClientes) {
+                return false;
+            }
+            clientes[i] = static_cast<uint32_t>(indice);
+            bool urgente = (marcasUrgente[i / 8] >> (i % 8)) & 1;
+            elegidas[i] = clienteAdmitido[indice] && filtro.admiteUrgencia(urgente) && filtro.admiteInstante(instantes[i]) &&
+                          (eliminados.empty() || eliminados.count(claveEliminado(numero, ids[i])) == 0);
+        }
+
+        FilaExportada fila;
+        for (size_t i = 0; i < filas; i++) {
+            uint64_t numProductos;
+            if (!lector.leerVarint(numProductos)) {
+                return false;
+            }
+            fila.productos.clear();
+            bool tieneProducto = filtro.producto.empty();
+            for (uint64_t j = 0; j < numProductos; j++) {
+                uint64_t indice;
+                int64_t precio;
+                if (!lector.leerVarint(indice) || indice >= cantidadProductos || !lector.leerZigzag(precio)) {
+                    return false;
+                }
+                if (elegidas[i]) {
+                    fila.productos.emplace_back(nombresProducto[indice], Dinero::desdeCentavos(precio));
+                    tieneProducto = tieneProducto || indice == indiceProducto;
+                }
+            }
+            if (!elegidas[i] || !tieneProducto) {
+                continue;
+            }
+
+            fila.id = ids[i];
+            fila.cliente = nombresCliente[clientes[i]];
+            fila.instante = instantes[i];
+            fila.urgente = (marcasUrgente[i / 8] >> (i % 8)) & 1;
+            fila.total = Dinero::desdeCentavos(totales[i]);
+            alFila(static_cast<const FilaExportada&>(fila));
+        }
+        return lector.terminado();
+    }
+
+    // Indice del segmento mas reciente que tiene el id (aunque este eliminado) o
+    // segmentos.size()
+    size_t buscarSegmento(int id) const {
+        for (size_t i = segmentos.size(); i-- > 0;) {
+            const ResumenSegmento& segmento = segmentos[i];
+            if (id < segmento.idMinimo || id > segmento.idMaximo || !puedeEstarEnFiltro(segmento.filtroIds, id)) {
+                continue;
+            }
+            if (segmentoEnCache != segmento.numero) {
+                if (!leerSegmento(segmento.numero, idsEnCache, nullptr)) {
+                    continue;
+                }
+                sort(idsEnCache.begin(), idsEnCache.end());
+                segmentoEnCache = segmento.numero;
+            }
+            if (binary_search(idsEnCache.begin(), idsEnCache.end(), id)) {
+                return i;
+            }
+        }
+        return segmentos.size();
+    }
+
+    // Igual que el respaldo: archivo temporal que se sincroniza y se renombra al final
+    static bool escribirSegmento(const string& ruta, const string& contenido) {
+        CronometroMetrica cronometro(Metricas::global().latenciaArchivar);
+        string rutaTemporal = ruta + ".tmp";
+        FILE* archivo = fopen(rutaTemporal.c_str(), "wb");
+        if (archivo == nullptr) {
+            return false;
+        }
+        bool escrito = fwrite(contenido.data(), 1, contenido.size(), archivo) == contenido.size();
+        sincronizarArchivo(archivo);
+        fclose(archivo);
+        if (!escrito || !reemplazarArchivo(rutaTemporal, ruta)) {
+            remove(rutaTemporal.c_str());
+            return false;
+        }
+        return true;
+    }
+
+public:
+    explicit HistorialArchivado(const string& _prefijo) : prefijo(_prefijo) {}
+
+    // Espera a que el ultimo segmento archivado este en disco. Devuelve false si
+    // no se pudo escribir ni al reintentarlo; el siguiente llamado reintenta.
+    bool esperarEscritura() const {
+        if (!escrituraPendiente) {
+            return true;
+        }
+        if (!hiloEscritura.recoger() && !escribirSegmento(rutaSegmento(numeroPorEscribir), porEscribir)) {
+            return false;
+        }
+        escrituraPendiente = false;
+        porEscribir.clear();
+        return true;
+    }
+
+    string rutaSegmento(uint32_t numero) const {
+        char nombre[40];
+        snprintf(nombre, sizeof(nombre), "pedidos_archivo_%06u.seg", numero);
+        return prefijo + nombre;
+    }
+
+    // Arma con los primeros `cantidad` pedidos un segmento nuevo y lo deja
+    // escribiendose en el hilo de escritura. Devuelve false si el segmento
+    // anterior no se pudo escribir; en ese caso no cambia nada.
+    bool archivar(const HistorialEnMemoria& pedidos, size_t cantidad) {
+        if (cantidad == 0) {
+            return true;
+        }
+        if (!esperarEscritura()) {
+            return false;
+        }
+
+        uint32_t numero = segmentos.empty() ? 1 : segmentos.back().numero + 1;
+        error_code error;
+        while (filesystem::exists(rutaSegmento(numero), error)) {
+            numero++;
+        }
+
+        ResumenSegmento resumen = resumenVacio();
+        resumen.numero = numero;
+        resumen.idMinimo = resumen.idMaximo = pedidos[0].getId();
+        resumen.instanteMinimo = resumen.instanteMaximo = pedidos[0].getInstante();
+        resumen.filtroIds.assign((cantidad * BITS_FILTRO_POR_PEDIDO + 63) / 64, 0);
+
+        string columnas;
+        EscritorBinario escritor(columnas);
+        int64_t anterior = 0;
+        for (size_t i = 0; i < cantidad; i++) {
+            const Pedido& p = pedidos[i];
+            escritor.escribirZigzag(p.getId() - anterior);
+            anterior = p.getId();
+            resumen.idMinimo = min(resumen.idMinimo, p.getId());
+            resumen.idMaximo = max(resumen.idMaximo, p.getId());
+            posicionesFiltro(resumen.filtroIds, p.getId(), [&](size_t bit) { resumen.filtroIds[bit / 64] |= uint64_t(1) << (bit % 64); });
+            sumarAlResumen(resumen, p, 1);
+        }
+        anterior = 0;
+        for (size_t i = 0; i < cantidad; i++) {
+            escritor.escribirZigzag(pedidos[i].getInstante() - anterior);
+            anterior = pedidos[i].getInstante();
+            resumen.instanteMinimo = min(resumen.instanteMinimo, anterior);
+            resumen.instanteMaximo = max(resumen.instanteMaximo, anterior);
+        }
+        for (size_t i = 0; i < cantidad; i++) {
+            escritor.escribirZigzag(pedidos[i].getTotal().getCentavos());
+        }
+        for (size_t i = 0; i < cantidad; i += 8) {
+            uint8_t marcas = 0;
+            for (size_t j = i; j < cantidad && j < i + 8; j++) {
+                marcas |= static_cast<uint8_t>((pedidos[j].esUrgente() ? 1 : 0) << (j - i));
+            }
+            escritor.escribir<uint8_t>(marcas);
+        }
+
+        // Tablas del segmento: cada cliente y producto distinto una vez
+        vector<uint32_t> clientes;
+        unordered_map<uint32_t, uint32_t> indiceCliente;
+        vector<uint32_t> indices(cantidad);
+        map<uint32_t, ArchivadosCliente> porCliente;
+        for (size_t i = 0; i < cantidad; i++) {
+            auto nuevo = indiceCliente.emplace(pedidos[i].getIdCliente(), static_cast<uint32_t>(clientes.size()));
+            if (nuevo.second) {
+                clientes.push_back(pedidos[i].getIdCliente());
+            }
+            indices[i] = nuevo.first->second;
+            porCliente[pedidos[i].getIdCliente()].sumar(pedidos[i]);
+        }
+        resumen.porCliente.assign(porCliente.begin(), porCliente.end());
+        escritor.escribir<uint32_t>(static_cast<uint32_t>(clientes.size()));
+        for (uint32_t idCliente : clientes) {
+            escritor.escribirTexto(RegistroClientes::global().nombre(idCliente));
+        }
+        for (uint32_t indice : indices) {
+            escritor.escribirVarint(indice);
+        }
+
+        vector<uint16_t> productos;
+        unordered_map<uint16_t, uint32_t> indiceProducto;
+        for (size_t i = 0; i < cantidad; i++) {
+            const LineasPedido& lineas = pedidos[i].getProductos();
+            escritor.escribirVarint(lineas.size());
+            for (const Producto& p : lineas) {
+                auto nuevo = indiceProducto.emplace(p.getIdProducto(), static_cast<uint32_t>(productos.size()));
+                if (nuevo.second) {
+                    productos.push_back(p.getIdProducto());
+                }
+                escritor.escribirVarint(nuevo.first->second);
+                escritor.escribirZigzag(p.getPrecio().getCentavos());
+            }
+        }
+
+        string seccionResumen;
+        EscritorBinario escritorResumen(seccionResumen);
+        escritorResumen.escribir<uint64_t>(cantidad);
+        escritorResumen.escribir<int32_t>(resumen.idMinimo);
+        escritorResumen.escribir<int32_t>(resumen.idMaximo);
+        escritorResumen.escribir<int64_t>(resumen.instanteMinimo);
+        escritorResumen.escribir<int64_t>(resumen.instanteMaximo);
+        escritorResumen.escribir<uint32_t>(static_cast<uint32_t>(productos.size()));
+        auto escribirGrupo = [&](const VentasPorGrupo& ventas, size_t grupo) {
+            escritorResumen.escribir<uint64_t>(static_cast<uint64_t>(ventas.cantidad[grupo]));
+            escritorResumen.escribir<int64_t>(ventas.ingreso[grupo].getCentavos());
+        };
+        for (uint16_t idProducto : productos) {
+            escritorResumen.escribirTexto(CatalogoProductos::global().nombre(idProducto));
+            escribirGrupo(resumen.porProducto, idProducto);
+        }
+        for (size_t hora = 0; hora < 24; hora++) {
+            escribirGrupo(resumen.porHora, hora);
+        }
+        for (size_t urgencia = 0; urgencia < 2; urgencia++) {
+            escribirGrupo(resumen.porUrgencia, urgencia);
+        }
+        escritorResumen.escribir<uint32_t>(static_cast<uint32_t>(resumen.porDia.size()));
+        for (const auto& dia : resumen.porDia) {
+            escritorResumen.escribir<int64_t>(dia.first);
+            escritorResumen.escribir<uint64_t>(dia.second.cantidadPedidos);
+            escritorResumen.escribir<int64_t>(dia.second.ingresoTotal.getCentavos());
+        }
+        escritorResumen.escribir<uint32_t>(static_cast<uint32_t>(resumen.filtroIds.size()));
+        for (uint64_t palabra : resumen.filtroIds) {
+            escritorResumen.escribir<uint64_t>(palabra);
+        }
+        escritorResumen.escribir<uint32_t>(static_cast<uint32_t>(resumen.porCliente.size()));
+        for (const auto& entrada : resumen.porCliente) {
+            escritorResumen.escribirTexto(RegistroClientes::global().nombre(entrada.first));
+            escritorResumen.escribir<uint64_t>(entrada.second.cantidad);
+            escritorResumen.escribir<int64_t>(entrada.second.gasto.getCentavos());
+            escritorResumen.escribir<int32_t>(entrada.second.ultimoId);
+            escritorResumen.escribir<int64_t>(entrada.second.ultimoInstante);
+        }
+
+        string encabezado(MAGICO_SEGMENTO, sizeof(MAGICO_SEGMENTO));
+        EscritorBinario escritorEncabezado(encabezado);
+        escritorEncabezado.escribir<uint16_t>(VERSION_SEGMENTO);
+        escritorEncabezado.escribir<uint16_t>(0);
+        escritorEncabezado.escribir<uint64_t>(seccionResumen.size());
+        escritorEncabezado.escribir<uint64_t>(columnas.size());
+        escritorEncabezado.escribir<uint64_t>(calcularChecksum(seccionResumen.data(), seccionResumen.size()));
+        escritorEncabezado.escribir<uint64_t>(calcularChecksum(columnas.data(), columnas.size()));
+
+        porEscribir.reserve(encabezado.size() + seccionResumen.size() + columnas.size());
+        porEscribir.append(encabezado).append(seccionResumen).append(columnas);
+        numeroPorEscribir = numero;
+        escrituraPendiente = true;
+        segmentos.push_back(move(resumen));
+        hiloEscritura.lanzar([this, ruta = rutaSegmento(numero)] { return escribirSegmento(ruta, porEscribir); });
+        return true;
+    }
+
+    // Lee los resumenes de los segmentos que nombra el respaldo y descuenta los
+    // pedidos eliminados. Devuelve false si falta un segmento o esta danado.
+    bool abrir(const vector<uint32_t>& numeros, const vector<pair<uint32_t, int>>& idsEliminados) {
+        clear();
+        unordered_set<uint32_t> sinClientes;
+        for (uint32_t numero : numeros) {
+            ArchivoMapeado archivo(rutaSegmento(numero));
+            string_view seccionResumen, seccionColumnas;
+            ResumenSegmento resumen = resumenVacio();
+            vector<uint16_t> idsProducto;
+            uint16_t version;
+            if (!archivo.estaAbierto() || !separarSecciones(archivo.contenido(), false, seccionResumen, seccionColumnas, &version) ||
+                !leerResumen(seccionResumen, version, true, resumen, idsProducto)) {
+                clear();
+                return false;
+            }
+            if (version < 2) {
+                sinClientes.insert(numero);
+            }
+            resumen.numero = numero;
+            segmentos.push_back(move(resumen));
+        }
+
+        // Cada segmento con eliminados, o de la version 1 sin clientes en el
+        // resumen, se lee una sola vez y sus clientes se cuentan de las columnas
+        unordered_map<uint32_t, unordered_set<int>> eliminadosPorSegmento;
+        for (const auto& eliminado : idsEliminados) {
+            eliminadosPorSegmento[eliminado.first].insert(eliminado.second);
+        }
+        for (ResumenSegmento& segmento : segmentos) {
+            auto grupo = eliminadosPorSegmento.find(segmento.numero);
+            bool conEliminados = grupo != eliminadosPorSegmento.end();
+            if (!conEliminados && sinClientes.count(segmento.numero) == 0) {
+                continue;
+            }
+            vector<int> ids;
+            map<uint32_t, ArchivadosCliente> porCliente;
+            bool valido = leerSegmento(segmento.numero, ids, [&](Pedido&& pedido) {
+                if (conEliminados && grupo->second.count(pedido.getId()) > 0 &&
+                    eliminados.insert(claveEliminado(segmento.numero, pedido.getId())).second) {
+                    sumarAlResumen(segmento, pedido, -1);
+                    return;
+                }
+                porCliente[pedido.getIdCliente()].sumar(pedido);
+            });
+            if (!valido) {
+                clear();
+                return false;
+            }
+            segmento.porCliente.assign(porCliente.begin(), porCliente.end());
+        }
+        return true;
+    }
+
+    // Numeros de los segmentos de este prefijo que hay en la carpeta, en
+    // cualquier orden, despues de esperar la escritura en curso; con
+    // temporales, los de escrituras que quedaron cortadas
+    vector<uint32_t> numerosEnDisco(bool temporales = false) const {
+        esperarEscritura();
+        filesystem::path base(prefijo + "pedidos_archivo_");
+        filesystem::path carpeta = base.has_parent_path() ? base.parent_path() : filesystem::path(".");
+        string inicio = base.filename().string();
+        string_view fin = temporales ? ".seg.tmp" : ".seg";
+
+        vector<uint32_t> encontrados;
+        error_code error;
+        for (filesystem::directory_iterator it(carpeta, error), ultimo; !error && it != ultimo; it.increment(error)) {
+            string nombre = it->path().filename().string();
+            string_view resto(nombre);
+            if (resto.size() <= inicio.size() + fin.size() || resto.substr(0, inicio.size()) != inicio ||
+                resto.substr(resto.size() - fin.size()) != fin) {
+                continue;
+            }
+            resto = resto.substr(inicio.size(), resto.size() - inicio.size() - fin.size());
+            // Solo los nombres que arma rutaSegmento (seis cifras o mas, sin signo)
+            uint32_t numero;
+            if (convertirNumero(resto, numero) && filesystem::path(rutaSegmento(numero)).filename().string() + string(fin.substr(4)) == nombre) {
+                encontrados.push_back(numero);
+            }
+        }
+        return encontrados;
+    }
+
+    // Borra los segmentos que no estan en la lista y los temporales que quedaron
+    // a medias: los escribio una sesion que archivo pedidos y termino, o volvio
+    // a cargar, sin guardar. Se busca en la carpeta, asi no importan los huecos.
+    void borrarHuerfanos() const {
+        unordered_set<uint32_t> enUso;
+        for (const ResumenSegmento& segmento : segmentos) {
+            enUso.insert(segmento.numero);
+        }
+        for (uint32_t numero : numerosEnDisco()) {
+            if (enUso.count(numero) == 0) {
+                remove(rutaSegmento(numero).c_str());
+            }
+        }
+        for (uint32_t numero : numerosEnDisco(true)) {
+            remove((rutaSegmento(numero) + ".tmp").c_str());
+        }
+    }
+
+    void clear() {
+        esperarEscritura();
+        escrituraPendiente = false;
+        porEscribir.clear();
+        segmentos.clear();
+        eliminados.clear();
+        segmentoEnCache = 0;
+        idsEnCache.clear();
+    }
+
+    bool contiene(int id) const {
+        size_t indice = buscarSegmento(id);
+        return indice < segmentos.size() && !estaEliminado(segmentos[indice].numero, id);
+    }
+
+    optional<Pedido> buscar(int id) const {
+        size_t indice = buscarSegmento(id);
+        if (indice == segmentos.size() || estaEliminado(segmentos[indice].numero, id)) {
+            return nullopt;
+        }
+
+        optional<Pedido> encontrado;
+        vector<int> ids;
+        leerSegmento(segmentos[indice].numero, ids, [&](Pedido&& pedido) {
+            if (pedido.getId() == id) {
+                encontrado = move(pedido);
+            }
+        });
+        return encontrado;
+    }
+
+    // Marca el pedido como eliminado y lo descuenta del resumen de su segmento.
+    // Si era el mas reciente de su cliente en el segmento, los pedidos de ese
+    // cliente se vuelven a contar leyendo solo este segmento.
+    optional<Pedido> eliminar(int id) {
+        optional<Pedido> pedido = buscar(id);
+        if (pedido) {
+            size_t indice = buscarSegmento(id);
+            ResumenSegmento& segmento = segmentos[indice];
+            sumarAlResumen(segmento, *pedido, -1);
+            eliminados.insert(claveEliminado(segmento.numero, id));
+
+            uint32_t idCliente = pedido->getIdCliente();
+            size_t posicion = segmento.posicionCliente(idCliente);
+            if (posicion < segmento.porCliente.size()) {
+                ArchivadosCliente& cliente = segmento.porCliente[posicion].second;
+                if (cliente.cantidad > 1 && cliente.ultimoId != id) {
+                    cliente.cantidad--;
+                    cliente.gasto -= pedido->getTotal();
+                }
+                else {
+                    cliente = ArchivadosCliente();
+                    recorrerSegmento(indice, [&](Pedido&& otro) {
+                        if (otro.getIdCliente() == idCliente) {
+                            cliente.sumar(otro);
+                        }
+                    });
+                    if (cliente.cantidad == 0) {
+                        segmento.porCliente.erase(segmento.porCliente.begin() + posicion);
+                    }
+                }
+            }
+        }
+        return pedido;
+    }
+
+    // Entrega a alLeerPedido(pedido) los pedidos vigentes de un segmento, en el
+    // orden en que se archivaron. Devuelve false si el segmento no se pudo leer.
+    template <typename Funcion>
+    bool recorrerSegmento(size_t indice, Funcion alLeerPedido) const {
+        vector<int> ids;
+        uint32_t numero = segmentos[indice].numero;
+        return leerSegmento(numero, ids, [&](Pedido&& pedido) {
+            if (!estaEliminado(numero, pedido.getId())) {
+                alLeerPedido(move(pedido));
+            }
+        });
+    }
+
+    // Todos los pedidos archivados, del mas antiguo al mas reciente
+    template <typename Funcion>
+    bool recorrer(Funcion alLeerPedido) const {
+        for (size_t i = 0; i < segmentos.size(); i++) {
+            if (!recorrerSegmento(i, alLeerPedido)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Los pedidos archivados que pasan el filtro, como filas de exportacion
+    // (ver filtrarSegmento). saltados cuenta los segmentos que no se leyeron.
+    template <typename Funcion>
+    bool filtrar(const FiltroExportacion& filtro, size_t& saltados, Funcion alFila) const {
+        if (!esperarEscritura()) {
+            return false;
+        }
+        for (const ResumenSegmento& segmento : segmentos) {
+            bool saltado;
+            if (!filtrarSegmento(rutaSegmento(segmento.numero), segmento.numero, eliminados, filtro, saltado, alFila)) {
+                return false;
+            }
+            saltados += saltado;
+        }
+        return true;
+    }
+
+    // Revisa el encabezado y los dos checksums de cada segmento, sin leer los pedidos
+    bool verificarGuardados(const vector<uint32_t>& numeros) const {
+        for (uint32_t numero : numeros) {
+            ArchivoMapeado archivo(rutaSegmento(numero));
+            string_view seccionResumen, seccionColumnas;
+            if (!archivo.estaAbierto() || !separarSecciones(archivo.contenido(), true, seccionResumen, seccionColumnas)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Lo mismo para los segmentos que nombra un respaldo, sin cargarlos
+    template <typename Funcion>
+    bool filtrarGuardados(const vector<uint32_t>& numeros, const vector<pair<uint32_t, int>>& eliminadosGuardados,
+                          const FiltroExportacion& filtro, size_t& saltados, Funcion alFila) const {
+        unordered_set<uint64_t> claves;
+        for (const auto& eliminado : eliminadosGuardados) {
+            claves.insert(claveEliminado(eliminado.first, eliminado.second));
+        }
+        for (uint32_t numero : numeros) {
+            bool saltado;
+            if (!filtrarSegmento(rutaSegmento(numero), numero, claves, filtro, saltado, alFila)) {
+                return false;
+            }
+            saltados += saltado;
+        }
+        return true;
+    }
+
+    // Pedidos archivados de un cliente, de los resumenes sin leer el disco
+    ArchivadosCliente deCliente(uint32_t idCliente) const {
+        ArchivadosCliente total;
+        for (const ResumenSegmento& segmento : segmentos) {
+            size_t posicion = segmento.posicionCliente(idCliente);
+            if (posicion < segmento.porCliente.size()) {
+                total.juntar(segmento.porCliente[posicion].second);
+            }
+        }
+        return total;
+    }
+
+    const vector<ResumenSegmento>& getSegmentos() const {
+        return segmentos;
+    }
+
+    vector<uint32_t> numeros() const {
+        vector<uint32_t> resultado;
+        for (const ResumenSegmento& segmento : segmentos) {
+            resultado.push_back(segmento.numero);
+        }
+        return resultado;
+    }
+
+    // Pares (segmento, id) de los pedidos eliminados
+    vector<pair<uint32_t, int>> idsEliminados() const {
+        vector<pair<uint32_t, int>> resultado;
+        for (uint64_t clave : eliminados) {
+            resultado.emplace_back(static_cast<uint32_t>(clave >> 32), static_cast<int>(static_cast<uint32_t>(clave)));
+        }
+        sort(resultado.begin(), resultado.end());
+        return resultado;
+    }
+
+    size_t cantidad() const {
+        size_t total = 0;
+        for (const ResumenSegmento& segmento : segmentos) {
+            total += segmento.cantidad;
+        }
+        return total;
+    }
+
+    Dinero ingreso() const {
+        Dinero total;
+        for (const ResumenSegmento& segmento : segmentos) {
+            total += segmento.ingreso();
+        }
+        return total;
+    }
+};
+
+// Resultado de cargar los datos guardados
+enum class EstadoCarga {
+    Correcta,
+    SinArchivos,
+    RespaldoDanado,
+    ErrorLectura  // la lectura fallo a mitad (por ejemplo, sin memoria)
+};
+
+// Pedidos de un cliente; el gasto cuenta solo los completados
+struct ResumenCliente {
+    size_t pendientes = 0;
+    size_t completados = 0;  // incluye los archivados
+    size_t archivados = 0;
+    Dinero gasto;
+    int ultimoId = 0;  // el de fecha mas reciente, pendiente o completado
+    int64_t ultimoInstante = 0;
+};
+
+struct ResultadoCarga {
+    EstadoCarga estado = EstadoCarga::Correcta;
+    int duplicados = 0;
+    size_t eventosAplicados = 0;
+    bool colaIncompleta = false;
+    // Revision de los pedidos cargados: el total guardado se compara con la
+    // suma de sus productos y cada precio con el del catalogo
+    vector<int> totalesIncorrectos;
+    size_t preciosDistintosAlCatalogo = 0;
+    // Productos nuevos que no entraron en el catalogo lleno y se cargaron como
+    // "Otro producto"; el contador es del proceso, asi que una carga en paralelo
+    // de otra sucursal tambien suma aqui
+    size_t productosSinLugar = 0;
+    // Lo mismo para clientes nuevos con el registro lleno ("Otro cliente")
+    size_t clientesSinLugar = 0;
+    // Pedidos del formato de texto cuya fecha no se entendio; se cargan con
+    // fecha 01/01/1970
+    vector<int> fechasInvalidas;
+};
+
+enum class EstadoExportacion {
+    Correcta,
+    SinArchivos,
+    ArchivoDanado,
+    ErrorEscritura
+};
+
+struct ResultadoExportacion {
+    EstadoExportacion estado = EstadoExportacion::Correcta;
+    size_t filas = 0;
+    uint64_t bytes = 0;
+    size_t segmentosSaltados = 0;  // archivados que el filtro descarto sin leer sus columnas
+    size_t fechasInvalidas = 0;    // filas del formato de texto que salieron con fecha 01/01/1970
+};
+
+// Con pocas lapidas no vale la pena purgar el historial
+const size_t LAPIDAS_MINIMAS_PARA_PURGAR = 1024;
+
+// Clase para gestionar los pedidos
+class GestorPedidos {
+private:
+    // Pendientes en orden de atencion (urgentes y normales segun su limite) y
+    // completados en orden de finalizacion (el final es la cima de la pila).
+    using IndicePedidos = unordered_map<int, UbicacionPedido, hash<int>, equal_to<int>, AsignadorPool<pair<const int, UbicacionPedido>>>;
+
+    // Bloques del historial y nodos del indice; van antes de los contenedores
+    // porque tienen que destruirse despues
+    PoolNodos poolHistorial;
+    PoolNodos poolIndice;
+
+    PlanificadorPedidos pedidosPendientes;
+    HistorialEnMemoria pedidosCompletados;
+
+    // Indice de pedidos por ID para buscar sin recorrer la cola ni la pila
+    IndicePedidos indicePedidos;
+
+    // Totales del historial para el reporte financiero; se actualizan cada vez
+    // que un pedido entra o sale de pedidosCompletados. Las unidades van por id de catalogo.
+    Dinero ingresoCompletados;
+    vector<long long> unidadesVendidas;
+
+    // El historial tambien se reparte por dia local de la fecha del pedido. Cada
+    // dia guarda sus totales y los IDs que caen en el, asi una consulta por
+    // rango suma los dias completos y solo revisa pedido por pedido los extremos.
+    struct SegmentoDia {
+        size_t cantidadPedidos = 0;
+        Dinero ingreso;
+        vector<int> ids;
+    };
+    map<int64_t, SegmentoDia> segmentosPorDia;
+
+    // El historial por columnas para las consultas de analisis
+    HistorialColumnar columnasCompletados;
+
+    // IDs de los pedidos (pendientes y completados) de cada cliente, por id de
+    // RegistroClientes. El orden no importa: al quitar se cambia por el ultimo.
+    vector<vector<int>> pedidosPorCliente;
+
+    // Los completados mas antiguos pasan a segmentos en disco cuando el historial
+    // en memoria supera maximoEnMemoria pedidos o edadMaximaEnMemoria segundos
+    // (0 es sin limite). Los totales, dias, columnas e indices de arriba solo
+    // cubren lo que sigue en memoria.
+    HistorialArchivado archivo;
+    size_t maximoEnMemoria = 0;
+    int64_t edadMaximaEnMemoria = 0;
+    int64_t limiteEdadRevisado = 0;  // el historial se recorre por edad una vez por segundo
+    bool archivoConError = false;
+
+    // Archivos de datos: respaldo binario, journal de cambios y exportacion en texto
+    string rutaSnapshot;
+    string rutaJournal;
+    string rutaPendientes;
+    string rutaCompletados;
+
+    // Cada cambio se agrega al journal; guardarPedidos (o la compactacion
+    // automatica) lo resume en un respaldo nuevo y lo vacia
+    bool usarJournal;
+    FILE* journal = nullptr;
+    uint64_t secuenciaJournal = 0;
+    size_t eventosSinSincronizar = 0;
+    size_t eventosEnJournal = 0;
+    string bufferEvento;
+
+    // Lo que acompana a los pedidos en el respaldo; se toma junto con ellos
+    struct DatosRespaldo {
+        uint64_t secuencia = 0;
+        size_t cantidadProductos = 0;
+        vector<uint32_t> segmentos;
+        vector<pair<uint32_t, int>> eliminados;
+    };
+
+    // Respaldo en segundo plano (configurarRespaldo). Al empezar se fija una
+    // foto: copia de los pendientes (suelen ser pocos) y punteros a los
+    // completados vivos, que no se mueven mientras no se purgue ni se archive;
+    // eso queda en pausa hasta que el hilo de respaldo termina. El journal pasa
+    // a rutaJournalAnterior y los cambios siguientes van a uno nuevo; la carga
+    // lee los dos, asi un corte a mitad del respaldo no pierde nada. Los
+    // vectores de la foto conservan su capacidad de un respaldo al siguiente:
+    // tocar memoria nueva cuesta mas que copiar los punteros.
+    struct FotoRespaldo {
+        vector<Pedido> pendientes;
+        vector<const Pedido*> completados;
+        DatosRespaldo datos;
+    };
+    string rutaJournalAnterior;
+    bool respaldoAsincrono = false;
+    size_t cambiosPorRespaldo = EVENTOS_POR_COMPACTACION;
+    int64_t segundosPorRespaldo = 0;
+    size_t cambiosDesdeRespaldo = 0;
+    int64_t instanteUltimoRespaldo = 0;
+    bool ultimoRespaldoFallo = false;
+    FotoRespaldo foto;
+    bool fotoFijada = false;
+
+    // Lo que este gestor sumo a cada indicador de tamano (publicarTamanos)
+    mutable array<int64_t, 4> tamanosPublicados{};
+    TrabajoEnSegundoPlano hiloRespaldo;
+
+    // Nanosegundos leyendo archivos durante la carga en curso (para las metricas)
+    mutable uint64_t lecturaEnCarga = 0;
+    // Filas del historial por columnas ya revisadas en la carga en curso
+    size_t filasRevisadasEnCarga = 0;
+
+    // El limite sale de la fecha del pedido, asi el orden es el mismo al
+    // registrarlo, al reproducir el journal y al cargar un respaldo
+    void encolarPendiente(Pedido pedido) {
+        int64_t llegada = pedido.getInstante();
+        UbicacionPedido& ubicacion = indicePedidos[pedido.getId()];
+        ubicacion = { EstadoPedido::Pendiente, 0, 0, 0 };
+        indexarCliente(pedido, ubicacion);
+        int64_t limite = limiteAtencion(llegada, pedido.esUrgente());
+        pedidosPendientes.encolar(move(pedido), limite);
+    }
+
+    void apilarCompletado(Pedido pedido) {
+        // Si venia de la cola ya esta en el indice del cliente
+        auto entrada = indicePedidos.try_emplace(pedido.getId());
+        UbicacionPedido& ubicacion = entrada.first->second;
+        ubicacion.estado = EstadoPedido::Completado;
+        ubicacion.ranura = pedidosCompletados.size();
+        if (entrada.second) {
+            indexarCliente(pedido, ubicacion);
+        }
+        acumularEnReporte(pedido, ubicacion, 1);
+        columnasCompletados.agregar(pedido);
+        pedidosCompletados.push_back(move(pedido));
+    }
+
+    void indexarCliente(const Pedido& pedido, UbicacionPedido& ubicacion) {
+        if (pedido.getIdCliente() >= pedidosPorCliente.size()) {
+            pedidosPorCliente.resize(RegistroClientes::global().tamano());
+        }
+        vector<int>& ids = pedidosPorCliente[pedido.getIdCliente()];
+        ubicacion.posicionCliente = static_cast<uint32_t>(ids.size());
+        ids.push_back(pedido.getId());
+    }
+
+    // Saca el id en esa posicion poniendo el ultimo en su lugar; el que se
+    // mueve actualiza su posicion en el indice
+    void quitarDeLista(vector<int>& ids, uint32_t posicion, uint32_t UbicacionPedido::*campo) {
+        ids[posicion] = ids.back();
+        ids.pop_back();
+        if (posicion < ids.size()) {
+            indicePedidos.find(ids[posicion])->second.*campo = posicion;
+        }
+    }
+
+    // Vuelve a anotar las posiciones despues de filtrar una lista
+    void renumerarLista(const vector<int>& ids, uint32_t UbicacionPedido::*campo) {
+        for (size_t i = 0; i < ids.size(); i++) {
+            indicePedidos.find(ids[i])->second.*campo = static_cast<uint32_t>(i);
+        }
+    }
+
+    // signo = 1 cuando el pedido entra al historial y -1 cuando se elimina
+    void acumularEnReporte(const Pedido& pedido, UbicacionPedido& ubicacion, int signo) {
+        ingresoCompletados += pedido.getTotal() * signo;
+        for (const Producto& p : pedido.getProductos()) {
+            if (p.getIdProducto() >= unidadesVendidas.size()) {
+                unidadesVendidas.resize(CatalogoProductos::global().tamano(), 0);
+            }
+            unidadesVendidas[p.getIdProducto()] += signo;
+        }
+
+        auto dia = segmentosPorDia.try_emplace(diaDe(pedido.getInstante())).first;
+        SegmentoDia& segmento = dia->second;
+        segmento.cantidadPedidos += signo;
+        segmento.ingreso += pedido.getTotal() * signo;
+        if (signo > 0) {
+            ubicacion.posicionDia = static_cast<uint32_t>(segmento.ids.size());
+            segmento.ids.push_back(pedido.getId());
+        }
+        else if (segmento.cantidadPedidos == 0) {
+            segmentosPorDia.erase(dia);
+        }
+        else {
+            quitarDeLista(segmento.ids, ubicacion.posicionDia, &UbicacionPedido::posicionDia);
+        }
+    }
+
+    // Ranuras del historial que siguen vivas (sin las lapidas)
+    size_t completadosEnMemoria() const {
+        return pedidosCompletados.size() - columnasCompletados.cantidadEliminadas();
+    }
+
+    // Pasa a los indicadores la diferencia entre los tamanos de este gestor y
+    // lo que publico la ultima vez; con retirar saca todo lo que publico
+    void publicarTamanos(bool retirar = false) const {
+        Metricas& metricas = Metricas::global();
+        IndicadorMetrica* indicadores[] = { &metricas.pendientes, &metricas.completadosEnMemoria, &metricas.archivados, &metricas.lapidas };
+        int64_t tamanos[] = { static_cast<int64_t>(pedidosPendientes.size()), static_cast<int64_t>(completadosEnMemoria()),
+                              static_cast<int64_t>(archivo.cantidad()), static_cast<int64_t>(columnasCompletados.cantidadEliminadas()) };
+        for (size_t i = 0; i < tamanosPublicados.size(); i++) {
+            int64_t nuevo = retirar ? 0 : tamanos[i];
+            indicadores[i]->sumar(nuevo - tamanosPublicados[i]);
+            tamanosPublicados[i] = nuevo;
+        }
+    }
+
+    static vector<int64_t> preciosDelCatalogo() {
+        const CatalogoProductos& catalogo = CatalogoProductos::global();
+        vector<int64_t> precios(catalogo.tamano());
+        for (size_t id = 0; id < precios.size(); id++) {
+            precios[id] = catalogo.precio(static_cast<uint16_t>(id)).getCentavos();
+        }
+        return precios;
+    }
+
+    // Revisa los completados cargados que todavia no se revisaron; se llama
+    // antes de archivar durante la carga y al terminarla, asi cada pedido se
+    // revisa una vez mientras sus columnas estan en memoria
+    void revisarCargados(ResultadoCarga& resultado) {
+        CronometroMetrica cronometro(Metricas::global().validarCarga);
+        vector<int64_t> precios = preciosDelCatalogo();
+        resultado.preciosDistintosAlCatalogo += columnasCompletados.validar(filasRevisadasEnCarga, precios.data(), resultado.totalesIncorrectos);
+        filasRevisadasEnCarga = columnasCompletados.size();
+    }
+
+    // Saca las lapidas del historial y renumera las ranuras que quedan. Se hace
+    // cuando las lapidas pasan de un cuarto del historial, antes de archivar y
+    // al guardar, asi cada eliminacion cuesta O(1) amortizado.
+    void purgarEliminados() {
+        if (columnasCompletados.cantidadEliminadas() == 0 || historialFijado()) {
+            return;
+        }
+
+        size_t destino = 0;
+        for (size_t ranura = 0; ranura < pedidosCompletados.size(); ranura++) {
+            if (!columnasCompletados.estaViva(ranura)) {
+                continue;
+            }
+            if (destino != ranura) {
+                pedidosCompletados[destino] = move(pedidosCompletados[ranura]);
+                indicePedidos.find(pedidosCompletados[destino].getId())->second.ranura = destino;
+            }
+            destino++;
+        }
+        pedidosCompletados.erase(pedidosCompletados.begin() + destino, pedidosCompletados.end());
+        columnasCompletados.purgar();
+        Metricas::global().purgasHistorial.sumar();
+    }
+
+    void reiniciarReporte() {
+        ingresoCompletados = Dinero();
+        unidadesVendidas.assign(CatalogoProductos::global().tamano(), 0);
+        segmentosPorDia.clear();
+        columnasCompletados.clear();
+    }
+
+    // Pasa los n completados mas antiguos a un segmento nuevo y los saca de la
+    // memoria. Los dias y clientes afectados se filtran una sola vez. El
+    // historial no debe tener lapidas.
+    bool archivarAntiguos(size_t n) {
+        Metricas& metricas = Metricas::global();
+        {
+            CronometroMetrica cronometro(metricas.archivarPausa);
+            if (!archivo.archivar(pedidosCompletados, n)) {
+                archivoConError = true;
+                return false;
+            }
+        }
+        metricas.pedidosArchivados.sumar(n);
+
+        set<int64_t> dias;
+        set<uint32_t> clientes;
+        for (size_t i = 0; i < n; i++) {
+            const Pedido& pedido = pedidosCompletados[i];
+            ingresoCompletados -= pedido.getTotal();
+            for (const Producto& p : pedido.getProductos()) {
+                unidadesVendidas[p.getIdProducto()]--;
+            }
+            SegmentoDia& segmento = segmentosPorDia[diaDe(pedido.getInstante())];
+            segmento.cantidadPedidos--;
+            segmento.ingreso -= pedido.getTotal();
+            dias.insert(diaDe(pedido.getInstante()));
+            clientes.insert(pedido.getIdCliente());
+            indicePedidos.erase(pedido.getId());
+        }
+
+        auto fueArchivado = [&](int id) { return indicePedidos.count(id) == 0; };
+        for (int64_t dia : dias) {
+            SegmentoDia& segmento = segmentosPorDia[dia];
+            if (segmento.cantidadPedidos == 0) {
+                segmentosPorDia.erase(dia);
+                continue;
+            }
+            segmento.ids.erase(remove_if(segmento.ids.begin(), segmento.ids.end(), fueArchivado), segmento.ids.end());
+            renumerarLista(segmento.ids, &UbicacionPedido::posicionDia);
+        }
+        for (uint32_t idCliente : clientes) {
+            vector<int>& ids = pedidosPorCliente[idCliente];
+            ids.erase(remove_if(ids.begin(), ids.end(), fueArchivado), ids.end());
+            renumerarLista(ids, &UbicacionPedido::posicionCliente);
+        }
+
+        columnasCompletados.quitarPrimeras(n);
+        pedidosCompletados.erase(pedidosCompletados.begin(), pedidosCompletados.begin() + n);
+        for (size_t i = 0; i < pedidosCompletados.size(); i++) {
+            indicePedidos[pedidosCompletados[i].getId()].ranura = i;
+        }
+        return true;
+    }
+
+    // Con un limite chico los segmentos son de la mitad del limite, asi no se
+    // archiva en cada pedido procesado
+    size_t pedidosPorSegmento() const {
+        return maximoEnMemoria > 0 ? min(PEDIDOS_POR_SEGMENTO, max<size_t>(1, maximoEnMemoria / 2)) : PEDIDOS_POR_SEGMENTO;
+    }
+
+    // Archiva lo que exceda los limites. Por edad se espera a juntar un segmento
+    // completo de pedidos viejos, salvo con todosLosViejos (al guardar y cargar).
+    // Durante un respaldo en segundo plano se espera a que termine.
+    void archivarExcedente(bool todosLosViejos) {
+        if (archivoConError || historialFijado()) {
+            return;
+        }
+
+        // Las lapidas se purgan antes de archivar; el archivo no guarda eliminados
+        size_t porSegmento = pedidosPorSegmento();
+        while (maximoEnMemoria > 0 && completadosEnMemoria() > maximoEnMemoria) {
+            purgarEliminados();
+            if (!archivarAntiguos(min(porSegmento, pedidosCompletados.size()))) {
+                return;
+            }
+        }
+
+        if (edadMaximaEnMemoria <= 0) {
+            return;
+        }
+        int64_t limite = static_cast<int64_t>(time(nullptr)) - edadMaximaEnMemoria;
+        if (!todosLosViejos && limite == limiteEdadRevisado) {
+            return;
+        }
+        limiteEdadRevisado = limite;
+
+        // El historial va en orden de finalizacion y el instante es el de
+        // registro: un urgente registrado despues se completa antes que un
+        // normal mas viejo. Los viejos se buscan en todo el historial.
+        auto esViejo = [&](const Pedido& pedido) { return pedido.getInstante() < limite; };
+        if (static_cast<size_t>(count_if(pedidosCompletados.begin(), pedidosCompletados.end(), esViejo)) < porSegmento &&
+            !todosLosViejos) {
+            return;
+        }
+        purgarEliminados();
+        size_t viejos = count_if(pedidosCompletados.begin(), pedidosCompletados.end(), esViejo);
+        size_t aArchivar = todosLosViejos ? viejos : viejos - viejos % porSegmento;
+        if (aArchivar == 0) {
+            return;
+        }
+        adelantarViejos(limite, aArchivar);
+        while (aArchivar > 0) {
+            size_t n = min(porSegmento, aArchivar);
+            if (!archivarAntiguos(n)) {
+                return;
+            }
+            aArchivar -= n;
+        }
+    }
+
+    // Lleva al principio del historial los primeros n pedidos (en orden de
+    // finalizacion) registrados antes de limite, para archivarlos con
+    // archivarAntiguos; los demas conservan su orden. Las columnas se arman de
+    // nuevo. El historial no debe tener lapidas.
+    void adelantarViejos(int64_t limite, size_t n) {
+        vector<Pedido> otros;
+        size_t destino = 0;
+        for (size_t ranura = 0; destino < n; ranura++) {
+            Pedido& pedido = pedidosCompletados[ranura];
+            if (pedido.getInstante() >= limite) {
+                otros.push_back(move(pedido));
+                continue;
+            }
+            if (destino != ranura) {
+                pedidosCompletados[destino] = move(pedido);
+            }
+            destino++;
+        }
+        if (otros.empty()) {
+            return;
+        }
+        move(otros.begin(), otros.end(), pedidosCompletados.begin() + destino);
+
+        columnasCompletados.clear();
+        for (size_t ranura = 0; ranura < pedidosCompletados.size(); ranura++) {
+            columnasCompletados.agregar(pedidosCompletados[ranura]);
+            indicePedidos.find(pedidosCompletados[ranura].getId())->second.ranura = ranura;
+        }
+    }
+
+    // Pasa el frente de la cola al historial
+    void completarSiguiente() {
+        apilarCompletado(pedidosPendientes.desencolar());
+    }
+
+    // Pasa un pedido pendiente al historial aunque no sea el frente
+    void completarPendiente(int id) {
+        optional<Pedido> pedido = pedidosPendientes.quitar(id);
+        if (pedido) {
+            apilarCompletado(move(*pedido));
+        }
+    }
+
+    // Quita un pedido de la cola o del historial. En el historial la ranura queda
+    // como lapida y los demas no se mueven; los archivados solo se marcan como eliminados.
+    bool quitarPedido(int id) {
+        auto it = indicePedidos.find(id);
+        if (it == indicePedidos.end()) {
+            return archivo.eliminar(id).has_value();
+        }
+
+        UbicacionPedido ubicacion = it->second;
+        indicePedidos.erase(it);
+
+        if (ubicacion.estado == EstadoPedido::Pendiente) {
+            optional<Pedido> pedido = pedidosPendientes.quitar(id);
+            if (pedido) {
+                quitarDeLista(pedidosPorCliente[pedido->getIdCliente()], ubicacion.posicionCliente, &UbicacionPedido::posicionCliente);
+            }
+        }
+        else {
+            const Pedido& pedido = pedidosCompletados[ubicacion.ranura];
+            quitarDeLista(pedidosPorCliente[pedido.getIdCliente()], ubicacion.posicionCliente, &UbicacionPedido::posicionCliente);
+            acumularEnReporte(pedido, ubicacion, -1);
+            columnasCompletados.quitar(ubicacion.ranura);
+            if (columnasCompletados.cantidadEliminadas() > max(LAPIDAS_MINIMAS_PARA_PURGAR, pedidosCompletados.size() / 4)) {
+                purgarEliminados();
+            }
+        }
+        return true;
+    }
+
+    void abrirJournal(bool vaciar) {
+        if (journal != nullptr) {
+            fclose(journal);
+        }
+        journal = fopen(rutaJournal.c_str(), vaciar ? "wb" : "ab");
+        if (journal != nullptr) {
+            setvbuf(journal, nullptr, _IOFBF, 1 << 16);
+        }
+    }
+
+    void sincronizarJournal() {
+        if (journal != nullptr && eventosSinSincronizar > 0) {
+            Metricas& metricas = Metricas::global();
+            CronometroMetrica cronometro(metricas.latenciaSincronizar);
+            sincronizarArchivo(journal);
+            eventosSinSincronizar = 0;
+            metricas.sincronizacionesJournal.sumar();
+        }
+    }
+
+    // Agrega un evento al final del journal; recibe el pedido completo o solo su id
+    void registrarEvento(TipoEvento tipo, const Pedido* pedido, int id) {
+        if (!usarJournal) {
+            return;
+        }
+        if (journal == nullptr) {
+            abrirJournal(false);
+            if (journal == nullptr) {
+                return;
+            }
+        }
+
+        bufferEvento.clear();
+        EscritorBinario escritor(bufferEvento);
+        escritor.escribir<uint32_t>(0); // la longitud se completa al final
+        escritor.escribir<uint8_t>(static_cast<uint8_t>(tipo));
+        escritor.escribir<uint64_t>(++secuenciaJournal);
+        if (pedido != nullptr) {
+            escribirPedidoJournal(escritor, *pedido);
+        }
+        else {
+            escritor.escribir<int32_t>(id);
+        }
+
+        uint32_t longitud = static_cast<uint32_t>(bufferEvento.size() - sizeof(uint32_t));
+        memcpy(&bufferEvento[0], &longitud, sizeof(longitud));
+        escritor.escribir<uint64_t>(calcularChecksum(bufferEvento.data() + sizeof(uint32_t), longitud));
+        fwrite(bufferEvento.data(), 1, bufferEvento.size(), journal);
+        Metricas::global().eventosJournal.sumar();
+        Metricas::global().bytesJournal.sumar(bufferEvento.size());
+
+        eventosEnJournal++;
+        if (++eventosSinSincronizar >= EVENTOS_POR_SINCRONIZACION) {
+            sincronizarJournal();
+        }
+    }
+
+    // Pasa el journal a rutaJournalAnterior y empieza uno vacio. Si quedo uno
+    // anterior de un respaldo que fallo se sigue escribiendo en el actual: sus
+    // eventos viejos se saltean al cargar porque la secuencia ya esta en el respaldo.
+    void rotarJournal() {
+        if (journal != nullptr) {
+            sincronizarJournal();
+            fclose(journal);
+            journal = nullptr;
+        }
+        if (!ArchivoMapeado(rutaJournalAnterior).estaAbierto() && reemplazarArchivo(rutaJournal, rutaJournalAnterior)) {
+            eventosEnJournal = 0;
+        }
+        abrirJournal(false);
+    }
+
+    void aplicarEvento(TipoEvento tipo, LectorBinario& lector) {
+        if (tipo == TipoEvento::Alta || tipo == TipoEvento::AltaCentavos || tipo == TipoEvento::AltaAnterior ||
+            tipo == TipoEvento::AltaUrgente) {
+            bool enCentavos = (tipo == TipoEvento::Alta || tipo == TipoEvento::AltaCentavos);
+            optional<Pedido> pedido = leerPedidoJournal(lector, enCentavos, tipo != TipoEvento::Alta);
+            if (!pedido || existePedido(pedido->getId())) {
+                return;
+            }
+            if (tipo != TipoEvento::AltaUrgente) {
+                encolarPendiente(move(*pedido));
+            }
+            else {
+                apilarCompletado(move(*pedido));
+            }
+            return;
+        }
+
+        int32_t id;
+        if (!lector.leer(id)) {
+            return;
+        }
+        if (tipo == TipoEvento::Procesar) {
+            // Se procesa el pedido registrado, no el frente actual, por si el
+            // orden de la cola cambio entre versiones
+            completarPendiente(id);
+        }
+        else if (tipo == TipoEvento::Eliminar) {
+            quitarPedido(id);
+        }
+    }
+
+    // Aplica los eventos del journal con secuencia mayor a la del respaldo.
+    // colaIncompleta indica si al final quedo un registro cortado o danado.
+    size_t reproducirJournal(const string& ruta, uint64_t secuenciaRespaldo, bool& colaIncompleta) {
+        ArchivoMapeado archivo(ruta);
+        string_view contenido = archivo.contenido();
+        size_t posicion = 0;
+        size_t aplicados = 0;
+
+        while (contenido.size() - posicion >= sizeof(uint32_t)) {
+            uint32_t longitud;
+            memcpy(&longitud, contenido.data() + posicion, sizeof(longitud));
+            size_t tamanoRegistro = sizeof(uint32_t) + static_cast<size_t>(longitud) + sizeof(uint64_t);
+            if (longitud < sizeof(uint8_t) + sizeof(uint64_t) || contenido.size() - posicion < tamanoRegistro) {
+                break;
+            }
+
+            const char* registro = contenido.data() + posicion + sizeof(uint32_t);
+            uint64_t checksum;
+            memcpy(&checksum, registro + longitud, sizeof(checksum));
+            if (calcularChecksum(registro, longitud) != checksum) {
+                break;
+            }
+            posicion += tamanoRegistro;
+
+            LectorBinario lector(registro, registro + longitud);
+            uint8_t tipo = 0;
+            uint64_t secuencia = 0;
+            lector.leer(tipo);
+            lector.leer(secuencia);
+
+            secuenciaJournal = max(secuenciaJournal, secuencia);
+            eventosEnJournal++;
+            if (secuencia > secuenciaRespaldo) {
+                aplicarEvento(static_cast<TipoEvento>(tipo), lector);
+                aplicados++;
+            }
+        }
+
+        colaIncompleta = (posicion != contenido.size());
+        return aplicados;
+    }
+
+    bool hayJournal() const {
+        return !ArchivoMapeado(rutaJournal).contenido().empty() || !ArchivoMapeado(rutaJournalAnterior).contenido().empty();
+    }
+
+    DatosRespaldo datosRespaldo() const {
+        DatosRespaldo datos;
+        datos.secuencia = secuenciaJournal;
+        datos.cantidadProductos = CatalogoProductos::global().tamano();
+        datos.segmentos = archivo.numeros();
+        datos.eliminados = archivo.idsEliminados();
+        return datos;
+    }
+
+    // Escribe un respaldo con todo el estado actual y vacia el journal
+    bool compactar() {
+        esperarRespaldo();
+        purgarEliminados();
+        // El respaldo solo nombra segmentos que ya estan en disco
+        if (!archivo.esperarEscritura() || !escribirSnapshot(pedidosPendientes, pedidosCompletados, datosRespaldo(), hilosDisponibles())) {
+            return false;
+        }
+        archivo.borrarHuerfanos();
+        if (usarJournal) {
+            abrirJournal(true);
+            remove(rutaJournalAnterior.c_str());
+        }
+        eventosEnJournal = 0;
+        eventosSinSincronizar = 0;
+        cambiosDesdeRespaldo = 0;
+        instanteUltimoRespaldo = static_cast<int64_t>(time(nullptr));
+        Metricas::global().respaldosEscritos.sumar();
+        return true;
+    }
+
+    // Fija la foto del estado actual y se la pasa al hilo de respaldo. Aqui
+    // solo se copian los pendientes y los punteros; armar y escribir el archivo
+    // queda para el otro hilo. Devuelve false si ya habia un respaldo en curso
+    // o si el ultimo segmento archivado no se pudo escribir.
+    bool iniciarRespaldo() {
+        if (historialFijado()) {
+            return false;
+        }
+        if (!archivo.esperarEscritura()) {
+            ultimoRespaldoFallo = true;
+            Metricas::global().respaldosFallidos.sumar();
+            return false;
+        }
+
+        CronometroMetrica cronometro(Metricas::global().respaldoFoto);
+        for (const Pedido& pedido : pedidosPendientes) {
+            foto.pendientes.push_back(pedido);
+        }
+        foto.completados.resize(pedidosCompletados.size());
+        size_t ranura = 0, vivos = 0;
+        for (const Pedido& pedido : pedidosCompletados) {
+            foto.completados[vivos] = &pedido;
+            vivos += columnasCompletados.estaViva(ranura++);
+        }
+        foto.completados.resize(vivos);
+        foto.datos = datosRespaldo();
+        fotoFijada = true;
+        if (usarJournal) {
+            rotarJournal();
+        }
+        cambiosDesdeRespaldo = 0;
+        instanteUltimoRespaldo = static_cast<int64_t>(time(nullptr));
+
+        // Se deja un nucleo para el hilo que atiende
+        size_t hilos = max<size_t>(2, hilosDisponibles()) - 1;
+        hiloRespaldo.lanzar([this, hilos] { return escribirSnapshot(foto.pendientes, foto.completados, foto.datos, hilos); });
+        return true;
+    }
+
+    void terminarRespaldo() {
+        bool escrito = hiloRespaldo.recoger();
+        foto.pendientes.clear();
+        foto.completados.clear();
+        fotoFijada = false;
+        ultimoRespaldoFallo = !escrito;
+        if (!escrito) {
+            Metricas::global().respaldosFallidos.sumar();
+            return;
+        }
+        // Todo lo del journal anterior ya esta en el respaldo
+        if (usarJournal) {
+            remove(rutaJournalAnterior.c_str());
+        }
+        archivo.borrarHuerfanos();
+        Metricas::global().respaldosEscritos.sumar();
+    }
+
+    // Indica si hay un respaldo en segundo plano leyendo el historial; si ya
+    // termino lo da por cerrado sin esperar
+    bool historialFijado() {
+        if (fotoFijada && hiloRespaldo.terminado()) {
+            terminarRespaldo();
+        }
+        return fotoFijada;
+    }
+
+    // Cuenta un cambio ya aplicado y escribe el respaldo si toca: en segundo
+    // plano cada cambiosPorRespaldo cambios o segundosPorRespaldo segundos, y
+    // en cualquier modo cuando el journal pasa de EVENTOS_POR_COMPACTACION eventos
+    void respaldarSiHaceFalta() {
+        cambiosDesdeRespaldo++;
+        if (!respaldoAsincrono) {
+            if (eventosEnJournal >= EVENTOS_POR_COMPACTACION) {
+                compactar();
+            }
+            return;
+        }
+        if (historialFijado()) {
+            return;
+        }
+
+        bool toca = (cambiosPorRespaldo > 0 && cambiosDesdeRespaldo >= cambiosPorRespaldo) || eventosEnJournal >= EVENTOS_POR_COMPACTACION ||
+                    (segundosPorRespaldo > 0 && static_cast<int64_t>(time(nullptr)) - instanteUltimoRespaldo >= segundosPorRespaldo);
+        if (toca) {
+            archivarExcedente(false);
+            iniciarRespaldo();
+        }
+    }
+
+    // Agrega la linea de texto del pedido; se llama desde varios hilos a la vez
+    static void escribirPedidoTexto(string& destino, const Pedido& p) {
+        agregarNumero(destino, p.getId());
+        destino += '|';
+        destino += p.getNombreCliente();
+        destino += '|';
+
+        // Guardar productos
+        const LineasPedido& productos = p.getProductos();
+        agregarNumero(destino, static_cast<int64_t>(productos.size()));
+        destino += '|';
+        for (const Producto& prod : productos) {
+            destino += prod.getNombre();
+            destino += ',';
+            agregarDinero(destino, prod.getPrecio());
+            destino += '|';
+        }
+
+        agregarDinero(destino, p.getTotal());
+        destino += '|';
+        agregarFechaHora(destino, p.getInstante());
+        destino += '|';
+        destino += p.esUrgente() ? '1' : '0';
+        destino += '\n';
+    }
+
+    static const Pedido* direccionDe(const Pedido& p) {
+        return &p;
+    }
+
+    static const Pedido* direccionDe(const Pedido* p) {
+        return p;
+    }
+
+    // Arma en paralelo los bloques de PEDIDOS_POR_TRAMO pedidos con escribirPedido(destino, pedido)
+    // y se los pasa en orden a alTerminarTramo(bloque). Acepta pedidos o punteros a pedidos.
+    template <typename Contenedor, typename Escribir, typename AlTerminar>
+    static void formatearEnParalelo(const Contenedor& pedidos, Escribir escribirPedido, AlTerminar alTerminarTramo,
+                                    size_t hilos = hilosDisponibles()) {
+        const size_t PEDIDOS_POR_TRAMO = 1 << 14;
+        vector<const Pedido*> lista;
+        lista.reserve(pedidos.size());
+        for (const auto& p : pedidos) {
+            lista.push_back(direccionDe(p));
+        }
+
+        size_t cantidadTramos = (lista.size() + PEDIDOS_POR_TRAMO - 1) / PEDIDOS_POR_TRAMO;
+        procesarTramosEnOrden<string>(cantidadTramos, hilos,
+            [&](size_t tramo) {
+                string bloque;
+                size_t fin = min(lista.size(), (tramo + 1) * PEDIDOS_POR_TRAMO);
+                for (size_t i = tramo * PEDIDOS_POR_TRAMO; i < fin; i++) {
+                    escribirPedido(bloque, *lista[i]);
+                }
+                return bloque;
+            },
+            [&](size_t, string&& bloque) { alTerminarTramo(bloque); });
+    }
+
+    static void escribirPedidoBinario(EscritorBinario& escritor, const Pedido& p) {
+        escritor.escribir<int32_t>(p.getId());
+        escritor.escribir<uint8_t>(p.esUrgente() ? 1 : 0);
+        escritor.escribirTexto(p.getNombreCliente());
+        escritor.escribir<int64_t>(p.getInstante());
+        escribirMonto(escritor, p.getTotal());
+
+        const LineasPedido& productos = p.getProductos();
+        escritor.escribir<uint16_t>(static_cast<uint16_t>(productos.size()));
+        for (const Producto& prod : productos) {
+            escritor.escribir<uint16_t>(prod.getIdProducto());
+            escribirMonto(escritor, prod.getPrecio());
+        }
+    }
+
+    // Se llama tambien desde el hilo de respaldo: solo lee los pedidos que
+    // recibe, datos y el catalogo (que se puede leer desde cualquier hilo)
+    template <typename Pendientes, typename Completados>
+    bool escribirSnapshot(const Pendientes& pendientes, const Completados& completados, const DatosRespaldo& datosRespaldo,
+                          size_t hilos) const {
+        CronometroMetrica formato;
+
+        // Se escribe a un archivo temporal y se reemplaza al final para no dejar
+        // nunca un respaldo a medias. El encabezado lleva el tamano y el checksum
+        // de los datos: se deja su lugar y se completa al final, asi cada bloque
+        // va al archivo apenas se arma y el respaldo no se junta entero en memoria.
+        string rutaTemporal = rutaSnapshot + ".tmp";
+        FILE* archivo = fopen(rutaTemporal.c_str(), "wb");
+        if (archivo == nullptr) {
+            return false;
+        }
+        string encabezado(TAMANO_ENCABEZADO_SNAPSHOT, '\0');
+        bool escrito = fwrite(encabezado.data(), 1, encabezado.size(), archivo) == encabezado.size();
+        ChecksumIncremental checksum;
+        uint64_t tamanoDatos = 0;
+        auto escribirDatos = [&](const string& bloque) {
+            escrito = escrito && fwrite(bloque.data(), 1, bloque.size(), archivo) == bloque.size();
+            checksum.agregar(bloque.data(), bloque.size());
+            tamanoDatos += bloque.size();
+        };
+
+        // La tabla de productos es el catalogo completo, asi cada linea guarda el id tal cual
+        const CatalogoProductos& catalogo = CatalogoProductos::global();
+        size_t cantidadProductos = datosRespaldo.cantidadProductos;
+        string datos;
+        EscritorBinario escritor(datos);
+        for (size_t id = 0; id < cantidadProductos; id++) {
+            escritor.escribirTexto(catalogo.nombre(static_cast<uint16_t>(id)));
+            escribirMonto(escritor, catalogo.precio(static_cast<uint16_t>(id)));
+        }
+        escribirDatos(datos);
+
+        auto escribirPedido = [](string& bloque, const Pedido& p) {
+            EscritorBinario escritorBloque(bloque);
+            escribirPedidoBinario(escritorBloque, p);
+        };
+        try {
+            formatearEnParalelo(pendientes, escribirPedido, escribirDatos, hilos);
+            formatearEnParalelo(completados, escribirPedido, escribirDatos, hilos);
+        }
+        catch (const exception&) {
+            // Un hilo que armaba bloques fallo (por ejemplo, sin memoria)
+            fclose(archivo);
+            remove(rutaTemporal.c_str());
+            return false;
+        }
+
+        datos.clear();
+        escritor.escribir<uint32_t>(static_cast<uint32_t>(datosRespaldo.segmentos.size()));
+        for (uint32_t numero : datosRespaldo.segmentos) {
+            escritor.escribir<uint32_t>(numero);
+        }
+        escritor.escribir<uint32_t>(static_cast<uint32_t>(datosRespaldo.eliminados.size()));
+        for (const auto& eliminado : datosRespaldo.eliminados) {
+            escritor.escribir<uint32_t>(eliminado.first);
+            escritor.escribir<int32_t>(eliminado.second);
+        }
+        escribirDatos(datos);
+
+        encabezado.clear();
+        EscritorBinario escritorEncabezado(encabezado);
+        encabezado.append(MAGICO_SNAPSHOT, sizeof(MAGICO_SNAPSHOT));
+        escritorEncabezado.escribir<uint16_t>(VERSION_SNAPSHOT);
+        escritorEncabezado.escribir<uint16_t>(0);
+        escritorEncabezado.escribir<uint32_t>(static_cast<uint32_t>(cantidadProductos));
+        escritorEncabezado.escribir<uint64_t>(pendientes.size());
+        escritorEncabezado.escribir<uint64_t>(completados.size());
+        escritorEncabezado.escribir<uint64_t>(datosRespaldo.secuencia);
+        escritorEncabezado.escribir<uint64_t>(tamanoDatos);
+        escritorEncabezado.escribir<uint64_t>(checksum.valor());
+        escrito = escrito && fseek(archivo, 0, SEEK_SET) == 0 &&
+                  fwrite(encabezado.data(), 1, encabezado.size(), archivo) == encabezado.size();
+        Metricas::global().respaldoFormato.registrar(formato.transcurrido());
+
+        CronometroMetrica escritura(Metricas::global().respaldoEscritura);
+        sincronizarArchivo(archivo);
+        fclose(archivo);
+
+        if (!escrito || !reemplazarArchivo(rutaTemporal, rutaSnapshot)) {
+            remove(rutaTemporal.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    struct EncabezadoSnapshot {
+        uint16_t version = 0;
+        uint32_t cantidadProductos = 0;
+        uint64_t cantidadPendientes = 0;
+        uint64_t cantidadCompletados = 0;
+        uint64_t secuencia = 0;
+        uint64_t tamanoDatos = 0;
+        uint64_t checksum = 0;
+        size_t tamano = 0;  // bytes del encabezado, que dependen de la version
+    };
+
+    // Valida el encabezado contra el tamano del archivo; el checksum lo revisa
+    // quien recorre los datos
+    static bool leerEncabezadoSnapshot(string_view contenido, EncabezadoSnapshot& encabezado) {
+        if (contenido.size() < TAMANO_ENCABEZADO_SNAPSHOT_V1) {
+            return false;
+        }
+
+        LectorBinario lector(contenido.data() + sizeof(MAGICO_SNAPSHOT), contenido.data() + contenido.size());
+        uint16_t reservado = 0;
+        lector.leer(encabezado.version);
+        lector.leer(reservado);
+        lector.leer(encabezado.cantidadProductos);
+        lector.leer(encabezado.cantidadPendientes);
+        lector.leer(encabezado.cantidadCompletados);
+        if (encabezado.version >= 2) {
+            lector.leer(encabezado.secuencia);
+        }
+        lector.leer(encabezado.tamanoDatos);
+        lector.leer(encabezado.checksum);
+
+        encabezado.tamano = (encabezado.version >= 2) ? TAMANO_ENCABEZADO_SNAPSHOT : TAMANO_ENCABEZADO_SNAPSHOT_V1;
+        return memcmp(contenido.data(), MAGICO_SNAPSHOT, sizeof(MAGICO_SNAPSHOT)) == 0 && encabezado.version >= 1 &&
+               encabezado.version <= VERSION_SNAPSHOT && contenido.size() >= encabezado.tamano &&
+               encabezado.tamanoDatos == contenido.size() - encabezado.tamano;
+    }
+
+    // Lo que va despues de los pedidos desde la version 5: segmentos archivados
+    // y pedidos eliminados de ellos
+    static bool leerArchivadosSnapshot(LectorBinario& lector, uint16_t version, vector<uint32_t>* segmentos,
+                                       vector<pair<uint32_t, int>>* eliminados) {
+        if (version < 5) {
+            return true;
+        }
+
+        uint32_t cantidadSegmentos, cantidadEliminados;
+        if (!lector.leer(cantidadSegmentos)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < cantidadSegmentos; i++) {
+            uint32_t numero;
+            if (!lector.leer(numero)) {
+                return false;
+            }
+            if (segmentos != nullptr) {
+                segmentos->push_back(numero);
+            }
+        }
+        if (!lector.leer(cantidadEliminados)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < cantidadEliminados; i++) {
+            uint32_t numero;
+            int32_t id;
+            if (!lector.leer(numero) || !lector.leer(id)) {
+                return false;
+            }
+            if (eliminados != nullptr) {
+                eliminados->emplace_back(numero, id);
+            }
+        }
+        return true;
+    }
+
+    // Recorre el respaldo mapeado una sola vez y entrega a alFila(fila) los
+    // pedidos que pasan el filtro sin armarlos: urgencia, fecha y cliente se
+    // revisan antes de las lineas, que se saltan de un golpe si el pedido no
+    // pasa. El checksum se calcula por partes mientras se avanza, asi que un
+    // archivo danado se detecta al final: quien llama descarta lo entregado.
+    template <typename Funcion>
+    bool filtrarSnapshot(const FiltroExportacion& filtro, vector<uint32_t>& segmentos, vector<pair<uint32_t, int>>& eliminados,
+                         Funcion alFila) const {
+        ArchivoMapeado archivo(rutaSnapshot);
+        EncabezadoSnapshot encabezado;
+        if (!archivo.estaAbierto() || !leerEncabezadoSnapshot(archivo.contenido(), encabezado)) {
+            return false;
+        }
+
+        const char* datos = archivo.contenido().data() + encabezado.tamano;
+        LectorBinario lector(datos, datos + encabezado.tamanoDatos);
+        bool enCentavos = (encabezado.version >= 3);
+        bool fechaComoTexto = (encabezado.version < 4);
+        // Indice (u16) y precio, que ocupa 8 bytes en centavos y en f64
+        const size_t BYTES_POR_LINEA = sizeof(uint16_t) + sizeof(int64_t);
+        const size_t BYTES_POR_VERIFICACION = 1 << 20;
+
+        if (encabezado.cantidadProductos > lector.restante()) {
+            return false;
+        }
+        vector<string_view> nombres(encabezado.cantidadProductos);
+        vector<uint8_t> esProductoBuscado(encabezado.cantidadProductos);
+        for (uint32_t i = 0; i < encabezado.cantidadProductos; i++) {
+            Dinero precioCatalogo;
+            if (!lector.leerTexto(nombres[i]) || !leerMonto(lector, enCentavos, precioCatalogo)) {
+                return false;
+            }
+            esProductoBuscado[i] = (nombres[i] == filtro.producto);
+        }
+
+        ChecksumIncremental checksum;
+        const char* verificado = datos;
+        FilaExportada fila;
+        uint64_t totalPedidos = encabezado.cantidadPendientes + encabezado.cantidadCompletados;
+        for (uint64_t n = 0; n < totalPedidos; n++) {
+            uint8_t urgente;
+            uint16_t numProductos;
+            if (!lector.leer(fila.id) || !lector.leer(urgente) || !lector.leerTexto(fila.cliente) ||
+                !leerInstante(lector, fechaComoTexto, fila.instante) || !leerMonto(lector, enCentavos, fila.total) ||
+                !lector.leer(numProductos)) {
+                return false;
+            }
+
+            fila.urgente = (urgente != 0);
+            if (!filtro.admiteUrgencia(fila.urgente) || !filtro.admiteInstante(fila.instante) || !filtro.admiteCliente(fila.cliente)) {
+                if (!lector.saltar(numProductos * BYTES_POR_LINEA)) {
+                    return false;
+                }
+            }
+            else {
+                fila.productos.clear();
+                bool tieneProducto = filtro.producto.empty();
+                for (uint16_t i = 0; i < numProductos; i++) {
+                    uint16_t indice;
+                    Dinero precio;
+                    if (!lector.leer(indice) || !leerMonto(lector, enCentavos, precio) || indice >= nombres.size()) {
+                        return false;
+                    }
+                    fila.productos.emplace_back(nombres[indice], precio);
+                    tieneProducto = tieneProducto || esProductoBuscado[indice];
+                }
+                if (tieneProducto) {
+                    fila.pendiente = (n < encabezado.cantidadPendientes);
+                    alFila(static_cast<const FilaExportada&>(fila));
+                }
+            }
+
+            if (static_cast<size_t>(lector.posicion() - verificado) >= BYTES_POR_VERIFICACION) {
+                checksum.agregar(verificado, static_cast<size_t>(lector.posicion() - verificado));
+                verificado = lector.posicion();
+            }
+        }
+
+        if (!leerArchivadosSnapshot(lector, encabezado.version, &segmentos, &eliminados) || !lector.terminado()) {
+            return false;
+        }
+        checksum.agregar(verificado, static_cast<size_t>(lector.posicion() - verificado));
+        return checksum.valor() == encabezado.checksum;
+    }
+
+    // Escribe la exportacion en ruta ("-" es la salida estandar) con
+    // escribirFilas(escritor, segmentosSaltados), que devuelve como salio la
+    // lectura. Un archivo se escribe aparte y reemplaza al destino solo si todo
+    // salio bien.
+    template <typename Funcion>
+    static ResultadoExportacion exportarA(const string& ruta, FormatoExportacion formato, Funcion escribirFilas) {
+        CronometroMetrica cronometro(Metricas::global().latenciaExportar);
+        ResultadoExportacion resultado;
+        bool salidaEstandar = (ruta == "-");
+        string rutaTemporal = ruta + ".tmp";
+        FILE* destino = salidaEstandar ? stdout : fopen(rutaTemporal.c_str(), "wb");
+        if (destino == nullptr) {
+            resultado.estado = EstadoExportacion::ErrorEscritura;
+            return resultado;
+        }
+
+        EscritorExportacion escritor(destino, formato);
+        resultado.estado = escribirFilas(escritor, resultado.segmentosSaltados);
+        if (!escritor.terminar() && resultado.estado == EstadoExportacion::Correcta) {
+            resultado.estado = EstadoExportacion::ErrorEscritura;
+        }
+        resultado.filas = escritor.cantidadFilas();
+        resultado.bytes = escritor.bytesEscritos();
+
+        if (!salidaEstandar) {
+            bool cerrado = (fclose(destino) == 0);
+            if (resultado.estado == EstadoExportacion::Correcta && (!cerrado || !reemplazarArchivo(rutaTemporal, ruta))) {
+                resultado.estado = EstadoExportacion::ErrorEscritura;
+            }
+            if (resultado.estado != EstadoExportacion::Correcta) {
+                remove(rutaTemporal.c_str());
+            }
+        }
+        Metricas::global().filasExportadas.sumar(resultado.filas);
+        return resultado;
+    }
+
+    // Lee el respaldo binario completo, verifica el checksum y entrega cada pedido
+    // a alLeerPedido(estado, pedido). Deja en segmentos y eliminados lo que el
+    // respaldo dice del historial archivado. Devuelve false si el archivo no es valido.
+    template <typename Funcion>
+    bool leerSnapshot(Funcion alLeerPedido, uint64_t* secuencia = nullptr, vector<uint32_t>* segmentos = nullptr,
+                      vector<pair<uint32_t, int>>* eliminados = nullptr) const {
+        CronometroMetrica lectura;
+        ifstream archivo(rutaSnapshot, ios::binary | ios::ate);
+        if (!archivo.is_open()) {
+            return false;
+        }
+
+        streamoff tamanoArchivo = archivo.tellg();
+        if (tamanoArchivo < static_cast<streamoff>(TAMANO_ENCABEZADO_SNAPSHOT_V1)) {
+            return false;
+        }
+
+        string contenido(static_cast<size_t>(tamanoArchivo), '\0');
+        archivo.seekg(0);
+        if (!archivo.read(&contenido[0], tamanoArchivo)) {
+            return false;
+        }
+        lecturaEnCarga += lectura.transcurrido();
+
+        EncabezadoSnapshot encabezado;
+        if (!leerEncabezadoSnapshot(contenido, encabezado)) {
+            return false;
+        }
+        uint32_t cantidadProductos = encabezado.cantidadProductos;
+        uint64_t cantidadPendientes = encabezado.cantidadPendientes;
+        uint64_t tamanoDatos = encabezado.tamanoDatos;
+
+        const char* datos = contenido.data() + encabezado.tamano;
+        if (calcularChecksum(datos, tamanoDatos) != encabezado.checksum) {
+            return false;
+        }
+        if (secuencia != nullptr) {
+            *secuencia = encabezado.secuencia;
+        }
+
+        LectorBinario lector(datos, datos + tamanoDatos);
+        bool enCentavos = (encabezado.version >= 3);
+        bool fechaComoTexto = (encabezado.version < 4);
+        // Traducir los ids de la tabla del archivo a ids del catalogo actual
+        if (cantidadProductos > lector.restante()) {
+            return false;
+        }
+        vector<uint16_t> idsCatalogo(cantidadProductos);
+        for (uint32_t i = 0; i < cantidadProductos; i++) {
+            string nombre;
+            Dinero precioCatalogo;
+            if (!lector.leerTexto(nombre) || !leerMonto(lector, enCentavos, precioCatalogo)) {
+                return false;
+            }
+            idsCatalogo[i] = CatalogoProductos::global().registrar(nombre, precioCatalogo);
+        }
+
+        uint64_t totalPedidos = cantidadPendientes + encabezado.cantidadCompletados;
+        for (uint64_t n = 0; n < totalPedidos; n++) {
+            int32_t id;
+            uint8_t urgente;
+            string nombreCliente;
+            int64_t instante;
+            Dinero total;
+            uint16_t numProductos;
+
+            if (!lector.leer(id) || !lector.leer(urgente) || !lector.leerTexto(nombreCliente) ||
+                !leerInstante(lector, fechaComoTexto, instante) || !leerMonto(lector, enCentavos, total) || !lector.leer(numProductos) ||
+                numProductos > lector.restante()) {
+                return false;
+            }
+
+            LineasPedido productos;
+            productos.reserve(numProductos);
+            for (uint16_t i = 0; i < numProductos; i++) {
+                uint16_t indice;
+                Dinero precio;
+                if (!lector.leer(indice) || !leerMonto(lector, enCentavos, precio) || indice >= idsCatalogo.size()) {
+                    return false;
+                }
+                productos.push_back(Producto(idsCatalogo[indice], precio));
+            }
+
+            EstadoPedido estado = (n < cantidadPendientes) ? EstadoPedido::Pendiente : EstadoPedido::Completado;
+            alLeerPedido(estado, Pedido(id, move(nombreCliente), move(productos), total, instante, urgente != 0));
+        }
+
+        return leerArchivadosSnapshot(lector, encabezado.version, segmentos, eliminados) && lector.terminado();
+    }
+
+    bool leerSnapshot(vector<Pedido>& pendientes, vector<Pedido>& completados) const {
+        return leerSnapshot([&](EstadoPedido estado, Pedido&& pedido) {
+            if (estado == EstadoPedido::Pendiente) {
+                pendientes.push_back(move(pedido));
+            }
+            else {
+                completados.push_back(move(pedido));
+            }
+        });
+    }
+
+    void mostrarListaGuardada(const vector<Pedido>& pedidos, const string& mensajeVacio) const {
+        if (pedidos.empty()) {
+            cout << mensajeVacio;
+            return;
+        }
+
+        SalidaBuffer salida(cout);
+        for (size_t i = 0; i < pedidos.size(); i++) {
+            salida.pedidoNumerado(i + 1, pedidos[i]);
+        }
+    }
+
+    void limpiarPedidos() {
+        pedidosPendientes.clear();
+        pedidosCompletados.clear();
+        indicePedidos.clear();
+        pedidosPorCliente.clear();
+        reiniciarReporte();
+        archivo.clear();
+    }
+
+public:
+    // prefijoArchivos permite usar otra carpeta u otros nombres para los archivos de datos.
+    // Con _usarJournal en false los cambios solo se guardan al llamar a guardarPedidos.
+    GestorPedidos(const string& prefijoArchivos = "", bool _usarJournal = true)
+        : pedidosCompletados(HistorialEnMemoria::allocator_type(&poolHistorial)),
+          indicePedidos(0, hash<int>(), equal_to<int>(), IndicePedidos::allocator_type(&poolIndice)),
+          archivo(prefijoArchivos),
+          rutaSnapshot(prefijoArchivos + "pedidos.dat"),
+          rutaJournal(prefijoArchivos + "pedidos.journal"),
+          rutaPendientes(prefijoArchivos + "pedidos_pendientes.txt"),
+          rutaCompletados(prefijoArchivos + "pedidos_completados.txt"),
+          usarJournal(_usarJournal),
+          rutaJournalAnterior(prefijoArchivos + "pedidos.journal.anterior") {
+        reiniciarReporte();
+    }
+
+    ~GestorPedidos() {
+        publicarTamanos(true);
+        esperarRespaldo();
+        if (journal != nullptr) {
+            sincronizarJournal();
+            fclose(journal);
+        }
+    }
+
+    GestorPedidos(const GestorPedidos&) = delete;
+    GestorPedidos& operator=(const GestorPedidos&) = delete;
+
+    // Indica si hay un respaldo, un journal o archivos de texto que se puedan cargar
+    bool hayDatosGuardados() const {
+        return esArchivoSnapshot(rutaSnapshot) || hayJournal() ||
+               (ArchivoMapeado(rutaPendientes).estaAbierto() && ArchivoMapeado(rutaCompletados).estaAbierto());
+    }
+
+    size_t cantidadPendientes() const {
+        return pedidosPendientes.size();
+    }
+
+    // Limites del historial en memoria (0 es sin limite); lo que sobra se archiva
+    // al procesar, guardar y cargar
+    void configurarHistorial(size_t maximoPedidos, int64_t edadMaximaSegundos) {
+        maximoEnMemoria = maximoPedidos;
+        edadMaximaEnMemoria = edadMaximaSegundos;
+        archivoConError = false;
+        archivarExcedente(false);
+    }
+
+    // Con asincrono, guardarPedidos y el respaldo automatico se escriben en un
+    // hilo aparte mientras se sigue atendiendo. El automatico se hace cada
+    // `cambios` cambios o cada `segundos` segundos si hubo cambios (0 desactiva
+    // cada criterio); el journal igual se resume a los EVENTOS_POR_COMPACTACION eventos.
+    void configurarRespaldo(bool asincrono, size_t cambios, int64_t segundos) {
+        respaldoAsincrono = asincrono;
+        cambiosPorRespaldo = cambios;
+        segundosPorRespaldo = segundos;
+        instanteUltimoRespaldo = static_cast<int64_t>(time(nullptr));
+    }
+
+    // Empieza un respaldo en segundo plano. Devuelve false si ya hay uno en curso.
+    bool guardarEnSegundoPlano() {
+        archivarExcedente(true);
+        return iniciarRespaldo();
+    }
+
+    // Espera el respaldo en segundo plano si hay uno. Devuelve false si el
+    // ultimo no se pudo escribir.
+    bool esperarRespaldo() {
+        if (fotoFijada) {
+            terminarRespaldo();
+        }
+        return !ultimoRespaldoFallo;
+    }
+
+    bool respaldoEnCurso() {
+        return historialFijado();
+    }
+
+    // Incluye los archivados
+    size_t cantidadCompletados() const {
+        return completadosEnMemoria() + archivo.cantidad();
+    }
+
+    size_t cantidadArchivados() const {
+        return archivo.cantidad();
+    }
+
+    const HistorialArchivado& historialArchivado() const {
+        return archivo;
+    }
+
+    // Pedido que se procesaria a continuacion o nullptr si la cola esta vacia
+    const Pedido* siguientePendiente() const {
+        return pedidosPendientes.empty() ? nullptr : &pedidosPendientes.frente();
+    }
+
+    // Registra un pedido ya armado en la cola; los urgentes se atienden antes.
+    // Devuelve false si ya existe un pedido con el mismo ID o si tiene mas de
+    // MAXIMO_LINEAS_PEDIDO lineas.
+    bool registrarPedido(Pedido pedido) {
+        Metricas& metricas = Metricas::global();
+        CronometroMetrica cronometro(metricas.latenciaRegistrar, MUESTREO_RUTA_CALIENTE);
+        if (existePedido(pedido.getId()) || pedido.getProductos().size() > MAXIMO_LINEAS_PEDIDO) {
+            metricas.pedidosRechazados.sumar();
+            return false;
+        }
+
+        registrarEvento(TipoEvento::Alta, &pedido, pedido.getId());
+        encolarPendiente(move(pedido));
+        respaldarSiHaceFalta();
+        metricas.pedidosRegistrados.sumar();
+        if (cronometro.activo()) {
+            publicarTamanos();
+        }
+        return true;
+    }
+
+    // Mueve el siguiente pedido pendiente al historial
+    bool procesarSiguiente() {
+        if (pedidosPendientes.empty()) {
+            return false;
+        }
+
+        Metricas& metricas = Metricas::global();
+        CronometroMetrica cronometro(metricas.latenciaProcesar, MUESTREO_RUTA_CALIENTE);
+        if (cronometro.activo()) {
+            int64_t espera = static_cast<int64_t>(time(nullptr)) - pedidosPendientes.frente().getInstante();
+            metricas.esperaEnCola.registrar(espera > 0 ? static_cast<uint64_t>(espera) * 1000000000 : 0);
+        }
+
+        registrarEvento(TipoEvento::Procesar, nullptr, pedidosPendientes.frente().getId());
+        completarSiguiente();
+        archivarExcedente(false);
+        respaldarSiHaceFalta();
+        metricas.pedidosProcesados.sumar();
+        if (cronometro.activo()) {
+            publicarTamanos();
+        }
+        return true;
+    }
+
+    // Elimina un pedido pendiente o completado. Devuelve false si no existe.
+    bool eliminarPedidoPorId(int id) {
+        Metricas& metricas = Metricas::global();
+        CronometroMetrica cronometro(metricas.latenciaEliminar, MUESTREO_RUTA_CALIENTE);
+        if (!existePedido(id)) {
+            return false;
+        }
+
+        registrarEvento(TipoEvento::Eliminar, nullptr, id);
+        quitarPedido(id);
+        respaldarSiHaceFalta();
+        metricas.pedidosEliminados.sumar();
+        if (cronometro.activo()) {
+            publicarTamanos();
+        }
+        return true;
+    }
+
+    bool existePedido(int id) const {
+        return indicePedidos.count(id) > 0 || archivo.contiene(id);
+    }
+
+    // Lee del disco un pedido que ya no esta en memoria
+    optional<Pedido> buscarArchivado(int id) const {
+        return archivo.buscar(id);
+    }
+
+    // Devuelve el pedido con ese ID o nullptr si no existe
+    const Pedido* obtenerPedido(int id, EstadoPedido* estado = nullptr) const {
+        auto it = indicePedidos.find(id);
+        if (it == indicePedidos.end()) {
+            return nullptr;
+        }
+
+        const UbicacionPedido& ubicacion = it->second;
+        if (estado != nullptr) {
+            *estado = ubicacion.estado;
+        }
+
+        if (ubicacion.estado == EstadoPedido::Pendiente) {
+            return pedidosPendientes.buscar(id);
+        }
+        return &pedidosCompletados[ubicacion.ranura];
+    }
+
+    void mostrarCatalogo() {
+        const CatalogoProductos& catalogo = CatalogoProductos::global();
+        cout << "\n--- Menu de productos ---\n";
+        for (uint16_t id = 0; id < catalogo.tamanoMenu(); id++) {
+            cout << (id + 1) << ". " << catalogo.nombre(id) << " - Q" << catalogo.precio(id) << endl;
+        }
+    }
+
+    LineasPedido seleccionarProductos() {
+        LineasPedido productosSeleccionados;
+        char continuar;
+
+        do {
+            mostrarCatalogo();
+
+            const CatalogoProductos& catalogo = CatalogoProductos::global();
+            int opcion;
+            cout << "\nSeleccione un producto (1-" << catalogo.tamanoMenu() << "): ";
+            cin >> opcion;
+
+            if (opcion < 1 || opcion > static_cast<int>(catalogo.tamanoMenu())) {
+                cout << "Opcion invalida. Intente de nuevo.\n";
+                continue;
+            }
+
+            // La opcion del menu es el id del producto mas uno
+            uint16_t id = static_cast<uint16_t>(opcion - 1);
+            productosSeleccionados.push_back(Producto(id, catalogo.precio(id)));
+            cout << "Producto anadido: " << catalogo.nombre(id) << " - Q" << catalogo.precio(id) << endl;
+
+            if (productosSeleccionados.size() == MAXIMO_LINEAS_PEDIDO) {
+                cout << "El pedido ya tiene el maximo de productos.\n";
+                break;
+            }
+            cout << "Desea agregar otro producto? (s/n): ";
+            cin >> continuar;
+        } while (continuar == 's' || continuar == 'S');
+
+        return productosSeleccionados;
+    }
+
+    void agregarPedido() {
+        cin.ignore();
+        string nombreCliente;
+        cout << "\nNombre del cliente: ";
+        getline(cin, nombreCliente);
+        if (!nombreClienteValido(nombreCliente)) {
+            cout << "\nEl nombre del cliente no puede contener '|' ni saltos de linea. Operacion cancelada.\n";
+            return;
+        }
+
+        // Permitir que el usuario especifique el ID
+        int id;
+        cout << "ID del pedido: ";
+        cin >> id;
+
+        if (existePedido(id)) {
+            cout << "\nYa existe un pedido con el ID " << id << ". Operacion cancelada.\n";
+            return;
+        }
+
+        LineasPedido productos = seleccionarProductos();
+
+        char opcionUrgente;
+        cout << "Es un pedido urgente? (s/n): ";
+        cin >> opcionUrgente;
+        bool esUrgente = (opcionUrgente == 's' || opcionUrgente == 'S');
+
+        // Se rechaza si el id ya existe o si tiene mas de MAXIMO_LINEAS_PEDIDO lineas
+        if (!registrarPedido(Pedido(id, nombreCliente, move(productos), esUrgente))) {
+            cout << "\nNo se pudo registrar el pedido " << id << " (ID repetido o mas de " << MAXIMO_LINEAS_PEDIDO
+                 << " productos). Operacion cancelada.\n";
+            return;
+        }
+
+        if (esUrgente) {
+            // Si es urgente, se atiende antes que los pedidos normales
+            cout << "\nPedido URGENTE registrado con prioridad en la cola.\n";
+        }
+        else {
+            cout << "\nPedido registrado correctamente.\n";
+        }
+        cout << "Detalle del pedido:\n" << obtenerPedido(id)->detalleCompleto() << endl;
+    }
+
+    void procesarPedido() {
+        if (pedidosPendientes.empty()) {
+            cout << "\nNo hay pedidos pendientes para procesar.\n";
+            return;
+        }
+
+        cout << "\nProcesando pedido:\n" << pedidosPendientes.frente().detalleCompleto() << endl;
+
+        procesarSiguiente();
+
+        cout << "Pedido completado y movido al historial.\n";
+    }
+
+    void mostrarPedidosPendientes() {
+        if (pedidosPendientes.empty()) {
+            cout << "\nNo hay pedidos pendientes.\n";
+            return;
+        }
+
+        cout << "\n--- PEDIDOS PENDIENTES ---\n";
+
+        SalidaBuffer salida(cout);
+        size_t contador = 1;
+
+        for (const Pedido& pedido : pedidosPendientes) {
+            salida.pedidoNumerado(contador, pedido);
+            contador++;
+        }
+    }
+
+    void mostrarPedidosCompletados() {
+        if (cantidadCompletados() == 0) {
+            cout << "\nNo hay pedidos completados en el historial.\n";
+            return;
+        }
+
+        cout << "\n--- HISTORIAL DE PEDIDOS COMPLETADOS ---\n";
+
+        // Recorrer de la cima hacia abajo para mostrar de más reciente a más antiguo
+        SalidaBuffer salida(cout);
+        size_t contador = 1;
+
+        for (size_t ranura = pedidosCompletados.size(); ranura-- > 0;) {
+            if (columnasCompletados.estaViva(ranura)) {
+                salida.pedidoNumerado(contador, pedidosCompletados[ranura]);
+                contador++;
+            }
+        }
+
+        if (archivo.cantidad() > 0) {
+            salida.texto("Hay ").numero(static_cast<int64_t>(archivo.cantidad())).texto(" pedido(s) mas antiguos archivados en ")
+                  .numero(static_cast<int64_t>(archivo.getSegmentos().size())).texto(" segmento(s); se pueden buscar por ID.\n");
+        }
+    }
+
+    void buscarPedidoPorId() {
+        int idBuscado;
+        cout << "\nIngrese el ID del pedido a buscar: ";
+        cin >> idBuscado;
+
+        EstadoPedido estado;
+        const Pedido* pedido = obtenerPedido(idBuscado, &estado);
+
+        if (pedido == nullptr) {
+            optional<Pedido> archivado = buscarArchivado(idBuscado);
+            if (archivado) {
+                cout << "\nPedido encontrado (completado, archivado):\n" << archivado->detalleCompleto() << endl;
+                return;
+            }
+            cout << "\nNo se encontro ningún pedido con el ID " << idBuscado << ".\n";
+            return;
+        }
+
+        if (estado == EstadoPedido::Completado) {
+            cout << "\nPedido encontrado (completado):\n" << pedido->detalleCompleto() << endl;
+        }
+        else {
+            cout << "\nPedido encontrado (pendiente):\n" << pedido->detalleCompleto() << endl;
+        }
+    }
+
+    // Busca por nombre exacto; si no hay, muestra los clientes que empiezan con el texto
+    void buscarPedidosPorCliente() {
+        cin.ignore();
+        string nombre;
+        cout << "\nNombre del cliente (o el inicio del nombre): ";
+        getline(cin, nombre);
+
+        uint32_t idCliente;
+        if (!RegistroClientes::global().buscar(nombre, idCliente) || cantidadPedidosDeCliente(idCliente) == 0) {
+            vector<uint32_t> coincidencias = buscarClientesPorPrefijo(nombre);
+            if (coincidencias.empty()) {
+                cout << "\nNo se encontraron pedidos de clientes que empiecen con \"" << nombre << "\".\n";
+                return;
+            }
+            if (coincidencias.size() > 1) {
+                const size_t CLIENTES_EN_LISTA = 20;
+                cout << "\nClientes encontrados:\n";
+                for (size_t i = 0; i < coincidencias.size() && i < CLIENTES_EN_LISTA; i++) {
+                    cout << "  - " << RegistroClientes::global().nombre(coincidencias[i]) << " ("
+                         << cantidadPedidosDeCliente(coincidencias[i]) << " pedido(s))" << endl;
+                }
+                if (coincidencias.size() > CLIENTES_EN_LISTA) {
+                    cout << "  ... y " << (coincidencias.size() - CLIENTES_EN_LISTA) << " mas\n";
+                }
+                return;
+            }
+            idCliente = coincidencias[0];
+        }
+
+        // Del mas reciente al mas antiguo
+        vector<pair<const Pedido*, EstadoPedido>> pedidos;
+        recorrerPedidosDeCliente(idCliente, [&](const Pedido& pedido, EstadoPedido estado) {
+            pedidos.push_back({ &pedido, estado });
+        });
+        sort(pedidos.begin(), pedidos.end(), [](const pair<const Pedido*, EstadoPedido>& a, const pair<const Pedido*, EstadoPedido>& b) {
+            if (a.first->getInstante() != b.first->getInstante()) {
+                return a.first->getInstante() > b.first->getInstante();
+            }
+            return a.first->getId() > b.first->getId();
+        });
+
+        ResumenCliente resumen = resumenCliente(idCliente);
+        string fechaUltimo;
+        agregarFechaHora(fechaUltimo, resumen.ultimoInstante);
+        cout << "\n--- PEDIDOS DE " << RegistroClientes::global().nombre(idCliente) << " ---\n";
+        cout << "Pendientes: " << resumen.pendientes << " | Completados: " << resumen.completados
+             << " | Gasto total: Q" << resumen.gasto << endl;
+        cout << "Ultimo pedido: ID " << resumen.ultimoId << " (" << fechaUltimo << ")\n\n";
+
+        SalidaBuffer salida(cout);
+        for (size_t i = 0; i < pedidos.size(); i++) {
+            salida.texto(pedidos[i].second == EstadoPedido::Pendiente ? "[pendiente] " : "[completado] ");
+            salida.pedidoNumerado(i + 1, *pedidos[i].first);
+        }
+        if (resumen.archivados > 0) {
+            salida.texto("Y ").numero(static_cast<int64_t>(resumen.archivados)).texto(" pedido(s) completados mas antiguos en el archivo.\n");
+        }
+    }
+
+    // Los totales ya estan acumulados; no se recorre el historial. Lo archivado
+    // sale de los resumenes de los segmentos.
+    ResumenFinanciero generarResumen() const {
+        ResumenFinanciero resumen;
+        resumen.cantidadPedidos = completadosEnMemoria();
+        resumen.ingresoTotal = ingresoCompletados;
+        resumen.unidadesVendidas = unidadesVendidas;
+        for (const ResumenSegmento& segmento : archivo.getSegmentos()) {
+            resumen.cantidadPedidos += segmento.cantidad;
+            resumen.ingresoTotal += segmento.ingreso();
+            const vector<long long>& unidades = segmento.porProducto.cantidad;
+            if (resumen.unidadesVendidas.size() < unidades.size()) {
+                resumen.unidadesVendidas.resize(unidades.size(), 0);
+            }
+            for (size_t id = 0; id < unidades.size(); id++) {
+                resumen.unidadesVendidas[id] += unidades[id];
+            }
+        }
+        return resumen;
+    }
+
+    // Entrega a alEncontrar(pedido, estado) cada pedido en memoria del cliente;
+    // el costo depende solo de cuantos pedidos tiene ese cliente
+    template <typename Funcion>
+    void recorrerPedidosDeCliente(uint32_t idCliente, Funcion alEncontrar) const {
+        if (idCliente >= pedidosPorCliente.size()) {
+            return;
+        }
+        for (int id : pedidosPorCliente[idCliente]) {
+            EstadoPedido estado;
+            const Pedido* pedido = obtenerPedido(id, &estado);
+            if (pedido != nullptr) {
+                alEncontrar(*pedido, estado);
+            }
+        }
+    }
+
+    // Incluye los archivados
+    size_t cantidadPedidosDeCliente(uint32_t idCliente) const {
+        size_t cantidad = idCliente < pedidosPorCliente.size() ? pedidosPorCliente[idCliente].size() : 0;
+        return cantidad + archivo.deCliente(idCliente).cantidad;
+    }
+
+    ResumenCliente resumenCliente(uint32_t idCliente) const {
+        ResumenCliente resumen;
+        auto considerarUltimo = [&](int id, int64_t instante) {
+            if (resumen.pendientes + resumen.completados == 1 || instante > resumen.ultimoInstante ||
+                (instante == resumen.ultimoInstante && id > resumen.ultimoId)) {
+                resumen.ultimoId = id;
+                resumen.ultimoInstante = instante;
+            }
+        };
+        recorrerPedidosDeCliente(idCliente, [&](const Pedido& pedido, EstadoPedido estado) {
+            if (estado == EstadoPedido::Pendiente) {
+                resumen.pendientes++;
+            }
+            else {
+                resumen.completados++;
+                resumen.gasto += pedido.getTotal();
+            }
+            considerarUltimo(pedido.getId(), pedido.getInstante());
+        });
+
+        ArchivadosCliente archivados = archivo.deCliente(idCliente);
+        if (archivados.cantidad > 0) {
+            resumen.archivados = archivados.cantidad;
+            resumen.completados += archivados.cantidad;
+            resumen.gasto += archivados.gasto;
+            considerarUltimo(archivados.ultimoId, archivados.ultimoInstante);
+        }
+        return resumen;
+    }
+
+    // Clientes con pedidos cuyo nombre empieza con prefijo, en orden alfabetico
+    vector<uint32_t> buscarClientesPorPrefijo(string_view prefijo) const {
+        vector<uint32_t> conPedidos;
+        for (uint32_t idCliente : RegistroClientes::global().buscarPorPrefijo(prefijo)) {
+            if (cantidadPedidosDeCliente(idCliente) > 0) {
+                conPedidos.push_back(idCliente);
+            }
+        }
+        return conPedidos;
+    }
+
+    const HistorialColumnar& historialColumnar() const {
+        return columnasCompletados;
+    }
+
+    // Agrupaciones de todo el historial: las columnas en memoria mas los
+    // resumenes de los segmentos archivados
+    VentasPorGrupo ventasPorProducto() const {
+        VentasPorGrupo ventas = columnasCompletados.porProducto();
+        for (const ResumenSegmento& segmento : archivo.getSegmentos()) {
+            sumarVentas(ventas, segmento.porProducto);
+        }
+        return ventas;
+    }
+
+    VentasPorGrupo ventasPorHora() const {
+        VentasPorGrupo ventas = columnasCompletados.porHora();
+        for (const ResumenSegmento& segmento : archivo.getSegmentos()) {
+            sumarVentas(ventas, segmento.porHora);
+        }
+        return ventas;
+    }
+
+    VentasPorGrupo ventasPorUrgencia() const {
+        VentasPorGrupo ventas = columnasCompletados.porUrgencia();
+        for (const ResumenSegmento& segmento : archivo.getSegmentos()) {
+            sumarVentas(ventas, segmento.porUrgencia);
+        }
+        return ventas;
+    }
+
+    VentasPorGrupo ventasPorCliente() const {
+        VentasPorGrupo ventas = columnasCompletados.porCliente();
+        for (const ResumenSegmento& segmento : archivo.getSegmentos()) {
+            for (const auto& entrada : segmento.porCliente) {
+                if (entrada.first >= ventas.cantidad.size()) {
+                    ventas.cantidad.resize(RegistroClientes::global().tamano(), 0);
+                    ventas.ingreso.resize(RegistroClientes::global().tamano());
+                }
+                ventas.cantidad[entrada.first] += static_cast<long long>(entrada.second.cantidad);
+                ventas.ingreso[entrada.first] += entrada.second.gasto;
+            }
+        }
+        return ventas;
+    }
+
+    // Recorre los dias con pedidos completados entre desde y hasta (instantes,
+    // inclusive) y entrega alDia(dia, resumen) en orden. Los dias completos usan
+    // sus totales; en los extremos se revisa cada pedido. De los segmentos
+    // archivados se usan los totales por dia si caen enteros en el rango y si no
+    // se leen del disco.
+    template <typename Funcion>
+    void resumenPorDia(int64_t desde, int64_t hasta, Funcion alDia) const {
+        if (desde > hasta) {
+            return;
+        }
+
+        map<int64_t, ResumenRango> archivados;
+        const vector<ResumenSegmento>& segmentos = archivo.getSegmentos();
+        for (size_t i = 0; i < segmentos.size(); i++) {
+            const ResumenSegmento& segmento = segmentos[i];
+            if (segmento.cantidad == 0 || segmento.instanteMaximo < desde || segmento.instanteMinimo > hasta) {
+                continue;
+            }
+            if (segmento.instanteMinimo >= desde && segmento.instanteMaximo <= hasta) {
+                for (const auto& dia : segmento.porDia) {
+                    archivados[dia.first].cantidadPedidos += dia.second.cantidadPedidos;
+                    archivados[dia.first].ingresoTotal += dia.second.ingresoTotal;
+                }
+                continue;
+            }
+            archivo.recorrerSegmento(i, [&](Pedido&& pedido) {
+                if (pedido.getInstante() >= desde && pedido.getInstante() <= hasta) {
+                    ResumenRango& delDia = archivados[diaDe(pedido.getInstante())];
+                    delDia.cantidadPedidos++;
+                    delDia.ingresoTotal += pedido.getTotal();
+                }
+            });
+        }
+        // Los dias archivados anteriores a limite que faltan por entregar
+        auto entregarArchivadosAntesDe = [&](int64_t limite) {
+            while (!archivados.empty() && archivados.begin()->first < limite) {
+                alDia(archivados.begin()->first, archivados.begin()->second);
+                archivados.erase(archivados.begin());
+            }
+        };
+
+        int64_t ultimoDia = diaDe(hasta);
+        for (auto it = segmentosPorDia.lower_bound(diaDe(desde)); it != segmentosPorDia.end() && it->first <= ultimoDia; ++it) {
+            const SegmentoDia& segmento = it->second;
+            ResumenRango resumen;
+            entregarArchivadosAntesDe(it->first);
+            auto archivadosDelDia = archivados.find(it->first);
+            if (archivadosDelDia != archivados.end()) {
+                resumen = archivadosDelDia->second;
+                archivados.erase(archivadosDelDia);
+            }
+
+            bool diaCompleto = diaDe(desde - 1) < it->first && diaDe(hasta + 1) > it->first;
+            if (diaCompleto) {
+                resumen.cantidadPedidos += segmento.cantidadPedidos;
+                resumen.ingresoTotal += segmento.ingreso;
+            }
+            else {
+                for (int id : segmento.ids) {
+                    const Pedido* pedido = obtenerPedido(id);
+                    if (pedido != nullptr && pedido->getInstante() >= desde && pedido->getInstante() <= hasta) {
+                        resumen.cantidadPedidos++;
+                        resumen.ingresoTotal += pedido->getTotal();
+                    }
+                }
+            }
+
+            if (resumen.cantidadPedidos > 0) {
+                alDia(it->first, resumen);
+            }
+        }
+        entregarArchivadosAntesDe(numeric_limits<int64_t>::max());
+    }
+
+    ResumenRango resumenEntre(int64_t desde, int64_t hasta) const {
+        ResumenRango total;
+        resumenPorDia(desde, hasta, [&](int64_t, const ResumenRango& resumen) {
+            total.cantidadPedidos += resumen.cantidadPedidos;
+            total.ingresoTotal += resumen.ingresoTotal;
+        });
+        return total;
+    }
+
+    // Entrega cada pedido completado con fecha entre desde y hasta: primero los
+    // archivados y despues los de memoria, por dia en orden de finalizacion
+    template <typename Funcion>
+    void recorrerCompletadosEntre(int64_t desde, int64_t hasta, Funcion alEncontrar) const {
+        if (desde > hasta) {
+            return;
+        }
+
+        const vector<ResumenSegmento>& segmentos = archivo.getSegmentos();
+        for (size_t i = 0; i < segmentos.size(); i++) {
+            if (segmentos[i].cantidad == 0 || segmentos[i].instanteMaximo < desde || segmentos[i].instanteMinimo > hasta) {
+                continue;
+            }
+            archivo.recorrerSegmento(i, [&](Pedido&& pedido) {
+                if (pedido.getInstante() >= desde && pedido.getInstante() <= hasta) {
+                    alEncontrar(static_cast<const Pedido&>(pedido));
+                }
+            });
+        }
+
+        int64_t ultimoDia = diaDe(hasta);
+        for (auto it = segmentosPorDia.lower_bound(diaDe(desde)); it != segmentosPorDia.end() && it->first <= ultimoDia; ++it) {
+            for (int id : it->second.ids) {
+                const Pedido* pedido = obtenerPedido(id);
+                if (pedido != nullptr && pedido->getInstante() >= desde && pedido->getInstante() <= hasta) {
+                    alEncontrar(*pedido);
+                }
+            }
+        }
+    }
+
+    // Ids de catalogo con unidades vendidas, ordenados por nombre
+    static vector<uint16_t> productosVendidosPorNombre(const ResumenFinanciero& resumen) {
+        const CatalogoProductos& catalogo = CatalogoProductos::global();
+        vector<uint16_t> productosVendidos;
+        for (size_t id = 0; id < resumen.unidadesVendidas.size(); id++) {
+            if (resumen.unidadesVendidas[id] > 0) {
+                productosVendidos.push_back(static_cast<uint16_t>(id));
+            }
+        }
+        sort(productosVendidos.begin(), productosVendidos.end(), [&](uint16_t a, uint16_t b) {
+            return catalogo.nombre(a) < catalogo.nombre(b);
+        });
+        return productosVendidos;
+    }
+
+    void generarReporteFinanciero() {
+        if (cantidadCompletados() == 0) {
+            cout << "\nNo hay pedidos completados para generar un reporte.\n";
+            return;
+        }
+
+        ResumenFinanciero resumen = generarResumen();
+        Dinero ingresoTotal = resumen.ingresoTotal;
+        size_t cantidadPedidos = resumen.cantidadPedidos;
+
+        const CatalogoProductos& catalogo = CatalogoProductos::global();
+        vector<uint16_t> productosVendidos = productosVendidosPorNombre(resumen);
+
+        cout << "\n--- REPORTE FINANCIERO ---\n";
+        cout << "Cantidad de pedidos completados: " << cantidadPedidos << endl;
+        cout << "Ingreso total: Q" << ingresoTotal << endl;
+        cout << "Promedio por pedido: Q" << (ingresoTotal / static_cast<int64_t>(cantidadPedidos)) << endl;
+
+        cout << "\nProductos vendidos:\n";
+        for (uint16_t id : productosVendidos) {
+            cout << "  - " << catalogo.nombre(id) << ": " << resumen.unidadesVendidas[id] << " unidad(es)" << endl;
+        }
+    }
+
+    // Ingresos por dia entre dos fechas (dd/mm/aaaa) y los de la ultima hora
+    void generarReportePorFechas() {
+        string textoDesde, textoHasta;
+        cout << "\nIngrese la fecha inicial (dd/mm/aaaa): ";
+        cin >> textoDesde;
+        cout << "Ingrese la fecha final (dd/mm/aaaa): ";
+        cin >> textoHasta;
+
+        int64_t desde, hasta;
+        if (!interpretarFechaHora(textoDesde + " 00:00:00", desde) || !interpretarFechaHora(textoHasta + " 23:59:59", hasta)) {
+            cout << "\nFecha invalida. Use el formato dd/mm/aaaa.\n";
+            return;
+        }
+
+        cout << "\n--- REPORTE POR FECHAS ---\n";
+        string fecha;
+        resumenPorDia(desde, hasta, [&](int64_t dia, const ResumenRango& resumen) {
+            fecha.clear();
+            // El mediodia local cae en el mismo dia aunque ese dia cambie el horario
+            int64_t mediodia = dia * 86400 + 43200;
+            agregarFechaHora(fecha, mediodia - desfaseHoraLocal(mediodia));
+            cout << fecha.substr(0, 10) << ": " << resumen.cantidadPedidos << " pedido(s), Q" << resumen.ingresoTotal << endl;
+        });
+
+        ResumenRango total = resumenEntre(desde, hasta);
+        cout << "Total del periodo: " << total.cantidadPedidos << " pedido(s), Q" << total.ingresoTotal << endl;
+
+        int64_t ahora = time(nullptr);
+        ResumenRango ultimaHora = resumenEntre(ahora - 3600, ahora);
+        cout << "Ultima hora: " << ultimaHora.cantidadPedidos << " pedido(s), Q" << ultimaHora.ingresoTotal << endl;
+    }
+
+    // Ingreso por producto, por hora, por cliente y de urgentes contra normales
+    void generarAnalisisVentas() {
+        if (cantidadCompletados() == 0) {
+            cout << "\nNo hay pedidos completados para analizar.\n";
+            return;
+        }
+
+        const CatalogoProductos& catalogo = CatalogoProductos::global();
+        Dinero ingresoTotal = ingresoCompletados + archivo.ingreso();
+        auto porcentaje = [&](Dinero parte) {
+            return ingresoTotal.getCentavos() == 0 ? 0.0 : 100.0 * parte.getCentavos() / ingresoTotal.getCentavos();
+        };
+        // Indices de los grupos con ventas, de mayor a menor ingreso
+        auto ordenarPorIngreso = [](const VentasPorGrupo& ventas) {
+            vector<size_t> orden;
+            for (size_t g = 0; g < ventas.cantidad.size(); g++) {
+                if (ventas.cantidad[g] > 0) {
+                    orden.push_back(g);
+                }
+            }
+            stable_sort(orden.begin(), orden.end(), [&](size_t a, size_t b) {
+                return ventas.ingreso[b] < ventas.ingreso[a];
+            });
+            return orden;
+        };
+
+        cout << "\n--- ANALISIS DE VENTAS ---\n";
+        cout << fixed << setprecision(1);
+
+        VentasPorGrupo productos = ventasPorProducto();
+        cout << "\nIngreso por producto:\n";
+        for (size_t id : ordenarPorIngreso(productos)) {
+            cout << "  - " << catalogo.nombre(static_cast<uint16_t>(id)) << ": " << productos.cantidad[id]
+                 << " unidad(es), Q" << productos.ingreso[id] << endl;
+        }
+
+        VentasPorGrupo horas = ventasPorHora();
+        cout << "\nIngreso por hora:\n";
+        for (size_t hora = 0; hora < 24; hora++) {
+            if (horas.cantidad[hora] > 0) {
+                cout << "  " << setw(2) << setfill('0') << hora << ":00 - " << setw(2) << hora << ":59" << setfill(' ')
+                     << ": " << horas.cantidad[hora] << " pedido(s), Q" << horas.ingreso[hora]
+                     << " (" << porcentaje(horas.ingreso[hora]) << "%)" << endl;
+            }
+        }
+
+        const size_t CLIENTES_EN_REPORTE = 10;
+        VentasPorGrupo clientes = ventasPorCliente();
+        vector<size_t> ordenClientes = ordenarPorIngreso(clientes);
+        cout << "\nClientes con mayor consumo:\n";
+        for (size_t i = 0; i < ordenClientes.size() && i < CLIENTES_EN_REPORTE; i++) {
+            size_t cliente = ordenClientes[i];
+            cout << "  " << (i + 1) << ". " << RegistroClientes::global().nombre(static_cast<uint32_t>(cliente)) << ": " << clientes.cantidad[cliente]
+                 << " pedido(s), Q" << clientes.ingreso[cliente] << endl;
+        }
+
+        VentasPorGrupo urgencia = ventasPorUrgencia();
+        cout << "\nUrgentes: " << urgencia.cantidad[1] << " pedido(s), Q" << urgencia.ingreso[1]
+             << " (" << porcentaje(urgencia.ingreso[1]) << "%)" << endl;
+        cout << "Normales: " << urgencia.cantidad[0] << " pedido(s), Q" << urgencia.ingreso[0]
+             << " (" << porcentaje(urgencia.ingreso[0]) << "%)" << endl;
+        cout.unsetf(ios::floatfield);
+        cout << setprecision(6);
+    }
+
+    // Escribe un respaldo con el estado actual. Devuelve false si no se pudo escribir.
+    bool guardar() {
+        CronometroMetrica cronometro(Metricas::global().latenciaGuardar);
+        esperarRespaldo();
+        archivarExcedente(true);
+        bool guardado = compactar();
+        publicarTamanos();
+        return guardado;
+    }
+
+    void guardarPedidos() {
+        if (respaldoAsincrono) {
+            if (respaldoEnCurso()) {
+                cout << "\nYa hay un respaldo en curso; los cambios nuevos entraran en el siguiente.\n";
+                return;
+            }
+            if (ultimoRespaldoFallo) {
+                cout << "\nAviso: el respaldo anterior no se pudo escribir en " << rutaSnapshot << ".\n";
+            }
+            guardarEnSegundoPlano();
+            cout << "\nGuardando los pedidos en segundo plano; puede seguir atendiendo.\n";
+            return;
+        }
+
+        if (!guardar()) {
+            cout << "\nError al guardar los pedidos en " << rutaSnapshot << ".\n";
+            return;
+        }
+
+        cout << "\nPedidos guardados correctamente en archivos.\n";
+    }
+
+    // Exporta los pedidos al formato de texto separado por '|'
+    // Escribe los pedidos en los archivos de texto. Devuelve false si no se
+    // pudieron abrir o si fallo la escritura.
+    bool exportarTexto() {
+        // La exportacion purga el historial; no puede pasar a mitad de un respaldo
+        esperarRespaldo();
+        ofstream archivoPendientes(rutaPendientes);
+        ofstream archivoCompletados(rutaCompletados);
+
+        if (!archivoPendientes.is_open() || !archivoCompletados.is_open()) {
+            return false;
+        }
+
+        // Si un hilo que arma bloques falla (por ejemplo, sin memoria) los
+        // archivos quedan a medias y se informa como error
+        try {
+            // Guardar pedidos pendientes en orden de atencion
+            formatearEnParalelo(pedidosPendientes, escribirPedidoTexto, [&](const string& bloque) {
+                archivoPendientes.write(bloque.data(), static_cast<streamsize>(bloque.size()));
+            });
+
+            // Guardar pedidos completados desde el fondo de la pila hasta la cima; los
+            // archivados son los mas antiguos y van primero, un segmento a la vez
+            auto escribirCompletados = [&](const string& bloque) {
+                archivoCompletados.write(bloque.data(), static_cast<streamsize>(bloque.size()));
+            };
+            vector<Pedido> segmento;
+            for (size_t i = 0; i < archivo.getSegmentos().size(); i++) {
+                segmento.clear();
+                archivo.recorrerSegmento(i, [&](Pedido&& pedido) { segmento.push_back(move(pedido)); });
+                formatearEnParalelo(segmento, escribirPedidoTexto, escribirCompletados);
+            }
+            purgarEliminados();
+            formatearEnParalelo(pedidosCompletados, escribirPedidoTexto, escribirCompletados);
+        }
+        catch (const exception&) {
+            return false;
+        }
+
+        archivoPendientes.close();
+        archivoCompletados.close();
+        return true;
+    }
+
+    void exportarPedidosTexto() {
+        if (!exportarTexto()) {
+            cout << "\nError al escribir los archivos de texto de los pedidos.\n";
+            return;
+        }
+        cout << "\nPedidos exportados correctamente a archivos de texto.\n";
+    }
+
+    // Carga el ultimo respaldo y le aplica los cambios del journal posteriores a el.
+    // Si no hay respaldo ni journal se usan los archivos de texto.
+    ResultadoCarga cargar() {
+        Metricas& metricas = Metricas::global();
+        CronometroMetrica cronometro(metricas.latenciaCargar);
+        esperarRespaldo();
+        lecturaEnCarga = 0;
+        filasRevisadasEnCarga = 0;
+
+        // Lo que este en el buffer del journal debe estar en el archivo antes de leerlo
+        if (journal != nullptr) {
+            fflush(journal);
+        }
+
+        // Limpiar las estructuras actuales
+        limpiarPedidos();
+
+        ResultadoCarga resultado;
+        uint64_t secuenciaRespaldo = 0;
+        bool desdeTexto = false;
+        size_t productosRechazados = CatalogoProductos::global().nombresRechazados();
+        size_t clientesRechazados = RegistroClientes::global().nombresRechazados();
+
+        if (esArchivoSnapshot(rutaSnapshot)) {
+            vector<uint32_t> segmentos;
+            vector<pair<uint32_t, int>> eliminados;
+            bool valido = leerSnapshot([&](EstadoPedido estado, Pedido&& pedido) {
+                if (existePedido(pedido.getId())) {
+                    resultado.duplicados++;
+                }
+                else if (estado == EstadoPedido::Pendiente) {
+                    encolarPendiente(move(pedido));
+                }
+                else {
+                    apilarCompletado(move(pedido));
+                }
+            }, &secuenciaRespaldo, &segmentos, &eliminados);
+            CronometroMetrica lecturaSegmentos;
+            valido = valido && archivo.abrir(segmentos, eliminados);
+            lecturaEnCarga += lecturaSegmentos.transcurrido();
+
+            if (!valido) {
+                limpiarPedidos();
+                resultado.estado = EstadoCarga::RespaldoDanado;
+                return resultado;
+            }
+
+            // Lo que archivo una sesion anterior sin guardar despues no lo nombra
+            // el respaldo; se borra para que no se junte con cada carga
+            archivo.borrarHuerfanos();
+        }
+        else if (!usarJournal || !hayJournal()) {
+            if (!cargarPedidosTexto(resultado)) {
+                resultado.estado = EstadoCarga::SinArchivos;
+                return resultado;
+            }
+            if (resultado.estado != EstadoCarga::Correcta) {
+                limpiarPedidos();
+                return resultado;
+            }
+            desdeTexto = true;
+        }
+
+        secuenciaJournal = secuenciaRespaldo;
+        eventosEnJournal = 0;
+        if (usarJournal) {
+            // El anterior existe si se corto un respaldo en segundo plano; sus
+            // eventos van antes que los del journal actual
+            bool colaAnterior = false;
+            resultado.eventosAplicados = reproducirJournal(rutaJournalAnterior, secuenciaRespaldo, colaAnterior);
+            resultado.eventosAplicados += reproducirJournal(rutaJournal, secuenciaRespaldo, resultado.colaIncompleta);
+            resultado.colaIncompleta = resultado.colaIncompleta || colaAnterior;
+        }
+        archivoConError = false;
+
+        // Los pendientes estan en el planificador y no en columnas; se revisan
+        // uno por uno (suelen ser pocos)
+        revisarCargados(resultado);
+        vector<int64_t> precios = preciosDelCatalogo();
+        for (const Pedido& pedido : pedidosPendientes) {
+            Dinero suma;
+            for (const Producto& p : pedido.getProductos()) {
+                suma += p.getPrecio();
+                resultado.preciosDistintosAlCatalogo += (precios[p.getIdProducto()] != p.getPrecio().getCentavos());
+            }
+            if (suma != pedido.getTotal()) {
+                resultado.totalesIncorrectos.push_back(pedido.getId());
+            }
+        }
+        metricas.totalesIncorrectos.sumar(resultado.totalesIncorrectos.size());
+        resultado.productosSinLugar = CatalogoProductos::global().nombresRechazados() - productosRechazados;
+        resultado.clientesSinLugar = RegistroClientes::global().nombresRechazados() - clientesRechazados;
+        archivarExcedente(true);
+
+        // Los datos cargados desde texto o un journal con basura al final se
+        // pasan a un respaldo nuevo para que el journal vuelva a empezar limpio
+        if (usarJournal && (desdeTexto || resultado.colaIncompleta)) {
+            compactar();
+        }
+
+        uint64_t total = cronometro.transcurrido();
+        metricas.cargarLectura.registrar(lecturaEnCarga);
+        metricas.cargarInterpretacion.registrar(total > lecturaEnCarga ? total - lecturaEnCarga : 0);
+        publicarTamanos();
+        return resultado;
+    }
+
+    void cargarPedidos() {
+        ResultadoCarga resultado = cargar();
+
+        if (resultado.estado == EstadoCarga::RespaldoDanado) {
+            cout << "\nEl archivo " << rutaSnapshot << " o uno de los segmentos archivados esta danado o tiene una version no soportada.\n";
+            return;
+        }
+        if (resultado.estado == EstadoCarga::SinArchivos) {
+            cout << "\nNo se encontraron archivos de pedidos para cargar o hubo un error al abrirlos.\n";
+            return;
+        }
+        if (resultado.estado == EstadoCarga::ErrorLectura) {
+            cout << "\nHubo un error al leer los archivos de pedidos (por ejemplo, falta de memoria); no se cargo nada.\n";
+            return;
+        }
+
+        if (resultado.duplicados > 0) {
+            cout << "\nSe omitieron " << resultado.duplicados << " pedido(s) con ID repetido.\n";
+        }
+        if (!resultado.totalesIncorrectos.empty()) {
+            cout << "\nAviso: " << resultado.totalesIncorrectos.size() << " pedido(s) tienen un total distinto a la suma de sus productos. IDs:";
+            for (size_t i = 0; i < resultado.totalesIncorrectos.size() && i < 10; i++) {
+                cout << " " << resultado.totalesIncorrectos[i];
+            }
+            cout << (resultado.totalesIncorrectos.size() > 10 ? " ...\n" : "\n");
+        }
+        if (!resultado.fechasInvalidas.empty()) {
+            cout << "\nAviso: " << resultado.fechasInvalidas.size() << " pedido(s) tienen una fecha que no se entiende y se cargaron con fecha 01/01/1970. IDs:";
+            for (size_t i = 0; i < resultado.fechasInvalidas.size() && i < 10; i++) {
+                cout << " " << resultado.fechasInvalidas[i];
+            }
+            cout << (resultado.fechasInvalidas.size() > 10 ? " ...\n" : "\n");
+        }
+        if (resultado.preciosDistintosAlCatalogo > 0) {
+            cout << "\nAviso: " << resultado.preciosDistintosAlCatalogo << " producto(s) en pedidos cargados tienen un precio distinto al del menu.\n";
+        }
+        if (resultado.productosSinLugar > 0) {
+            cout << "\nAviso: el catalogo esta lleno; " << resultado.productosSinLugar << " producto(s) nuevos se cargaron como \"Otro producto\".\n";
+        }
+        if (resultado.clientesSinLugar > 0) {
+            cout << "\nAviso: el registro de clientes esta lleno; " << resultado.clientesSinLugar << " cliente(s) nuevos se cargaron como \"Otro cliente\".\n";
+        }
+        if (resultado.eventosAplicados > 0) {
+            cout << "\nSe aplicaron " << resultado.eventosAplicados << " cambio(s) registrados despues del ultimo respaldo.\n";
+        }
+        if (resultado.colaIncompleta) {
+            cout << "\nSe descarto un cambio incompleto al final de " << rutaJournal << ".\n";
+        }
+
+        cout << "\nPedidos cargados correctamente desde archivos.\n";
+    }
+
+    // Devuelve false si falta alguno de los archivos; si se pudieron abrir pero
+    // la lectura fallo deja el estado en ErrorLectura
+    bool cargarPedidosTexto(ResultadoCarga& resultado) {
+        if (!ArchivoMapeado(rutaPendientes).estaAbierto() || !ArchivoMapeado(rutaCompletados).estaAbierto()) {
+            return false;
+        }
+
+        // Cargar pedidos pendientes
+        bool leidos = leerPedidosTexto(rutaPendientes, [&](Pedido&& pedido) {
+            if (existePedido(pedido.getId())) {
+                resultado.duplicados++;
+                return;
+            }
+            encolarPendiente(move(pedido));
+        }, &resultado.fechasInvalidas);
+
+        // Cargar pedidos completados (el archivo va del fondo de la pila a la cima);
+        // con un limite en memoria se van archivando mientras se leen, despues
+        // de revisarlos
+        leidos = leidos && leerPedidosTexto(rutaCompletados, [&](Pedido&& pedido) {
+            if (existePedido(pedido.getId())) {
+                resultado.duplicados++;
+                return;
+            }
+            apilarCompletado(move(pedido));
+            if (maximoEnMemoria > 0 && pedidosCompletados.size() > maximoEnMemoria) {
+                revisarCargados(resultado);
+                archivarExcedente(false);
+                filasRevisadasEnCarga = columnasCompletados.size();
+            }
+        }, &resultado.fechasInvalidas);
+
+        if (!leidos) {
+            resultado.estado = EstadoCarga::ErrorLectura;
+        }
+        return true;
+    }
+
+    void verPedidosGuardados() {
+        if (esArchivoSnapshot(rutaSnapshot)) {
+            vector<Pedido> pendientes, completados;
+            if (!leerSnapshot(pendientes, completados)) {
+                cout << "\nEl archivo " << rutaSnapshot << " esta danado o tiene una version no soportada.\n";
+                return;
+            }
+
+            cout << "\n--- PEDIDOS GUARDADOS EN ARCHIVOS ---\n";
+            cout << "\nPEDIDOS PENDIENTES:\n";
+            mostrarListaGuardada(pendientes, "No hay pedidos pendientes guardados.\n");
+            cout << "\nPEDIDOS COMPLETADOS:\n";
+            mostrarListaGuardada(completados, "No hay pedidos completados guardados.\n");
+
+            if (eventosEnJournal > 0) {
+                cout << "\nHay " << eventosEnJournal << " cambio(s) en " << rutaJournal << " que entraran en el proximo respaldo.\n";
+            }
+            return;
+        }
+
+        if (!ArchivoMapeado(rutaPendientes).estaAbierto() || !ArchivoMapeado(rutaCompletados).estaAbierto()) {
+            cout << "\nNo se encontraron archivos de pedidos para visualizar o hubo un error al abrirlos.\n";
+            return;
+        }
+
+        cout << "\n--- PEDIDOS GUARDADOS EN ARCHIVOS ---\n";
+
+        SalidaBuffer salida(cout);
+
+        // Mostrar pedidos pendientes
+        salida.texto("\nPEDIDOS PENDIENTES:\n");
+        size_t contador = 1;
+
+        leerPedidosTexto(rutaPendientes, [&](Pedido&& p) {
+            salida.pedidoNumerado(contador, p);
+            contador++;
+        });
+
+        if (contador == 1) {
+            salida.texto("No hay pedidos pendientes guardados.\n");
+        }
+
+        // Mostrar pedidos completados
+        salida.texto("\nPEDIDOS COMPLETADOS:\n");
+        contador = 1;
+
+        leerPedidosTexto(rutaCompletados, [&](Pedido&& p) {
+            salida.pedidoNumerado(contador, p);
+            contador++;
+        });
+
+        if (contador == 1) {
+            salida.texto("No hay pedidos completados guardados.\n");
+        }
+    }
+
+    // Exporta lo guardado en archivos sin cargarlo: el respaldo binario y los
+    // segmentos que nombra, o los archivos de texto si no hay respaldo. Como en
+    // verPedidosGuardados, los cambios que solo estan en el journal no entran.
+    // Van los pendientes, despues los completados y al final los archivados.
+    // Lo que ya salio por la salida estandar no se puede descartar, asi que ahi
+    // se revisan antes los checksums del respaldo y de sus segmentos.
+    ResultadoExportacion exportarGuardados(FormatoExportacion formato, const FiltroExportacion& filtro, const string& ruta) {
+        esperarRespaldo();
+        if (esArchivoSnapshot(rutaSnapshot)) {
+            if (ruta == "-") {
+                vector<uint32_t> segmentos;
+                vector<pair<uint32_t, int>> eliminados;
+                if (!filtrarSnapshot(filtro, segmentos, eliminados, [](const FilaExportada&) {}) ||
+                    !archivo.verificarGuardados(segmentos)) {
+                    ResultadoExportacion resultado;
+                    resultado.estado = EstadoExportacion::ArchivoDanado;
+                    return resultado;
+                }
+            }
+            return exportarA(ruta, formato, [&](EscritorExportacion& escritor, size_t& saltados) {
+                vector<uint32_t> segmentos;
+                vector<pair<uint32_t, int>> eliminados;
+                auto escribir = [&](const FilaExportada& fila) { escritor.escribir(fila); };
+                if (!filtrarSnapshot(filtro, segmentos, eliminados, escribir) ||
+                    !archivo.filtrarGuardados(segmentos, eliminados, filtro, saltados, escribir)) {
+                    return EstadoExportacion::ArchivoDanado;
+                }
+                return EstadoExportacion::Correcta;
+            });
+        }
+
+        if (!ArchivoMapeado(rutaPendientes).estaAbierto() || !ArchivoMapeado(rutaCompletados).estaAbierto()) {
+            ResultadoExportacion resultado;
+            resultado.estado = EstadoExportacion::SinArchivos;
+            return resultado;
+        }
+        size_t fechasInvalidas = 0;
+        ResultadoExportacion resultado = exportarA(ruta, formato, [&](EscritorExportacion& escritor, size_t&) {
+            auto escribir = [&](const string& texto, size_t filas) { escritor.escribirFormateadas(texto, filas); };
+            if (!filtrarPedidosTexto(rutaPendientes, true, filtro, formato, fechasInvalidas, escribir) ||
+                !filtrarPedidosTexto(rutaCompletados, false, filtro, formato, fechasInvalidas, escribir)) {
+                return EstadoExportacion::ArchivoDanado;
+            }
+            return EstadoExportacion::Correcta;
+        });
+        resultado.fechasInvalidas = fechasInvalidas;
+        return resultado;
+    }
+
+    // Exporta el estado en memoria, con el journal ya aplicado: pendientes en
+    // orden de atencion, completados en memoria y despues los archivados
+    ResultadoExportacion exportarEnMemoria(FormatoExportacion formato, const FiltroExportacion& filtro, const string& ruta) const {
+        return exportarA(ruta, formato, [&](EscritorExportacion& escritor, size_t& saltados) {
+            // Cliente y producto se traducen a ids una vez y se compara por id
+            const CatalogoProductos& catalogo = CatalogoProductos::global();
+            uint32_t idCliente = 0;
+            bool hayCliente = filtro.cliente.empty() || RegistroClientes::global().buscar(filtro.cliente, idCliente);
+            vector<uint8_t> esProductoBuscado(catalogo.tamano());
+            for (size_t id = 0; id < esProductoBuscado.size(); id++) {
+                esProductoBuscado[id] = (catalogo.nombre(static_cast<uint16_t>(id)) == filtro.producto);
+            }
+
+            FilaExportada fila;
+            auto escribirPedido = [&](const Pedido& p, bool pendiente) {
+                if (!hayCliente || (!filtro.cliente.empty() && p.getIdCliente() != idCliente) || !filtro.admiteUrgencia(p.esUrgente()) ||
+                    !filtro.admiteInstante(p.getInstante())) {
+                    return;
+                }
+                fila.productos.clear();
+                bool tieneProducto = filtro.producto.empty();
+                for (const Producto& prod : p.getProductos()) {
+                    fila.productos.emplace_back(catalogo.nombre(prod.getIdProducto()), prod.getPrecio());
+                    tieneProducto = tieneProducto || esProductoBuscado[prod.getIdProducto()];
+                }
+                if (!tieneProducto) {
+                    return;
+                }
+                fila.id = p.getId();
+                fila.pendiente = pendiente;
+                fila.cliente = p.getNombreCliente();
+                fila.instante = p.getInstante();
+                fila.urgente = p.esUrgente();
+                fila.total = p.getTotal();
+                escritor.escribir(fila);
+            };
+
+            for (const Pedido& p : pedidosPendientes) {
+                escribirPedido(p, true);
+            }
+            for (size_t ranura = 0; ranura < pedidosCompletados.size(); ranura++) {
+                if (columnasCompletados.estaViva(ranura)) {
+                    escribirPedido(pedidosCompletados[ranura], false);
+                }
+            }
+            if (!archivo.filtrar(filtro, saltados, [&](const FilaExportada& archivada) { escritor.escribir(archivada); })) {
+                return EstadoExportacion::ArchivoDanado;
+            }
+            return EstadoExportacion::Correcta;
+        });
+    }
+
+    // Elimina un pedido pendiente o del historial; el cambio queda en el journal
+    void eliminarPedido() {
+        int opcion;
+        cout << "\nQue tipo de pedido desea eliminar?" << endl;
+        cout << "1. Pedido pendiente" << endl;
+        cout << "2. Pedido completado" << endl;
+        cout << "3. Por ID (incluye archivados)" << endl;
+        cout << "Ingrese opcion: ";
+        cin >> opcion;
+
+        // Por ID no hace falta listar nada
+        if (opcion == 3) {
+            int id;
+            cout << "Ingrese el ID del pedido a eliminar: ";
+            cin >> id;
+            if (eliminarPedidoPorId(id)) {
+                cout << "\nPedido " << id << " eliminado correctamente." << endl;
+            }
+            else {
+                cout << "\nNo se encontro ningún pedido con el ID " << id << "." << endl;
+            }
+            return;
+        }
+
+        if (opcion != 1 && opcion != 2) {
+            cout << "\nOpcion invalida. Regresando al menu principal." << endl;
+            return;
+        }
+
+        string tipoPedido = (opcion == 1) ? "pendientes" : "completados";
+        // Pendientes en orden de atencion; completados del fondo a la cima
+        vector<const Pedido*> pedidos;
+        if (opcion == 1) {
+            for (const Pedido& p : pedidosPendientes) {
+                pedidos.push_back(&p);
+            }
+        }
+        else {
+            for (size_t ranura = 0; ranura < pedidosCompletados.size(); ranura++) {
+                if (columnasCompletados.estaViva(ranura)) {
+                    pedidos.push_back(&pedidosCompletados[ranura]);
+                }
+            }
+        }
+
+        if (pedidos.empty()) {
+            cout << "\nNo hay pedidos " << tipoPedido << " para eliminar." << endl;
+            return;
+        }
+
+        // Mostrar los pedidos al usuario
+        cout << "\n--- Pedidos " << tipoPedido << " disponibles para eliminar ---\n";
+        SalidaBuffer salida(cout);
+        for (size_t i = 0; i < pedidos.size(); i++) {
+            salida.pedidoNumerado(i + 1, *pedidos[i]);
+        }
+        salida.vaciar();
+
+        // Solicitar al usuario que seleccione el pedido a eliminar
+        int seleccion;
+        cout << "Seleccione el numero del pedido a eliminar (1-" << pedidos.size() << "): ";
+        cin >> seleccion;
+
+        if (seleccion < 1 || seleccion > static_cast<int>(pedidos.size())) {
+            cout << "\nSelección invalida. Operacion cancelada." << endl;
+            return;
+        }
+
+        eliminarPedidoPorId(pedidos[seleccion - 1]->getId());
+
+        cout << "\nPedido eliminado correctamente de los pedidos " << tipoPedido << "." << endl;
+    }
+};
+
+// Historial de solo agregar que se puede leer mientras otros hilos escriben.
+// Los pedidos viven en bloques que nunca se mueven y 'publicados' marca hasta
+// donde ya estan completos, asi un lector ve siempre un prefijo consistente.
+// Cada escritor reserva primero un tramo de posiciones (su turno), construye
+// sus pedidos sin bloquear a los demas y publica cuando todos los tramos
+// anteriores ya se publicaron, asi el orden del historial es el de reserva.
+class HistorialConcurrente {
+private:
+    static const size_t PEDIDOS_POR_BLOQUE = 4096;
+    static const size_t MAXIMO_BLOQUES = 1 << 16;
+
+    unique_ptr<atomic<Pedido*>[]> bloques;
+    atomic<size_t> reservados{ 0 };
+    atomic<size_t> publicados{ 0 };
+    mutex mutexPublicacion;
+    condition_variable turnoPublicar;
+
+    Pedido* direccion(size_t posicion) const {
+        return bloques[posicion / PEDIDOS_POR_BLOQUE].load(memory_order_acquire) + posicion % PEDIDOS_POR_BLOQUE;
+    }
+
+public:
+    HistorialConcurrente() : bloques(new atomic<Pedido*>[MAXIMO_BLOQUES]) {
+        for (size_t i = 0; i < MAXIMO_BLOQUES; i++) {
+            bloques[i].store(nullptr, memory_order_relaxed);
+        }
+    }
+
+    ~HistorialConcurrente() {
+        size_t total = publicados.load();
+        for (size_t i = 0; i < total; i++) {
+            direccion(i)->~Pedido();
+        }
+        for (size_t i = 0; i < MAXIMO_BLOQUES; i++) {
+            ::operator delete(bloques[i].load());
+        }
+    }
+
+    HistorialConcurrente(const HistorialConcurrente&) = delete;
+    HistorialConcurrente& operator=(const HistorialConcurrente&) = delete;
+
+    static constexpr size_t CAPACIDAD = PEDIDOS_POR_BLOQUE * MAXIMO_BLOQUES;
+
+    // Reserva cantidad posiciones y devuelve la primera en inicio. Devuelve
+    // false, sin reservar nada, si el historial no tiene lugar.
+    bool reservar(size_t cantidad, size_t& inicio) {
+        size_t actual = reservados.load(memory_order_relaxed);
+        do {
+            if (cantidad > CAPACIDAD - actual) {
+                return false;
+            }
+        } while (!reservados.compare_exchange_weak(actual, actual + cantidad, memory_order_relaxed));
+        inicio = actual;
+        return true;
+    }
+
+    // Construye el lote en las posiciones reservadas desde inicio y lo publica
+    // cuando le llega el turno. Todo tramo reservado se tiene que agregar,
+    // aunque este vacio, o los siguientes esperan para siempre.
+    void agregar(size_t inicio, vector<Pedido>& lote) {
+        for (size_t i = 0; i < lote.size(); i++) {
+            size_t posicion = inicio + i;
+            atomic<Pedido*>& bloque = bloques[posicion / PEDIDOS_POR_BLOQUE];
+            if (bloque.load(memory_order_acquire) == nullptr) {
+                // Dos escritores pueden empezar el mismo bloque; gana el primero
+                Pedido* nuevo = static_cast<Pedido*>(::operator new(sizeof(Pedido) * PEDIDOS_POR_BLOQUE));
+                Pedido* esperado = nullptr;
+                if (!bloque.compare_exchange_strong(esperado, nuevo, memory_order_acq_rel)) {
+                    ::operator delete(nuevo);
+                }
+            }
+            new (direccion(posicion)) Pedido(move(lote[i]));
+        }
+
+        unique_lock<mutex> bloqueo(mutexPublicacion);
+        turnoPublicar.wait(bloqueo, [&] { return publicados.load(memory_order_relaxed) == inicio; });
+        publicados.store(inicio + lote.size(), memory_order_release);
+        turnoPublicar.notify_all();
+    }
+
+    size_t tamano() const {
+        return publicados.load(memory_order_acquire);
+    }
+
+    // Posiciones ya reservadas, publicadas o no
+    size_t tamanoReservado() const {
+        return reservados.load(memory_order_relaxed);
+    }
+
+    // Solo se pueden leer posiciones menores a tamano()
+    const Pedido& operator[](size_t posicion) const {
+        return *direccion(posicion);
+    }
+};
+
+enum class ResultadoEnvio {
+    Aceptado,
+    IdRepetido,
+    HistorialLleno
+};
+
+// Version de GestorPedidos para varios mostradores y cocinas a la vez: cualquier
+// hilo puede enviar pedidos a la cola de entrada y un grupo de trabajadores los
+// procesa pasandolos al historial. Los lotes reservan su lugar al salir de la
+// cola, asi el historial queda en el orden de llegada aunque los trabajadores
+// terminen en otro orden. Reportes y busquedas leen el historial sin detener a
+// los trabajadores.
+class GestorPedidosConcurrente {
+private:
+    static const size_t FRANJAS_INDICE = 64;
+    static const size_t TAMANO_LOTE = 256;
+    static constexpr int64_t POSICION_PENDIENTE = -1;
+
+    // Indice de IDs repartido en franjas con su propio mutex; guarda la posicion
+    // en el historial o POSICION_PENDIENTE
+    struct FranjaIndice {
+        mutex mutexFranja;
+        unordered_map<int, int64_t> posiciones;
+    };
+
+    mutex mutexEntrada;
+    condition_variable hayPedidos;
+    condition_variable sinTrabajo;
+    deque<Pedido> colaEntrada;
+    size_t lotesEnProceso = 0;
+    size_t pedidosEnProceso = 0;
+    bool cerrando = false;
+    // Pedidos que se aceptan en total: los de la cola mas los del historial
+    size_t maximoPedidos;
+
+    array<FranjaIndice, FRANJAS_INDICE> franjas;
+    HistorialConcurrente historial;
+    vector<thread> trabajadores;
+
+    FranjaIndice& franjaDe(int id) {
+        return franjas[static_cast<unsigned int>(id) % FRANJAS_INDICE];
+    }
+
+    void ejecutarTrabajador() {
+        vector<Pedido> lote;
+        lote.reserve(TAMANO_LOTE);
+        size_t inicio = 0;
+
+        while (true) {
+            {
+                unique_lock<mutex> bloqueo(mutexEntrada);
+                hayPedidos.wait(bloqueo, [&] { return cerrando || !colaEntrada.empty(); });
+                if (colaEntrada.empty()) {
+                    return;
+                }
+
+                while (!colaEntrada.empty() && lote.size() < TAMANO_LOTE) {
+                    lote.push_back(move(colaEntrada.front()));
+                    colaEntrada.pop_front();
+                }
+                // enviarPedido ya controlo el lugar, asi que la reserva no falla;
+                // reservar aqui, con el mutex, es lo que fija el orden
+                historial.reservar(lote.size(), inicio);
+                lotesEnProceso++;
+                pedidosEnProceso += lote.size();
+            }
+
+            historial.agregar(inicio, lote);
+            for (size_t i = 0; i < lote.size(); i++) {
+                int id = historial[inicio + i].getId();
+                FranjaIndice& franja = franjaDe(id);
+                lock_guard<mutex> bloqueo(franja.mutexFranja);
+                franja.posiciones[id] = static_cast<int64_t>(inicio + i);
+            }
+
+            {
+                lock_guard<mutex> bloqueo(mutexEntrada);
+                lotesEnProceso--;
+                pedidosEnProceso -= lote.size();
+                if (colaEntrada.empty() && lotesEnProceso == 0) {
+                    sinTrabajo.notify_all();
+                }
+            }
+            lote.clear();
+        }
+    }
+
+public:
+    explicit GestorPedidosConcurrente(size_t cantidadTrabajadores = thread::hardware_concurrency(),
+                                      size_t maximo = HistorialConcurrente::CAPACIDAD)
+        : maximoPedidos(min(maximo, HistorialConcurrente::CAPACIDAD)) {
+        if (cantidadTrabajadores == 0) {
+            cantidadTrabajadores = 1;
+        }
+        for (size_t i = 0; i < cantidadTrabajadores; i++) {
+            trabajadores.emplace_back(&GestorPedidosConcurrente::ejecutarTrabajador, this);
+        }
+    }
+
+    // Termina de procesar lo que quede en la cola antes de detener a los trabajadores
+    ~GestorPedidosConcurrente() {
+        {
+            lock_guard<mutex> bloqueo(mutexEntrada);
+            cerrando = true;
+        }
+        hayPedidos.notify_all();
+        for (thread& t : trabajadores) {
+            t.join();
+        }
+    }
+
+    GestorPedidosConcurrente(const GestorPedidosConcurrente&) = delete;
+    GestorPedidosConcurrente& operator=(const GestorPedidosConcurrente&) = delete;
+
+    // Envia un pedido a la cola de entrada. Falla si el ID ya existe o si ya
+    // no entran mas pedidos en el historial.
+    ResultadoEnvio enviarPedido(Pedido pedido) {
+        int id = pedido.getId();
+        FranjaIndice& franja = franjaDe(id);
+        {
+            lock_guard<mutex> bloqueo(franja.mutexFranja);
+            if (!franja.posiciones.emplace(id, POSICION_PENDIENTE).second) {
+                return ResultadoEnvio::IdRepetido;
+            }
+        }
+
+        bool lleno;
+        {
+            lock_guard<mutex> bloqueo(mutexEntrada);
+            lleno = historial.tamanoReservado() + colaEntrada.size() >= maximoPedidos;
+            if (!lleno) {
+                colaEntrada.push_back(move(pedido));
+            }
+        }
+        if (lleno) {
+            lock_guard<mutex> bloqueo(franja.mutexFranja);
+            franja.posiciones.erase(id);
+            return ResultadoEnvio::HistorialLleno;
+        }
+        hayPedidos.notify_one();
+        return ResultadoEnvio::Aceptado;
+    }
+
+    // Bloquea hasta que la cola de entrada quede vacia y no haya lotes en proceso
+    void esperarProcesados() {
+        unique_lock<mutex> bloqueo(mutexEntrada);
+        sinTrabajo.wait(bloqueo, [&] { return colaEntrada.empty() && lotesEnProceso == 0; });
+    }
+
+    size_t cantidadPendientes() {
+        lock_guard<mutex> bloqueo(mutexEntrada);
+        return colaEntrada.size() + pedidosEnProceso;
+    }
+
+    const HistorialConcurrente& getHistorial() const {
+        return historial;
+    }
+
+    // Devuelve el pedido si ya esta en el historial. Si sigue en cola,
+    // devuelve nullptr con estado Pendiente; si no existe, nullptr y false.
+    const Pedido* buscarPedido(int id, EstadoPedido& estado, bool& existe) {
+        FranjaIndice& franja = franjaDe(id);
+        int64_t posicion;
+        {
+            lock_guard<mutex> bloqueo(franja.mutexFranja);
+            auto it = franja.posiciones.find(id);
+            existe = (it != franja.posiciones.end());
+            if (!existe) {
+                return nullptr;
+            }
+            posicion = it->second;
+        }
+
+        if (posicion == POSICION_PENDIENTE) {
+            estado = EstadoPedido::Pendiente;
+            return nullptr;
+        }
+        estado = EstadoPedido::Completado;
+        return &historial[static_cast<size_t>(posicion)];
+    }
+
+    // Reporte sobre los pedidos publicados en el historial al momento de llamarlo
+    ResumenFinanciero generarResumen() const {
+        ResumenFinanciero resumen;
+        resumen.cantidadPedidos = historial.tamano();
+        resumen.unidadesVendidas.assign(CatalogoProductos::global().tamano(), 0);
+
+        for (size_t i = 0; i < resumen.cantidadPedidos; i++) {
+            const Pedido& pedido = historial[i];
+            resumen.ingresoTotal += pedido.getTotal();
+            for (const Producto& p : pedido.getProductos()) {
+                if (p.getIdProducto() >= resumen.unidadesVendidas.size()) {
+                    resumen.unidadesVendidas.resize(p.getIdProducto() + 1, 0);
+                }
+                resumen.unidadesVendidas[p.getIdProducto()]++;
+            }
+        }
+        return resumen;
+    }
+};
 
-            int id = stoi(datos[0]);
-            string nombreCliente = datos[1];
-            int numProductos = stoi(datos[2]);
+// Varias sucursales atendidas por el mismo proceso. Cada sucursal es un
+// GestorPedidos independiente, con su cola, su historial, sus archivos
+// (prefijo "sucursalN_") y su propio mutex, asi los hilos que atienden
+// sucursales distintas no se esperan entre si. Los IDs de pedido solo tienen
+// que ser unicos dentro de cada sucursal; el catalogo y los clientes son los
+// registros globales de siempre. Los reportes de todas calculan el resumen de
+// cada sucursal en paralelo y los suman; cada sucursal se lee en su propio
+// momento, no hay una foto comun de todas.
+class GestorSucursales {
+private:
+    struct Sucursal {
+        mutex mutexSucursal;
+        GestorPedidos gestor;
+
+        Sucursal(const string& prefijoArchivos, bool usarJournal) : gestor(prefijoArchivos, usarJournal) {}
+    };
+
+    vector<unique_ptr<Sucursal>> sucursales;
+
+    // Calcula calcular(gestor) en cada sucursal con su mutex tomado, en varios
+    // hilos, y entrega los resultados a juntar(resultado) en orden de sucursal.
+    // Los hilos se reparten: cada sucursal usa su parte para su propio trabajo
+    // en paralelo (respaldo, carga, agrupaciones).
+    template <typename Resultado, typename Calcular, typename Juntar>
+    void juntarSucursales(Calcular calcular, Juntar juntar) {
+        size_t hilos = min(sucursales.size(), hilosDisponibles());
+        size_t porSucursal = hilosDisponibles() / max<size_t>(hilos, 1);
+        procesarTramosEnOrden<Resultado>(sucursales.size(), hilos,
+                                         [&](size_t idSucursal) {
+                                             PresupuestoHilos presupuesto(porSucursal);
+                                             Sucursal& sucursal = *sucursales[idSucursal];
+                                             lock_guard<mutex> bloqueo(sucursal.mutexSucursal);
+                                             return calcular(sucursal.gestor);
+                                         },
+                                         [&](size_t, Resultado&& resultado) { juntar(resultado); });
+    }
 
-            vector<Producto> productos;
-            for (int i = 0; i < numProductos; i++) {
-                string prodInfo = datos[3 + i];
-                stringstream ssProd(prodInfo);
-                string nombreProd, precioProd;
+    VentasPorGrupo juntarVentas(VentasPorGrupo (GestorPedidos::*agrupacion)() const) {
+        VentasPorGrupo ventas;
+        juntarSucursales<VentasPorGrupo>([&](GestorPedidos& gestor) { return (gestor.*agrupacion)(); },
+                                         [&](const VentasPorGrupo& deSucursal) { sumarVentas(ventas, deSucursal); });
+        return ventas;
+    }
 
-                getline(ssProd, nombreProd, ',');
-                getline(ssProd, precioProd, ',');
+public:
+    static string prefijoSucursal(const string& prefijoArchivos, size_t idSucursal) {
+        return prefijoArchivos + "sucursal" + to_string(idSucursal) + "_";
+    }
 
-                productos.push_back(Producto(nombreProd, stod(precioProd)));
-            }
+    // Las sucursales van de 0 a cantidadSucursales - 1; siempre hay al menos una
+    explicit GestorSucursales(size_t cantidadSucursales, const string& prefijoArchivos = "", bool usarJournal = true) {
+        for (size_t i = 0; i < max<size_t>(cantidadSucursales, 1); i++) {
+            sucursales.push_back(make_unique<Sucursal>(prefijoSucursal(prefijoArchivos, i), usarJournal));
+        }
+    }
 
-            double total = stod(datos[3 + numProductos]);
-            string fechaHora = datos[4 + numProductos];
-            bool urgente = (datos[5 + numProductos] == "1");
+    GestorSucursales(const GestorSucursales&) = delete;
+    GestorSucursales& operator=(const GestorSucursales&) = delete;
 
-            Pedido p(id, nombreCliente, productos, total, fechaHora, urgente);
-            pedidosPendientes.push(p);
-        }
+    size_t cantidadSucursales() const {
+        return sucursales.size();
+    }
 
-        // Cargar pedidos completados (en orden inverso para mantener la estructura de pila)
-        vector<Pedido> pedidosTmp;
+    bool existeSucursal(size_t idSucursal) const {
+        return idSucursal < sucursales.size();
+    }
 
-        while (getline(archivoCompletados, linea)) {
-            stringstream ss(linea);
-            string token;
-            vector<string> datos;
+    // Ejecuta operacion(gestor) con el mutex de la sucursal tomado y devuelve lo
+    // que devuelva. Los punteros a pedidos del gestor no deben salir de operacion.
+    template <typename Operacion>
+    auto conSucursal(size_t idSucursal, Operacion operacion) -> decltype(operacion(declval<GestorPedidos&>())) {
+        Sucursal& sucursal = *sucursales[idSucursal];
+        lock_guard<mutex> bloqueo(sucursal.mutexSucursal);
+        return operacion(sucursal.gestor);
+    }
 
-            while (getline(ss, token, '|')) {
-                datos.push_back(token);
-            }
+    // Los limites del historial y del respaldo son los mismos en todas
+    void configurarHistorial(size_t maximoPedidos, int64_t edadMaximaSegundos) {
+        for (size_t i = 0; i < sucursales.size(); i++) {
+            conSucursal(i, [&](GestorPedidos& gestor) { gestor.configurarHistorial(maximoPedidos, edadMaximaSegundos); });
+        }
+    }
 
-            if (datos.size() < 6) continue; // Formato inválido
+    void configurarRespaldo(bool asincrono, size_t cambios, int64_t segundos) {
+        for (size_t i = 0; i < sucursales.size(); i++) {
+            conSucursal(i, [&](GestorPedidos& gestor) { gestor.configurarRespaldo(asincrono, cambios, segundos); });
+        }
+    }
 
-            int id = stoi(datos[0]);
-            string nombreCliente = datos[1];
-            int numProductos = stoi(datos[2]);
+    bool registrarPedido(size_t idSucursal, Pedido pedido) {
+        return conSucursal(idSucursal, [&](GestorPedidos& gestor) { return gestor.registrarPedido(move(pedido)); });
+    }
 
-            vector<Producto> productos;
-            for (int i = 0; i < numProductos; i++) {
-                string prodInfo = datos[3 + i];
-                stringstream ssProd(prodInfo);
-                string nombreProd, precioProd;
+    bool procesarSiguiente(size_t idSucursal) {
+        return conSucursal(idSucursal, [](GestorPedidos& gestor) { return gestor.procesarSiguiente(); });
+    }
 
-                getline(ssProd, nombreProd, ',');
-                getline(ssProd, precioProd, ',');
+    bool eliminarPedidoPorId(size_t idSucursal, int id) {
+        return conSucursal(idSucursal, [&](GestorPedidos& gestor) { return gestor.eliminarPedidoPorId(id); });
+    }
 
-                productos.push_back(Producto(nombreProd, stod(precioProd)));
+    // Copia del pedido, tambien si ya esta archivado (como completado)
+    optional<Pedido> buscarPedido(size_t idSucursal, int id, EstadoPedido* estado = nullptr) {
+        return conSucursal(idSucursal, [&](GestorPedidos& gestor) {
+            const Pedido* pedido = gestor.obtenerPedido(id, estado);
+            if (pedido != nullptr) {
+                return optional<Pedido>(*pedido);
             }
+            if (estado != nullptr) {
+                *estado = EstadoPedido::Completado;
+            }
+            return gestor.buscarArchivado(id);
+        });
+    }
 
-            double total = stod(datos[3 + numProductos]);
-            string fechaHora = datos[4 + numProductos];
-            bool urgente = (datos[5 + numProductos] == "1");
-
-            Pedido p(id, nombreCliente, productos, total, fechaHora, urgente);
-            pedidosTmp.push_back(p);
+    size_t cantidadPendientes() {
+        size_t cantidad = 0;
+        for (size_t i = 0; i < sucursales.size(); i++) {
+            cantidad += conSucursal(i, [](GestorPedidos& gestor) { return gestor.cantidadPendientes(); });
         }
+        return cantidad;
+    }
 
-        // Cargar en la pila en orden inverso
-        for (int i = pedidosTmp.size() - 1; i >= 0; i--) {
-            pedidosCompletados.push(pedidosTmp[i]);
+    size_t cantidadCompletados() {
+        size_t cantidad = 0;
+        for (size_t i = 0; i < sucursales.size(); i++) {
+            cantidad += conSucursal(i, [](GestorPedidos& gestor) { return gestor.cantidadCompletados(); });
         }
+        return cantidad;
+    }
 
-        archivoPendientes.close();
-        archivoCompletados.close();
+    // Reportes de todas las sucursales juntas
+    ResumenFinanciero generarResumen() {
+        ResumenFinanciero resumen;
+        juntarSucursales<ResumenFinanciero>([](GestorPedidos& gestor) { return gestor.generarResumen(); },
+                                            [&](const ResumenFinanciero& deSucursal) {
+            resumen.cantidadPedidos += deSucursal.cantidadPedidos;
+            resumen.ingresoTotal += deSucursal.ingresoTotal;
+            if (resumen.unidadesVendidas.size() < deSucursal.unidadesVendidas.size()) {
+                resumen.unidadesVendidas.resize(deSucursal.unidadesVendidas.size(), 0);
+            }
+            for (size_t id = 0; id < deSucursal.unidadesVendidas.size(); id++) {
+                resumen.unidadesVendidas[id] += deSucursal.unidadesVendidas[id];
+            }
+        });
+        return resumen;
+    }
 
-        cout << "\nPedidos cargados correctamente desde archivos.\n";
+    ResumenRango resumenEntre(int64_t desde, int64_t hasta) {
+        ResumenRango total;
+        juntarSucursales<ResumenRango>([&](GestorPedidos& gestor) { return gestor.resumenEntre(desde, hasta); },
+                                       [&](const ResumenRango& deSucursal) {
+            total.cantidadPedidos += deSucursal.cantidadPedidos;
+            total.ingresoTotal += deSucursal.ingresoTotal;
+        });
+        return total;
     }
 
-    void verPedidosGuardados() {
-        ifstream archivoPendientes("pedidos_pendientes.txt");
-        ifstream archivoCompletados("pedidos_completados.txt");
+    VentasPorGrupo ventasPorProducto() {
+        return juntarVentas(&GestorPedidos::ventasPorProducto);
+    }
 
-        if (!archivoPendientes.is_open() || !archivoCompletados.is_open()) {
-            cout << "\nNo se encontraron archivos de pedidos para visualizar o hubo un error al abrirlos.\n";
-            return;
-        }
+    VentasPorGrupo ventasPorHora() {
+        return juntarVentas(&GestorPedidos::ventasPorHora);
+    }
 
-        cout << "\n--- PEDIDOS GUARDADOS EN ARCHIVOS ---\n";
+    VentasPorGrupo ventasPorUrgencia() {
+        return juntarVentas(&GestorPedidos::ventasPorUrgencia);
+    }
 
-        // Mostrar pedidos pendientes
-        cout << "\nPEDIDOS PENDIENTES:\n";
-        string linea;
-        int contador = 1;
+    VentasPorGrupo ventasPorCliente() {
+        return juntarVentas(&GestorPedidos::ventasPorCliente);
+    }
 
-        while (getline(archivoPendientes, linea)) {
-            stringstream ss(linea);
-            string token;
-            vector<string> datos;
+    // Guarda todas las sucursales en paralelo. Devuelve false si alguna no se pudo escribir.
+    bool guardar() {
+        bool guardadas = true;
+        juntarSucursales<bool>([](GestorPedidos& gestor) { return gestor.guardar(); },
+                               [&](bool guardada) { guardadas = guardadas && guardada; });
+        return guardadas;
+    }
 
-            while (getline(ss, token, '|')) {
-                datos.push_back(token);
+    // Carga todas las sucursales en paralelo y suma sus resultados. Falta de
+    // archivos solo si no hay ninguno; un error en cualquiera (el de la primera
+    // sucursal con error) es el error de todas.
+    ResultadoCarga cargar() {
+        ResultadoCarga total;
+        total.estado = EstadoCarga::SinArchivos;
+        size_t productosRechazados = CatalogoProductos::global().nombresRechazados();
+        size_t clientesRechazados = RegistroClientes::global().nombresRechazados();
+        juntarSucursales<ResultadoCarga>([](GestorPedidos& gestor) { return gestor.cargar(); },
+                                         [&](const ResultadoCarga& deSucursal) {
+            bool hayError = total.estado == EstadoCarga::RespaldoDanado || total.estado == EstadoCarga::ErrorLectura;
+            if (!hayError && deSucursal.estado != EstadoCarga::SinArchivos) {
+                total.estado = deSucursal.estado;
             }
+            total.duplicados += deSucursal.duplicados;
+            total.eventosAplicados += deSucursal.eventosAplicados;
+            total.colaIncompleta = total.colaIncompleta || deSucursal.colaIncompleta;
+            total.totalesIncorrectos.insert(total.totalesIncorrectos.end(), deSucursal.totalesIncorrectos.begin(),
+                                            deSucursal.totalesIncorrectos.end());
+            total.preciosDistintosAlCatalogo += deSucursal.preciosDistintosAlCatalogo;
+            total.fechasInvalidas.insert(total.fechasInvalidas.end(), deSucursal.fechasInvalidas.begin(),
+                                         deSucursal.fechasInvalidas.end());
+        });
+        // Las sucursales cargan a la vez y cada una ve tambien lo de las otras
+        total.productosSinLugar = CatalogoProductos::global().nombresRechazados() - productosRechazados;
+        total.clientesSinLugar = RegistroClientes::global().nombresRechazados() - clientesRechazados;
+        return total;
+    }
+};
 
-            if (datos.size() < 6) continue; // Formato inválido
-
-            int id = stoi(datos[0]);
-            string nombreCliente = datos[1];
-            int numProductos = stoi(datos[2]);
+// Segundos que tarda operacion()
+template <typename Funcion>
+double medirSegundos(Funcion operacion) {
+    auto inicio = chrono::steady_clock::now();
+    operacion();
+    return chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+}
+
+// Valor en la posicion fraccion (0 a 1) de valores ordenados
+double percentil(vector<int64_t> valores, double fraccion) {
+    if (valores.empty()) {
+        return 0.0;
+    }
+    size_t posicion = min(valores.size() - 1, static_cast<size_t>(fraccion * valores.size()));
+    nth_element(valores.begin(), valores.begin() + posicion, valores.end());
+    return static_cast<double>(valores[posicion]);
+}
+
+// Lineas de un pedido sintetico para benchmarks y pruebas: de 1 a 4 productos
+// del menu al azar con su precio. Deja en total la suma.
+LineasPedido productosAlAzar(mt19937& generador, Dinero& total) {
+    const CatalogoProductos& catalogo = CatalogoProductos::global();
+    LineasPedido productos;
+    total = Dinero();
+    size_t numProductos = 1 + generador() % 4;
+    for (size_t j = 0; j < numProductos; j++) {
+        uint16_t id = static_cast<uint16_t>(generador() % catalogo.tamanoMenu());
+        productos.push_back(Producto(id, catalogo.precio(id)));
+        total += catalogo.precio(id);
+    }
+    return productos;
+}
+
+// Pedido sintetico de uno de 5000 clientes registrado en instante
+Pedido pedidoAlAzar(mt19937& generador, int id, bool urgente, int64_t instante) {
+    Dinero total;
+    LineasPedido productos = productosAlAzar(generador, total);
+    return Pedido(id, "Cliente " + to_string(generador() % 5000), move(productos), total, instante, urgente);
+}
+
+// Lo mismo registrado ahora; el constructor calcula el total y la fecha
+Pedido pedidoAlAzar(mt19937& generador, int id, bool urgente) {
+    Dinero total;
+    LineasPedido productos = productosAlAzar(generador, total);
+    return Pedido(id, "Cliente " + to_string(generador() % 5000), move(productos), urgente);
+}
+
+// Mide guardar y cargar con el formato de texto y con el respaldo binario
+void ejecutarBenchmarkSnapshot(size_t cantidad) {
+    const string prefijo = "bench_";
+    GestorPedidos gestor(prefijo, false);
+
+    mt19937 generador(12345);
+    for (size_t i = 0; i < cantidad; i++) {
+        gestor.registrarPedido(pedidoAlAzar(generador, static_cast<int>(i + 1), i % 10 == 0));
+    }
+    // Dejar un 20% de pedidos pendientes
+    while (gestor.cantidadPendientes() > cantidad / 5) {
+        gestor.procesarSiguiente();
+    }
 
-            vector<Producto> productos;
-            for (int i = 0; i < numProductos; i++) {
-                string prodInfo = datos[3 + i];
-                stringstream ssProd(prodInfo);
-                string nombreProd, precioProd;
+    auto tamanoArchivo = [](const string& ruta) {
+        ifstream archivo(ruta, ios::binary | ios::ate);
+        return archivo.is_open() ? static_cast<double>(archivo.tellg()) : 0.0;
+    };
+
+    // Sin los mensajes del menu, que no son parte de guardar ni de cargar
+    remove((prefijo + "pedidos.dat").c_str());
+    bool correcto = true;
+    double guardarTexto = medirSegundos([&] { correcto = gestor.exportarTexto() && correcto; });
+    double bytesTexto = tamanoArchivo(prefijo + "pedidos_pendientes.txt") + tamanoArchivo(prefijo + "pedidos_completados.txt");
+    double cargarTexto = medirSegundos([&] { correcto = gestor.cargar().estado == EstadoCarga::Correcta && correcto; });
+
+    double guardarBinario = medirSegundos([&] { correcto = gestor.guardar() && correcto; });
+    double bytesBinario = tamanoArchivo(prefijo + "pedidos.dat");
+    double cargarBinario = medirSegundos([&] { correcto = gestor.cargar().estado == EstadoCarga::Correcta && correcto; });
+    correcto = correcto && gestor.cantidadPendientes() + gestor.cantidadCompletados() == cantidad;
+
+    auto imprimir = [&](const string& nombre, double segundos, double bytes) {
+        cout << left << setw(18) << nombre << right << fixed << setprecision(3) << setw(10) << segundos << " s"
+             << setw(14) << setprecision(0) << (cantidad / segundos) << " pedidos/s"
+             << setw(10) << setprecision(1) << (bytes / segundos / 1e6) << " MB/s" << endl;
+    };
+
+    cout << "\n--- BENCHMARK DE RESPALDO (" << cantidad << " pedidos) ---\n";
+    imprimir("Guardar texto", guardarTexto, bytesTexto);
+    imprimir("Cargar texto", cargarTexto, bytesTexto);
+    imprimir("Guardar binario", guardarBinario, bytesBinario);
+    imprimir("Cargar binario", cargarBinario, bytesBinario);
+    cout << "Resultado: " << (correcto ? "OK" : "ERROR") << endl;
+
+    remove((prefijo + "pedidos.dat").c_str());
+    remove((prefijo + "pedidos_pendientes.txt").c_str());
+    remove((prefijo + "pedidos_completados.txt").c_str());
+}
+
+// Compara la latencia de registrar y procesar sin respaldo, con el respaldo
+// normal (todo en el hilo que atiende) y durante un respaldo en segundo plano
+// de un historial de `cantidad` pedidos
+void ejecutarBenchmarkRespaldoAsincrono(size_t cantidad) {
+    const string prefijo = "bench_";
+    GestorPedidos gestor(prefijo, false);
+    gestor.configurarHistorial(0, 0);
+
+    mt19937 generador(12345);
+    int siguienteId = 1;
+    auto nuevoPedido = [&] { return pedidoAlAzar(generador, siguienteId++, false); };
+    // En el mostrador la cola es corta; casi todo es historial
+    const size_t PENDIENTES = 100;
+    for (size_t i = 0; i < cantidad; i++) {
+        gestor.registrarPedido(nuevoPedido());
+        if (i >= PENDIENTES) {
+            gestor.procesarSiguiente();
+        }
+    }
 
-                getline(ssProd, nombreProd, ',');
-                getline(ssProd, precioProd, ',');
+    // Cada muestra es un pedido registrado y otro procesado, en nanosegundos
+    auto registrarYProcesar = [&](vector<int64_t>& latencias) {
+        Pedido pedido = nuevoPedido();
+        auto inicio = chrono::steady_clock::now();
+        gestor.registrarPedido(move(pedido));
+        gestor.procesarSiguiente();
+        latencias.push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - inicio).count());
+    };
+    auto imprimir = [&](const string& nombre, const vector<int64_t>& latencias) {
+        cout << left << setw(24) << nombre << right << setw(10) << latencias.size() << " ops | p50 " << fixed << setprecision(2)
+             << percentil(latencias, 0.50) / 1000 << " us | p99 " << percentil(latencias, 0.99) / 1000 << " us | p99.9 "
+             << percentil(latencias, 0.999) / 1000 << " us | maxima " << setprecision(0) << percentil(latencias, 1.0) / 1000
+             << " us" << endl;
+    };
+
+    const size_t MUESTRAS = 200000;
+    vector<int64_t> sinRespaldo;
+    for (size_t i = 0; i < MUESTRAS; i++) {
+        registrarYProcesar(sinRespaldo);
+    }
 
-                productos.push_back(Producto(nombreProd, stod(precioProd)));
+    auto inicio = chrono::steady_clock::now();
+    bool guardado = gestor.guardar();
+    double pausaNormal = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+    // El primer respaldo en segundo plano reserva la memoria de la foto; se mide el siguiente
+    guardado = gestor.guardarEnSegundoPlano() && gestor.esperarRespaldo() && guardado;
+    inicio = chrono::steady_clock::now();
+    guardado = gestor.guardarEnSegundoPlano() && guardado;
+    double pausaFoto = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+    vector<int64_t> duranteRespaldo;
+    while (gestor.respaldoEnCurso()) {
+        registrarYProcesar(duranteRespaldo);
+    }
+    double duracionRespaldo = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+    guardado = gestor.esperarRespaldo() && guardado;
+
+    ifstream respaldo(prefijo + "pedidos.dat", ios::binary | ios::ate);
+    double megabytes = respaldo.is_open() ? static_cast<double>(respaldo.tellg()) / 1e6 : 0.0;
+
+    cout << "\n--- BENCHMARK DE RESPALDO EN SEGUNDO PLANO (" << cantidad << " pedidos, " << fixed << setprecision(1)
+         << megabytes << " MB) ---\n";
+    cout << "Respaldo normal: el hilo que atiende queda detenido " << setprecision(3) << pausaNormal << " s\n";
+    cout << "En segundo plano: pausa para fijar la foto " << pausaFoto * 1000 << " ms, respaldo completo en "
+         << duracionRespaldo << " s\n";
+    cout << "Registrar y procesar un pedido:\n";
+    imprimir("  sin respaldo", sinRespaldo);
+    imprimir("  durante el respaldo", duranteRespaldo);
+    cout << "Respaldos: " << (guardado ? "OK" : "ERROR") << endl;
+
+    remove((prefijo + "pedidos.dat").c_str());
+}
+
+// Mide la exportacion de un respaldo con `cantidad` pedidos de 30 dias, la
+// mitad archivada en segmentos, contra leer los mismos archivos sin
+// interpretarlos y contra cargarlos en memoria
+void ejecutarBenchmarkExportacion(size_t cantidad) {
+    const string prefijo = "bench_exportar_";
+    const CatalogoProductos& catalogo = CatalogoProductos::global();
+    mt19937 generador(12345);
+    int64_t ahora = static_cast<int64_t>(time(nullptr));
+    const int64_t DURACION = 30 * 86400;
+    {
+        GestorPedidos gestor(prefijo, false);
+        gestor.configurarHistorial(cantidad / 2, 0);
+        for (size_t i = 0; i < cantidad; i++) {
+            bool urgente = generador() % 10 == 0;
+            int64_t instante = ahora - DURACION + static_cast<int64_t>(i * DURACION / cantidad);
+            gestor.registrarPedido(pedidoAlAzar(generador, static_cast<int>(i + 1), urgente, instante));
+            if (i >= 100) {
+                gestor.procesarSiguiente();
             }
+        }
+        gestor.guardar();
+    }
 
-            double total = stod(datos[3 + numProductos]);
-            string fechaHora = datos[4 + numProductos];
-            bool urgente = (datos[5 + numProductos] == "1");
+    HistorialArchivado nombres(prefijo);
+    vector<string> archivos = { prefijo + "pedidos.dat" };
+    for (uint32_t numero = 1; filesystem::exists(nombres.rutaSegmento(numero)); numero++) {
+        archivos.push_back(nombres.rutaSegmento(numero));
+    }
 
-            Pedido p(id, nombreCliente, productos, total, fechaHora, urgente);
-            cout << contador << ". " << p.toString() << endl << endl;
-            contador++;
+    // Referencia: leer los archivos de corrido sin mirar lo que dicen
+    double megabytes = 0;
+    vector<char> bloque(1 << 20);
+    double segundosLectura = medirSegundos([&] {
+        for (const string& ruta : archivos) {
+            FILE* archivo = fopen(ruta.c_str(), "rb");
+            size_t leidos;
+            while (archivo != nullptr && (leidos = fread(bloque.data(), 1, bloque.size(), archivo)) > 0) {
+                megabytes += leidos / 1e6;
+            }
+            if (archivo != nullptr) {
+                fclose(archivo);
+            }
         }
-
-        if (contador == 1) {
-            cout << "No hay pedidos pendientes guardados.\n";
+    });
+
+    cout << "\n--- BENCHMARK DE EXPORTACION (" << cantidad << " pedidos, " << archivos.size() - 1 << " segmentos, " << fixed
+         << setprecision(1) << megabytes << " MB guardados) ---\n";
+    cout << left << setw(34) << "Leer los archivos sin interpretar" << right << setw(12) << "" << setw(10) << setprecision(3)
+         << segundosLectura << " s | " << setw(7) << setprecision(0) << megabytes / segundosLectura << " MB/s\n";
+
+    GestorPedidos gestor(prefijo, false);
+    bool correcto = true;
+    string rutaSalida = prefijo + "salida.txt";
+    auto exportar = [&](const string& nombre, bool enMemoria, FormatoExportacion formato, const FiltroExportacion& filtro) {
+        ResultadoExportacion resultado;
+        double segundos = medirSegundos([&] {
+            resultado = enMemoria ? gestor.exportarEnMemoria(formato, filtro, rutaSalida) : gestor.exportarGuardados(formato, filtro, rutaSalida);
+        });
+        correcto = correcto && resultado.estado == EstadoExportacion::Correcta;
+        cout << left << setw(34) << nombre << right << setw(10) << resultado.filas << " filas " << setw(8) << setprecision(3) << segundos
+             << " s | " << setw(7) << setprecision(0) << megabytes / segundos << " MB/s leidos | " << setprecision(1)
+             << resultado.bytes / 1e6 << " MB escritos";
+        if (resultado.segmentosSaltados > 0) {
+            cout << " | " << resultado.segmentosSaltados << " segmentos saltados";
+        }
+        cout << "\n";
+    };
+
+    FiltroExportacion todos;
+    exportar("CSV", false, FormatoExportacion::Csv, todos);
+    exportar("JSON Lines", false, FormatoExportacion::JsonLines, todos);
+
+    FiltroExportacion recientesUrgentes;
+    recientesUrgentes.desde = ahora - 3 * 86400;
+    recientesUrgentes.urgencia = 1;
+    exportar("CSV urgentes de 3 dias", false, FormatoExportacion::Csv, recientesUrgentes);
+
+    FiltroExportacion unCliente;
+    unCliente.cliente = "Cliente 42";
+    exportar("CSV de un cliente", false, FormatoExportacion::Csv, unCliente);
+
+    FiltroExportacion unProducto;
+    unProducto.producto = catalogo.nombre(0);
+    exportar("CSV de un producto", false, FormatoExportacion::Csv, unProducto);
+
+    double segundosCarga = medirSegundos([&] { correcto = gestor.cargar().estado == EstadoCarga::Correcta && correcto; });
+    cout << left << setw(34) << "Cargar en memoria (arma pedidos)" << right << setw(10) << gestor.cantidadCompletados() + gestor.cantidadPendientes()
+         << " filas " << setw(8) << setprecision(3) << segundosCarga << " s\n";
+    exportar("CSV desde memoria", true, FormatoExportacion::Csv, todos);
+    cout << "Exportaciones: " << (correcto ? "OK" : "ERROR") << endl;
+
+    remove(rutaSalida.c_str());
+    for (const string& ruta : archivos) {
+        remove(ruta.c_str());
+    }
+}
+
+// Mide pedidos registrados y procesados por segundo con un hilo por sucursal,
+// de 1 sucursal hasta maximoSucursales, y los reportes que suman todas. Cada
+// vuelta reparte los mismos `cantidad` pedidos entre las sucursales. Devuelve
+// false si los totales no coinciden.
+bool ejecutarBenchmarkSucursales(size_t cantidad, size_t maximoSucursales) {
+    maximoSucursales = max<size_t>(maximoSucursales, 1);
+    vector<size_t> vueltas;
+    for (size_t sucursales = 1; sucursales < maximoSucursales; sucursales *= 2) {
+        vueltas.push_back(sucursales);
+    }
+    vueltas.push_back(maximoSucursales);
+
+    cout << "\n--- BENCHMARK DE SUCURSALES (" << cantidad << " pedidos, " << thread::hardware_concurrency() << " hilos de hardware) ---\n";
+    bool correcto = true;
+    double pedidosPorSegundoBase = 0;
+    for (size_t cantidadSucursales : vueltas) {
+        GestorSucursales gestor(cantidadSucursales, "bench_sucursales_", false);
+
+        // Los pedidos se arman antes para medir solo al gestor
+        vector<vector<Pedido>> porSucursal(cantidadSucursales);
+        mt19937 generador(12345);
+        for (size_t i = 0; i < cantidad; i++) {
+            porSucursal[i % cantidadSucursales].push_back(
+                pedidoAlAzar(generador, static_cast<int>(i / cantidadSucursales + 1), i % 10 == 0));
         }
 
-        // Mostrar pedidos completados
-        cout << "\nPEDIDOS COMPLETADOS:\n";
-        contador = 1;
+        // Como en un dia normal queda un 20% pendiente
+        auto inicio = chrono::steady_clock::now();
+        vector<thread> hilos;
+        for (size_t s = 0; s < cantidadSucursales; s++) {
+            hilos.emplace_back([&, s] {
+                vector<Pedido>& pedidos = porSucursal[s];
+                for (size_t i = 0; i < pedidos.size(); i++) {
+                    gestor.registrarPedido(s, move(pedidos[i]));
+                    if (i % 5 != 0) {
+                        gestor.procesarSiguiente(s);
+                    }
+                }
+            });
+        }
+        for (thread& hilo : hilos) {
+            hilo.join();
+        }
+        double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+        inicio = chrono::steady_clock::now();
+        ResumenFinanciero resumen = gestor.generarResumen();
+        VentasPorGrupo porProducto = gestor.ventasPorProducto();
+        VentasPorGrupo porHora = gestor.ventasPorHora();
+        double segundosReporte = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+        long long unidades = accumulate(resumen.unidadesVendidas.begin(), resumen.unidadesVendidas.end(), 0LL);
+        long long unidadesPorProducto = accumulate(porProducto.cantidad.begin(), porProducto.cantidad.end(), 0LL);
+        long long pedidosPorHora = accumulate(porHora.cantidad.begin(), porHora.cantidad.end(), 0LL);
+        correcto = correcto && gestor.cantidadPendientes() + gestor.cantidadCompletados() == cantidad &&
+                   resumen.cantidadPedidos == gestor.cantidadCompletados() && unidades == unidadesPorProducto &&
+                   static_cast<size_t>(pedidosPorHora) == resumen.cantidadPedidos;
+
+        double pedidosPorSegundo = cantidad / segundos;
+        if (pedidosPorSegundoBase == 0) {
+            pedidosPorSegundoBase = pedidosPorSegundo;
+        }
+        cout << "Sucursales: " << setw(3) << cantidadSucursales << " | " << fixed << setprecision(3) << segundos << " s | "
+             << setprecision(0) << setw(10) << pedidosPorSegundo << " pedidos/s | x" << setprecision(2)
+             << (pedidosPorSegundo / pedidosPorSegundoBase) << " | reporte sumado " << setprecision(1)
+             << segundosReporte * 1000 << " ms" << endl;
+    }
+    cout << "Totales: " << (correcto ? "OK" : "NO COINCIDEN") << endl;
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+    return correcto;
+}
+
+// Mide las agrupaciones del historial por columnas con al menos cantidadLineas
+// lineas de pedido sinteticas repartidas en 30 dias
+void ejecutarBenchmarkColumnar(size_t cantidadLineas) {
+    HistorialColumnar columnas;
+    mt19937 generador(12345);
+    int64_t inicio = static_cast<int64_t>(time(nullptr)) - 30 * 86400;
+
+    for (int id = 1; columnas.cantidadLineas() < cantidadLineas; id++) {
+        Dinero total;
+        LineasPedido productos = productosAlAzar(generador, total);
+        columnas.agregar(Pedido(id, "Cliente " + to_string(generador() % 50000), move(productos), total,
+                                inicio + generador() % (30 * 86400), generador() % 10 == 0));
+    }
 
-        while (getline(archivoCompletados, linea)) {
-            stringstream ss(linea);
-            string token;
-            vector<string> datos;
+    // Se compara la suma de cada agrupacion contra las demas para no medir codigo descartado
+    VentasPorGrupo productosVendidos, horas, clientes, urgencia;
+    double segundosProducto = medirSegundos([&] { productosVendidos = columnas.porProducto(); });
+    double segundosHora = medirSegundos([&] { horas = columnas.porHora(); });
+    double segundosCliente = medirSegundos([&] { clientes = columnas.porCliente(); });
+    double segundosUrgencia = medirSegundos([&] { urgencia = columnas.porUrgencia(); });
+
+    auto sumar = [](const VentasPorGrupo& ventas) {
+        Dinero suma;
+        for (Dinero ingreso : ventas.ingreso) {
+            suma += ingreso;
+        }
+        return suma;
+    };
+    bool coincide = sumar(productosVendidos) == sumar(horas) && sumar(horas) == sumar(clientes) &&
+                    sumar(clientes) == sumar(urgencia);
+
+    auto imprimir = [](const string& nombre, double segundos, size_t filas) {
+        cout << left << setw(22) << nombre << right << fixed << setprecision(3) << setw(8) << segundos << " s"
+             << setw(16) << setprecision(0) << (filas / segundos) << " filas/s" << endl;
+    };
+
+    cout << "\n--- BENCHMARK DE ANALISIS (" << columnas.size() << " pedidos, " << columnas.cantidadLineas()
+         << " lineas, " << max(1u, thread::hardware_concurrency()) << " hilos) ---\n";
+    imprimir("Por producto (lineas)", segundosProducto, columnas.cantidadLineas());
+    imprimir("Por hora", segundosHora, columnas.size());
+    imprimir("Por cliente", segundosCliente, columnas.size());
+    imprimir("Urgentes/normales", segundosUrgencia, columnas.size());
+    cout << "Ingreso total: Q" << sumar(urgencia) << (coincide ? "" : " (las agrupaciones no coinciden)") << endl;
+}
+
+// Memoria residente actual y maxima del proceso en MB (0 donde no se puede leer)
+void medirMemoria(double& actualMb, double& maximaMb) {
+    actualMb = maximaMb = 0.0;
+#ifndef _WIN32
+    ifstream estado("/proc/self/statm");
+    size_t paginasTotales = 0, paginasResidentes = 0;
+    if (estado >> paginasTotales >> paginasResidentes) {
+        actualMb = paginasResidentes * static_cast<double>(sysconf(_SC_PAGESIZE)) / 1e6;
+    }
+    struct rusage uso;
+    if (getrusage(RUSAGE_SELF, &uso) == 0) {
+#ifdef __APPLE__
+        maximaMb = uso.ru_maxrss / 1e6;  // bytes
+#else
+        maximaMb = uso.ru_maxrss / 1e3;  // KB
+#endif
+    }
+#endif
+}
+
+// Procesa cantidad pedidos con a lo sumo maximoEnMemoria en el historial y
+// muestra la memoria a medida que el resto pasa al archivo. Al final compara
+// el reporte con los totales esperados, busca IDs archivados y recarga.
+void ejecutarBenchmarkHistorial(size_t cantidad, size_t maximoEnMemoria) {
+    const string prefijo = "bench_hist_";
+    mt19937 generador(12345);
+    Dinero ingresoEsperado;
+    double actualMb, maximaMb;
+
+    cout << "\n--- BENCHMARK DE HISTORIAL ARCHIVADO (" << cantidad << " pedidos, " << maximoEnMemoria << " en memoria) ---\n";
+    GestorPedidos gestor(prefijo, false);
+    gestor.configurarHistorial(maximoEnMemoria, 0);
+
+    size_t paso = max<size_t>(1, cantidad / 10);
+    double segundos = medirSegundos([&] {
+        for (size_t i = 0; i < cantidad; i++) {
+            Pedido pedido = pedidoAlAzar(generador, static_cast<int>(i + 1), i % 10 == 0);
+            ingresoEsperado += pedido.getTotal();
+            gestor.registrarPedido(move(pedido));
+            gestor.procesarSiguiente();
+
+            if ((i + 1) % paso == 0) {
+                medirMemoria(actualMb, maximaMb);
+                cout << setw(12) << (i + 1) << " procesados | en memoria: " << setw(9) << (gestor.cantidadCompletados() - gestor.cantidadArchivados())
+                     << " | archivados: " << setw(11) << gestor.cantidadArchivados() << " | RSS: " << fixed << setprecision(1)
+                     << actualMb << " MB (max " << maximaMb << " MB)" << endl;
+            }
+        }
+    });
+    cout << "Procesar: " << fixed << setprecision(3) << segundos << " s, " << setprecision(0) << (cantidad / segundos) << " pedidos/s\n";
+
+    ResumenFinanciero resumen = gestor.generarResumen();
+    bool correcto = resumen.cantidadPedidos == cantidad && resumen.ingresoTotal == ingresoEsperado &&
+                    gestor.resumenEntre(0, numeric_limits<int64_t>::max()).ingresoTotal == ingresoEsperado;
+
+    const size_t BUSQUEDAS = 1000;
+    uniform_int_distribution<int> ids(1, static_cast<int>(cantidad));
+    size_t encontrados = 0;
+    segundos = medirSegundos([&] {
+        for (size_t i = 0; i < BUSQUEDAS; i++) {
+            int id = ids(generador);
+            encontrados += (gestor.obtenerPedido(id) != nullptr || gestor.buscarArchivado(id)) ? 1 : 0;
+        }
+    });
+    correcto = correcto && encontrados == BUSQUEDAS;
+    cout << "Buscar por ID: " << setprecision(1) << (segundos * 1e6 / BUSQUEDAS) << " us por busqueda\n";
+
+    double guardar = medirSegundos([&] { gestor.guardar(); });
+    double cargar = medirSegundos([&] { gestor.cargar(); });
+    correcto = correcto && gestor.generarResumen().ingresoTotal == ingresoEsperado;
+    medirMemoria(actualMb, maximaMb);
+    cout << "Guardar: " << setprecision(3) << guardar << " s | Cargar: " << cargar << " s | RSS: " << setprecision(1)
+         << actualMb << " MB (max " << maximaMb << " MB)\n";
+    cout << "Totales: " << (correcto ? "OK" : "NO COINCIDEN") << endl;
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+
+    for (uint32_t numero : gestor.historialArchivado().numeros()) {
+        remove(gestor.historialArchivado().rutaSegmento(numero).c_str());
+    }
+    remove((prefijo + "pedidos.dat").c_str());
+}
+
+// Simula una cocina que prepara un pedido a la vez con llegadas al azar y
+// compara la espera de urgentes y normales atendiendo en orden de llegada
+// contra el planificador por limite de atencion.
+void ejecutarSimulacionPlanificador(double llegadasPorMinuto, double fraccionUrgentes, size_t cantidad) {
+    const double PREPARACION_PROMEDIO = 45.0; // segundos por pedido
+
+    mt19937 generador(7);
+    exponential_distribution<double> entreLlegadas(llegadasPorMinuto / 60.0);
+    exponential_distribution<double> preparacion(1.0 / PREPARACION_PROMEDIO);
+    bernoulli_distribution esUrgente(fraccionUrgentes);
+
+    // Los tiempos de la simulacion van en milisegundos
+    vector<int64_t> llegadas(cantidad);
+    vector<int64_t> duraciones(cantidad);
+    vector<bool> urgentes(cantidad);
+    double reloj = 0.0;
+    for (size_t i = 0; i < cantidad; i++) {
+        reloj += entreLlegadas(generador);
+        llegadas[i] = static_cast<int64_t>(reloj * 1000);
+        duraciones[i] = static_cast<int64_t>(preparacion(generador) * 1000);
+        urgentes[i] = esUrgente(generador);
+    }
 
-            while (getline(ss, token, '|')) {
-                datos.push_back(token);
+    cout << "\n--- SIMULACION DEL PLANIFICADOR (" << cantidad << " pedidos) ---\n";
+    cout << "Llegadas por minuto: " << fixed << setprecision(2) << llegadasPorMinuto
+         << " | Urgentes: " << setprecision(0) << (fraccionUrgentes * 100) << "%"
+         << " | Preparacion promedio: " << PREPARACION_PROMEDIO << " s"
+         << " | Ocupacion: " << (llegadasPorMinuto * PREPARACION_PROMEDIO / 60.0 * 100) << "%" << endl;
+
+    for (int politica = 0; politica < 2; politica++) {
+        bool porLimite = (politica == 1);
+        PlanificadorPedidos cola;
+        vector<int64_t> esperas[2];
+        int64_t ahora = 0;
+        size_t siguiente = 0;
+
+        auto inicio = chrono::steady_clock::now();
+        while (siguiente < cantidad || !cola.empty()) {
+            if (cola.empty() && ahora < llegadas[siguiente]) {
+                ahora = llegadas[siguiente];
+            }
+            while (siguiente < cantidad && llegadas[siguiente] <= ahora) {
+                int64_t limite = llegadas[siguiente];
+                if (porLimite) {
+                    limite += limiteAtencion(0, urgentes[siguiente]) * 1000;
+                }
+                cola.encolar(Pedido(static_cast<int>(siguiente), string(), LineasPedido(), Dinero(), 0, urgentes[siguiente]), limite);
+                siguiente++;
             }
 
-            if (datos.size() < 6) continue; // Formato inválido
+            Pedido pedido = cola.desencolar();
+            size_t id = static_cast<size_t>(pedido.getId());
+            esperas[pedido.esUrgente() ? 0 : 1].push_back(ahora - llegadas[id]);
+            ahora += duraciones[id];
+        }
+        double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+        cout << "\n" << (porLimite ? "Planificador por limite" : "Orden de llegada") << " ("
+             << setprecision(0) << (2 * cantidad / segundos) << " operaciones de cola/s)\n";
+        const char* nombres[2] = { "Urgentes", "Normales" };
+        for (int clase = 0; clase < 2; clase++) {
+            vector<int64_t>& lista = esperas[clase];
+            int64_t maximo = lista.empty() ? 0 : *max_element(lista.begin(), lista.end());
+            cout << "  " << nombres[clase] << " (" << lista.size() << "): espera p50 " << setprecision(1)
+                 << percentil(lista, 0.50) / 1000 << " s | p99 " << percentil(lista, 0.99) / 1000 << " s | maxima "
+                 << (maximo / 1000.0) << " s" << endl;
+        }
+    }
+}
+
+// Respuestas de error del modo por lotes; cada una suma a errores
+void responderErrorLote(SalidaBuffer& salida, size_t& errores, string_view comando, string_view motivo) {
+    salida.texto("error").campo(comando).campo(motivo).terminarLinea();
+    errores++;
+}
+
+void responderErrorLote(SalidaBuffer& salida, size_t& errores, string_view comando, int id, string_view motivo) {
+    salida.texto("error").campo(comando).campo(id).campo(motivo).terminarLinea();
+    errores++;
+}
+
+// Comandos que solo usan totales y archivos (report, range, recent, group, save
+// y load). Gestor es un GestorPedidos o un GestorSucursales. Devuelve false si
+// el comando no es uno de estos.
+template <typename Gestor>
+bool ejecutarConsultaLote(Gestor& gestor, string_view comando, string_view linea, SalidaBuffer& salida, size_t& errores) {
+    const CatalogoProductos& catalogo = CatalogoProductos::global();
+
+    if (comando == "report") {
+        ResumenFinanciero resumen = gestor.generarResumen();
+        salida.texto("ok").campo(comando).campo(static_cast<int64_t>(resumen.cantidadPedidos)).campoDinero(resumen.ingresoTotal);
+        for (uint16_t id : GestorPedidos::productosVendidosPorNombre(resumen)) {
+            salida.campo(catalogo.nombre(id)).texto(",").numero(resumen.unidadesVendidas[id]);
+        }
+        salida.terminarLinea();
+    }
+    else if (comando == "range" || comando == "recent") {
+        int64_t desde, hasta;
+        string_view campoDesde;
+        if (comando == "range") {
+            if (!siguienteCampo(linea, '|', campoDesde) || !convertirNumero(campoDesde, desde) ||
+                !convertirNumero(linea, hasta)) {
+                responderErrorLote(salida, errores, comando, "formato");
+                return true;
+            }
+        }
+        else {
+            int64_t segundos;
+            if (!convertirNumero(linea, segundos) || segundos < 0) {
+                responderErrorLote(salida, errores, comando, "formato");
+                return true;
+            }
+            hasta = time(nullptr);
+            desde = hasta - segundos;
+        }
 
-            int id = stoi(datos[0]);
-            string nombreCliente = datos[1];
-            int numProductos = stoi(datos[2]);
+        ResumenRango resumen = gestor.resumenEntre(desde, hasta);
+        salida.texto("ok").campo(comando).campo(static_cast<int64_t>(resumen.cantidadPedidos))
+              .campoDinero(resumen.ingresoTotal).terminarLinea();
+    }
+    else if (comando == "group") {
+        VentasPorGrupo ventas;
+        if (linea == "producto") {
+            ventas = gestor.ventasPorProducto();
+        }
+        else if (linea == "hora") {
+            ventas = gestor.ventasPorHora();
+        }
+        else if (linea == "cliente") {
+            ventas = gestor.ventasPorCliente();
+        }
+        else if (linea == "urgencia") {
+            ventas = gestor.ventasPorUrgencia();
+        }
+        else {
+            responderErrorLote(salida, errores, comando, "formato");
+            return true;
+        }
 
-            vector<Producto> productos;
-            for (int i = 0; i < numProductos; i++) {
-                string prodInfo = datos[3 + i];
-                stringstream ssProd(prodInfo);
-                string nombreProd, precioProd;
+        // Un campo "clave,cantidad,ingreso" por grupo con ventas
+        salida.texto("ok").campo(comando).campo(linea);
+        for (size_t g = 0; g < ventas.cantidad.size(); g++) {
+            if (ventas.cantidad[g] == 0) {
+                continue;
+            }
+            if (linea == "producto") {
+                salida.campo(catalogo.nombre(static_cast<uint16_t>(g)));
+            }
+            else if (linea == "cliente") {
+                salida.campo(RegistroClientes::global().nombre(static_cast<uint32_t>(g)));
+            }
+            else if (linea == "urgencia") {
+                salida.campo(g == 1 ? "urgente" : "normal");
+            }
+            else {
+                salida.campo(static_cast<int64_t>(g));
+            }
+            salida.texto(",").numero(ventas.cantidad[g]).texto(",").dinero(ventas.ingreso[g]);
+        }
+        salida.terminarLinea();
+    }
+    else if (comando == "save") {
+        if (!gestor.guardar()) {
+            responderErrorLote(salida, errores, comando, "escritura");
+            return true;
+        }
+        salida.texto("ok").campo(comando).campo(static_cast<int64_t>(gestor.cantidadPendientes()))
+              .campo(static_cast<int64_t>(gestor.cantidadCompletados())).terminarLinea();
+    }
+    else if (comando == "load") {
+        ResultadoCarga resultado = gestor.cargar();
+        if (resultado.estado != EstadoCarga::Correcta) {
+            responderErrorLote(salida, errores, comando,
+                               resultado.estado == EstadoCarga::SinArchivos ? "sin_archivos" :
+                               resultado.estado == EstadoCarga::ErrorLectura ? "error_lectura" : "respaldo_danado");
+            return true;
+        }
+        salida.texto("ok").campo(comando).campo(static_cast<int64_t>(gestor.cantidadPendientes()))
+              .campo(static_cast<int64_t>(gestor.cantidadCompletados())).campo(resultado.duplicados)
+              .campo(static_cast<int64_t>(resultado.eventosAplicados))
+              .campo(static_cast<int64_t>(resultado.totalesIncorrectos.size()))
+              .campo(static_cast<int64_t>(resultado.preciosDistintosAlCatalogo))
+              .campo(static_cast<int64_t>(resultado.productosSinLugar))
+              .campo(static_cast<int64_t>(resultado.clientesSinLugar))
+              .campo(static_cast<int64_t>(resultado.fechasInvalidas.size())).terminarLinea();
+    }
+    else {
+        return false;
+    }
+    return true;
+}
 
-                getline(ssProd, nombreProd, ',');
-                getline(ssProd, precioProd, ',');
+// Ejecuta un comando (sin la sucursal) sobre un gestor y escribe su respuesta
+void ejecutarComandoLote(GestorPedidos& gestor, string_view comando, string_view linea, SalidaBuffer& salida, size_t& errores) {
+    const CatalogoProductos& catalogo = CatalogoProductos::global();
 
-                productos.push_back(Producto(nombreProd, stod(precioProd)));
-            }
+    if (ejecutarConsultaLote(gestor, comando, linea, salida, errores)) {
+        return;
+    }
 
-            double total = stod(datos[3 + numProductos]);
-            string fechaHora = datos[4 + numProductos];
-            bool urgente = (datos[5 + numProductos] == "1");
+    if (comando == "add") {
+        string_view campoId, cliente, campoUrgente, listaProductos;
+        int id;
+        if (!siguienteCampo(linea, '|', campoId) || !convertirNumero(campoId, id) ||
+            !siguienteCampo(linea, '|', cliente) || !siguienteCampo(linea, '|', campoUrgente) ||
+            (campoUrgente != "0" && campoUrgente != "1") || !siguienteCampo(linea, '|', listaProductos) ||
+            linea.data() != nullptr) {
+            // linea queda sin datos solo si no sobraron campos
+            responderErrorLote(salida, errores, comando, "formato");
+            return;
+        }
 
-            Pedido p(id, nombreCliente, productos, total, fechaHora, urgente);
-            cout << contador << ". " << p.toString() << endl << endl;
-            contador++;
+        if (!nombreClienteValido(cliente)) {
+            responderErrorLote(salida, errores, comando, id, "cliente_invalido");
+            return;
         }
 
-        if (contador == 1) {
-            cout << "No hay pedidos completados guardados.\n";
+        LineasPedido productos;
+        bool productosValidos = !listaProductos.empty();
+        string_view opcion;
+        while (productosValidos && siguienteCampo(listaProductos, ',', opcion)) {
+            int numero;
+            if (!convertirNumero(opcion, numero) || numero < 1 || numero > static_cast<int>(catalogo.tamanoMenu())) {
+                productosValidos = false;
+                break;
+            }
+            uint16_t idProducto = static_cast<uint16_t>(numero - 1);
+            productos.push_back(Producto(idProducto, catalogo.precio(idProducto)));
+        }
+        if (!productosValidos) {
+            responderErrorLote(salida, errores, comando, id, "producto_invalido");
+            return;
+        }
+        if (productos.size() > MAXIMO_LINEAS_PEDIDO) {
+            responderErrorLote(salida, errores, comando, id, "demasiados_productos");
+            return;
         }
 
-        archivoPendientes.close();
-        archivoCompletados.close();
+        if (!gestor.registrarPedido(Pedido(id, string(cliente), move(productos), campoUrgente == "1"))) {
+            responderErrorLote(salida, errores, comando, id, "id_repetido");
+            return;
+        }
+        salida.texto("ok").campo(comando).campo(id).campo(static_cast<int64_t>(gestor.cantidadPendientes())).terminarLinea();
+    }
+    else if (comando == "process") {
+        const Pedido* siguiente = gestor.siguientePendiente();
+        if (siguiente == nullptr) {
+            responderErrorLote(salida, errores, comando, "cola_vacia");
+            return;
+        }
+        int id = siguiente->getId();
+        gestor.procesarSiguiente();
+        salida.texto("ok").campo(comando).campo(id).terminarLinea();
     }
+    else if (comando == "find" || comando == "delete") {
+        int id;
+        if (!convertirNumero(linea, id)) {
+            responderErrorLote(salida, errores, comando, "formato");
+            return;
+        }
 
-    // Nueva función para eliminar pedidos guardados en archivos
-    void eliminarPedido() {
-        int opcion;
-        cout << "\nQue tipo de pedido desea eliminar?" << endl;
-        cout << "1. Pedido pendiente" << endl;
-        cout << "2. Pedido completado" << endl;
-        cout << "Ingrese opcion: ";
-        cin >> opcion;
+        if (comando == "delete") {
+            if (!gestor.eliminarPedidoPorId(id)) {
+                responderErrorLote(salida, errores, comando, id, "no_existe");
+                return;
+            }
+            salida.texto("ok").campo(comando).campo(id).terminarLinea();
+            return;
+        }
 
-        if (opcion != 1 && opcion != 2) {
-            cout << "\nOpcion invalida. Regresando al menu principal." << endl;
+        // Los que ya no estan en memoria se leen del archivo
+        EstadoPedido estado;
+        const Pedido* pedido = gestor.obtenerPedido(id, &estado);
+        optional<Pedido> archivado;
+        if (pedido == nullptr) {
+            archivado = gestor.buscarArchivado(id);
+            if (!archivado) {
+                responderErrorLote(salida, errores, comando, id, "no_existe");
+                return;
+            }
+            pedido = &*archivado;
+        }
+        salida.texto("ok").campo(comando).campo(id)
+              .campo(archivado ? "archivado" : estado == EstadoPedido::Pendiente ? "pendiente" : "completado")
+              .campo(pedido->getNombreCliente()).campo(pedido->esUrgente() ? 1 : 0)
+              .campoDinero(pedido->getTotal()).campo(static_cast<int64_t>(pedido->getProductos().size()))
+              .campo(pedido->getInstante()).terminarLinea();
+    }
+    else if (comando == "customer") {
+        uint32_t idCliente;
+        if (!RegistroClientes::global().buscar(linea, idCliente) || gestor.cantidadPedidosDeCliente(idCliente) == 0) {
+            responderErrorLote(salida, errores, comando, "no_existe");
             return;
         }
 
-        string tipoArchivo = (opcion == 1) ? "pendientes" : "completados";
-        string nombreArchivo = "pedidos_" + tipoArchivo + ".txt";
+        ResumenCliente resumen = gestor.resumenCliente(idCliente);
+        salida.texto("ok").campo(comando).campo(linea).campo(static_cast<int64_t>(resumen.pendientes))
+              .campo(static_cast<int64_t>(resumen.completados)).campoDinero(resumen.gasto).campo(resumen.ultimoId);
+        gestor.recorrerPedidosDeCliente(idCliente, [&](const Pedido& pedido, EstadoPedido) {
+            salida.campo(pedido.getId());
+        });
+        salida.terminarLinea();
+    }
+    else if (comando == "customers") {
+        vector<uint32_t> clientes = gestor.buscarClientesPorPrefijo(linea);
+        salida.texto("ok").campo(comando).campo(static_cast<int64_t>(clientes.size()));
+        for (uint32_t idCliente : clientes) {
+            salida.campo(RegistroClientes::global().nombre(idCliente)).texto(",")
+                  .numero(static_cast<int64_t>(gestor.cantidadPedidosDeCliente(idCliente)));
+        }
+        salida.terminarLinea();
+    }
+    else if (comando == "export") {
+        string_view campo, ruta;
+        FormatoExportacion formato;
+        FiltroExportacion filtro;
+        bool valido = siguienteCampo(linea, '|', campo) && interpretarFormatoExportacion(campo, formato) &&
+                      siguienteCampo(linea, '|', ruta) && !ruta.empty() && ruta != "-";
+        if (valido && siguienteCampo(linea, '|', campo) && !campo.empty()) {
+            valido = convertirNumero(campo, filtro.desde);
+        }
+        if (valido && siguienteCampo(linea, '|', campo) && !campo.empty()) {
+            valido = convertirNumero(campo, filtro.hasta);
+        }
+        if (valido && siguienteCampo(linea, '|', campo) && !campo.empty()) {
+            valido = (campo == "0" || campo == "1");
+            filtro.urgencia = (campo == "1") ? 1 : 0;
+        }
+        if (valido && siguienteCampo(linea, '|', campo)) {
+            filtro.cliente = string(campo);
+        }
+        if (valido && siguienteCampo(linea, '|', campo)) {
+            filtro.producto = string(campo);
+        }
+        if (!valido) {
+            responderErrorLote(salida, errores, comando, "formato");
+            return;
+        }
 
-        // Leer archivo a memoria
-        ifstream archivoEntrada(nombreArchivo);
-        if (!archivoEntrada.is_open()) {
-            cout << "\nNo se pudo abrir el archivo de pedidos " << tipoArchivo << "." << endl;
+        ResultadoExportacion resultado = gestor.exportarEnMemoria(formato, filtro, string(ruta));
+        if (resultado.estado != EstadoExportacion::Correcta) {
+            responderErrorLote(salida, errores, comando, resultado.estado == EstadoExportacion::ArchivoDanado ? "archivo_danado" : "escritura");
+            return;
+        }
+        salida.texto("ok").campo(comando).campo(static_cast<int64_t>(resultado.filas))
+              .campo(static_cast<int64_t>(resultado.bytes)).campo(static_cast<int64_t>(resultado.segmentosSaltados)).terminarLinea();
+    }
+    else {
+        responderErrorLote(salida, errores, comando, "comando_desconocido");
+    }
+}
+
+// Recorre las lineas de comandos y entrega cada una a ejecutar(linea, salida,
+// errores); al final escribe el resumen en stderr y devuelve los errores
+template <typename Funcion>
+size_t recorrerComandosLote(string_view comandos, Funcion ejecutar) {
+    SalidaBuffer salida(cout);
+    size_t cantidadComandos = 0;
+    size_t errores = 0;
+    auto inicio = chrono::steady_clock::now();
+
+    string_view resto = comandos;
+    string_view linea;
+    while (siguienteCampo(resto, '\n', linea)) {
+        if (!linea.empty() && linea.back() == '\r') {
+            linea.remove_suffix(1);
+        }
+        if (linea.empty() || linea[0] == '#') {
+            continue;
+        }
+        cantidadComandos++;
+        ejecutar(linea, salida, errores);
+    }
+    salida.vaciar();
+    cout.flush();
+
+    // El resumen va a stderr para no mezclarse con las respuestas
+    double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+    fprintf(stderr, "Comandos: %zu | Errores: %zu | Tiempo: %.3f s | %.0f comandos/s\n",
+            cantidadComandos, errores, segundos, segundos > 0 ? cantidadComandos / segundos : 0.0);
+    return errores;
+}
+
+// Modo sin menu: lee un comando por linea de un archivo (o de la entrada
+// estandar) y escribe una linea de resultado por comando, separada por '|'.
+//   add|id|cliente|urgente(0/1)|producto,producto,...   (numeros del menu)
+//   process | find|id | delete|id | report | save | load
+//   (find responde "archivado" como estado si el pedido ya esta en disco)
+//   (load responde pendientes, completados, duplicados, cambios aplicados,
+//    totales incorrectos, precios distintos al catalogo y productos y
+//    clientes que no entraron en el catalogo o el registro llenos y pedidos
+//    con una fecha que no se entiende)
+//   range|desde|hasta | recent|segundos   (instantes en segundos desde 1970)
+//   group|producto, group|hora, group|cliente o group|urgencia
+//   customer|nombre (resumen e IDs de sus pedidos en memoria) | customers|prefijo
+//   export|csv o jsonl|archivo[|desde|hasta|urgente(0/1)|cliente|producto]
+//   (exporta el estado en memoria; un filtro vacio no filtra; responde filas,
+//    bytes y segmentos archivados que se saltaron sin leer)
+// Con varias sucursales cada linea empieza con la sucursal (0, 1, ...) y los
+// comandos report, range, recent, group, save y load aceptan '*' para sumar
+// todas: 0|add|...  1|process  *|report
+// Cada respuesta empieza con "ok" o "error", el comando y el ID si lo tiene.
+// Las lineas vacias y las que empiezan con '#' se ignoran. Devuelve la
+// cantidad de errores.
+size_t ejecutarModoLote(GestorPedidos& gestor, string_view comandos) {
+    return recorrerComandosLote(comandos, [&](string_view linea, SalidaBuffer& salida, size_t& errores) {
+        string_view comando;
+        siguienteCampo(linea, '|', comando);
+        ejecutarComandoLote(gestor, comando, linea, salida, errores);
+    });
+}
+
+// Modo por lotes con varias sucursales; ver ejecutarModoLote
+size_t ejecutarModoLoteSucursales(GestorSucursales& sucursales, string_view comandos) {
+    return recorrerComandosLote(comandos, [&](string_view linea, SalidaBuffer& salida, size_t& errores) {
+        string_view campoSucursal, comando;
+        siguienteCampo(linea, '|', campoSucursal);
+        siguienteCampo(linea, '|', comando);
+
+        if (campoSucursal == "*") {
+            if (!ejecutarConsultaLote(sucursales, comando, linea, salida, errores)) {
+                responderErrorLote(salida, errores, comando, "requiere_sucursal");
+            }
             return;
         }
 
-        // Leer todas las líneas del archivo
-        vector<string> lineas;
-        string linea;
-        vector<Pedido> pedidosLeidos;
+        size_t idSucursal;
+        if (!convertirNumero(campoSucursal, idSucursal) || !sucursales.existeSucursal(idSucursal)) {
+            responderErrorLote(salida, errores, comando, "sucursal_invalida");
+            return;
+        }
+        sucursales.conSucursal(idSucursal, [&](GestorPedidos& gestor) {
+            ejecutarComandoLote(gestor, comando, linea, salida, errores);
+        });
+    });
+}
+
+// Lee toda la entrada estandar; se usa cuando el modo por lotes no recibe archivo
+string leerEntradaEstandar() {
+    string contenido;
+    char bloque[1 << 16];
+    size_t leidos;
+    while ((leidos = fread(bloque, 1, sizeof(bloque), stdin)) > 0) {
+        contenido.append(bloque, leidos);
+    }
+    return contenido;
+}
 
-        while (getline(archivoEntrada, linea)) {
-            // Parsear la línea para obtener ID y mostrar al usuario
-            stringstream ss(linea);
-            string token;
-            vector<string> datos;
+// Los benchmarks (benchmarks.cpp) y las pruebas (pruebas.cpp) incluyen este
+// archivo y traen su propio main
+#ifndef PROYECTOPROGRA_SIN_MAIN
 
-            while (getline(ss, token, '|')) {
-                datos.push_back(token);
+// Función principal
+int main(int argc, char* argv[]) {
+    // Limites del historial en memoria y volcado de metricas; se aceptan en
+    // cualquier posicion y se quitan de argv antes de ver el modo:
+    //   --max-historial N (pedidos, 0 sin limite)  --max-edad-historial S (segundos)
+    //   --metricas ARCHIVO (formato de Prometheus)  --intervalo-metricas S (10 por defecto)
+    //   --respaldo-asincrono (guardar en segundo plano)  --respaldo-cambios N  --respaldo-segundos S
+    size_t maximoHistorial = 1000000;
+    int64_t edadMaximaHistorial = 0;
+    string rutaMetricas;
+    int64_t intervaloMetricas = 10;
+    bool respaldoAsincrono = false;
+    size_t cambiosPorRespaldo = EVENTOS_POR_COMPACTACION;
+    int64_t segundosPorRespaldo = 0;
+    // Valor numerico de una opcion; los negativos y lo que no es numero se rechazan
+    auto leerValorOpcion = [](const string& opcion, const char* texto, auto& valor) {
+        if (!convertirNumero(string_view(texto), valor) || valor < 0) {
+            fprintf(stderr, "%s espera un numero no negativo: %s\n", opcion.c_str(), texto);
+            return false;
+        }
+        return true;
+    };
+    vector<char*> argumentos;
+    for (int i = 0; i < argc; i++) {
+        string argumento = argv[i];
+        if (argumento == "--max-historial" && i + 1 < argc) {
+            if (!leerValorOpcion(argumento, argv[++i], maximoHistorial)) {
+                return 1;
             }
+        }
+        else if (argumento == "--max-edad-historial" && i + 1 < argc) {
+            if (!leerValorOpcion(argumento, argv[++i], edadMaximaHistorial)) {
+                return 1;
+            }
+        }
+        else if (argumento == "--metricas" && i + 1 < argc) {
+            rutaMetricas = argv[++i];
+        }
+        else if (argumento == "--intervalo-metricas" && i + 1 < argc) {
+            if (!leerValorOpcion(argumento, argv[++i], intervaloMetricas)) {
+                return 1;
+            }
+        }
+        else if (argumento == "--respaldo-asincrono") {
+            respaldoAsincrono = true;
+        }
+        else if (argumento == "--respaldo-cambios" && i + 1 < argc) {
+            if (!leerValorOpcion(argumento, argv[++i], cambiosPorRespaldo)) {
+                return 1;
+            }
+        }
+        else if (argumento == "--respaldo-segundos" && i + 1 < argc) {
+            if (!leerValorOpcion(argumento, argv[++i], segundosPorRespaldo)) {
+                return 1;
+            }
+        }
+        else {
+            argumentos.push_back(argv[i]);
+        }
+    }
+    argc = static_cast<int>(argumentos.size());
+    argv = argumentos.data();
+
+    // Se detiene (y escribe por ultima vez) al salir de main
+    unique_ptr<VolcadoMetricas> volcadoMetricas;
+    if (!rutaMetricas.empty()) {
+        if (METRICAS_ACTIVAS) {
+            volcadoMetricas = make_unique<VolcadoMetricas>(rutaMetricas, intervaloMetricas);
+        }
+        else {
+            fprintf(stderr, "Las metricas estan deshabilitadas en esta compilacion\n");
+        }
+    }
 
-            if (datos.size() < 6) continue; // Formato inválido
-
-            int id = stoi(datos[0]);
-            string nombreCliente = datos[1];
-            int numProductos = stoi(datos[2]);
+    if (argc > 1 && string(argv[1]) == "--bench-snapshot") {
+        size_t cantidad = (argc > 2) ? stoul(argv[2]) : 1000000;
+        ejecutarBenchmarkSnapshot(cantidad);
+        return 0;
+    }
 
-            vector<Producto> productos;
-            for (int i = 0; i < numProductos; i++) {
-                string prodInfo = datos[3 + i];
-                stringstream ssProd(prodInfo);
-                string nombreProd, precioProd;
+    if (argc > 1 && string(argv[1]) == "--bench-respaldo") {
+        size_t cantidad = (argc > 2) ? stoul(argv[2]) : 5000000;
+        ejecutarBenchmarkRespaldoAsincrono(cantidad);
+        return 0;
+    }
 
-                getline(ssProd, nombreProd, ',');
-                getline(ssProd, precioProd, ',');
+    if (argc > 1 && string(argv[1]) == "--bench-analisis") {
+        size_t cantidadLineas = (argc > 2) ? stoul(argv[2]) : 50000000;
+        ejecutarBenchmarkColumnar(cantidadLineas);
+        return 0;
+    }
 
-                productos.push_back(Producto(nombreProd, stod(precioProd)));
-            }
+    if (argc > 1 && string(argv[1]) == "--bench-historial") {
+        size_t cantidad = (argc > 2) ? stoul(argv[2]) : 5000000;
+        size_t maximo = (argc > 3) ? stoul(argv[3]) : 200000;
+        ejecutarBenchmarkHistorial(cantidad, maximo);
+        return 0;
+    }
 
-            double total = stod(datos[3 + numProductos]);
-            string fechaHora = datos[4 + numProductos];
-            bool urgente = (datos[5 + numProductos] == "1");
+    if (argc > 1 && string(argv[1]) == "--bench-planificador") {
+        double llegadasPorMinuto = (argc > 2) ? stod(argv[2]) : 1.2;
+        double fraccionUrgentes = (argc > 3) ? stod(argv[3]) : 0.2;
+        size_t cantidad = (argc > 4) ? stoul(argv[4]) : 200000;
+        ejecutarSimulacionPlanificador(llegadasPorMinuto, fraccionUrgentes, cantidad);
+        return 0;
+    }
 
-            Pedido p(id, nombreCliente, productos, total, fechaHora, urgente);
-            pedidosLeidos.push_back(p);
-            lineas.push_back(linea);
-        }
+    if (argc > 1 && string(argv[1]) == "--bench-exportar") {
+        size_t cantidad = (argc > 2) ? stoul(argv[2]) : 5000000;
+        ejecutarBenchmarkExportacion(cantidad);
+        return 0;
+    }
 
-        archivoEntrada.close();
+    if (argc > 1 && string(argv[1]) == "--bench-sucursales") {
+        size_t cantidad = (argc > 2) ? stoul(argv[2]) : 2000000;
+        size_t sucursales = (argc > 3) ? stoul(argv[3]) : max<size_t>(thread::hardware_concurrency(), 4);
+        return ejecutarBenchmarkSucursales(cantidad, sucursales) ? 0 : 1;
+    }
 
-        if (pedidosLeidos.empty()) {
-            cout << "\nNo hay pedidos " << tipoArchivo << " para eliminar." << endl;
-            return;
+    // --exportar csv|jsonl [archivo] [--desde S] [--hasta S] [--urgentes|--normales]
+    // [--cliente NOMBRE] [--producto NOMBRE]: exporta lo guardado en archivos sin
+    // cargarlo; sin archivo va a la salida estandar
+    if (argc > 1 && string(argv[1]) == "--exportar") {
+        auto mostrarUso = [&] {
+            fprintf(stderr, "Uso: %s --exportar csv|jsonl [archivo] [--desde S] [--hasta S] [--urgentes|--normales] "
+                            "[--cliente NOMBRE] [--producto NOMBRE]\n", argv[0]);
+            return 1;
+        };
+        FormatoExportacion formato;
+        if (argc < 3 || !interpretarFormatoExportacion(argv[2], formato)) {
+            return mostrarUso();
         }
 
-        // Mostrar los pedidos al usuario
-        cout << "\n--- Pedidos " << tipoArchivo << " disponibles para eliminar ---\n";
-        for (size_t i = 0; i < pedidosLeidos.size(); i++) {
-            cout << (i + 1) << ". " << pedidosLeidos[i].toString() << endl << endl;
+        FiltroExportacion filtro;
+        string rutaSalida;
+        for (int i = 3; i < argc; i++) {
+            string opcion = argv[i];
+            if (opcion == "--desde" && i + 1 < argc) {
+                if (!convertirNumero(argv[++i], filtro.desde)) {
+                    fprintf(stderr, "--desde espera segundos desde 1970: %s\n", argv[i]);
+                    return 1;
+                }
+            }
+            else if (opcion == "--hasta" && i + 1 < argc) {
+                if (!convertirNumero(argv[++i], filtro.hasta)) {
+                    fprintf(stderr, "--hasta espera segundos desde 1970: %s\n", argv[i]);
+                    return 1;
+                }
+            }
+            else if (opcion == "--urgentes") {
+                filtro.urgencia = 1;
+            }
+            else if (opcion == "--normales") {
+                filtro.urgencia = 0;
+            }
+            else if (opcion == "--cliente" && i + 1 < argc) {
+                filtro.cliente = argv[++i];
+            }
+            else if (opcion == "--producto" && i + 1 < argc) {
+                filtro.producto = argv[++i];
+            }
+            // "-" es la salida estandar; otra opcion o un segundo archivo es un error
+            else if ((opcion.size() > 1 && opcion[0] == '-') || !rutaSalida.empty()) {
+                fprintf(stderr, "Opcion desconocida, sin valor o repetida: %s\n", opcion.c_str());
+                return mostrarUso();
+            }
+            else {
+                rutaSalida = opcion;
+            }
         }
-
-        // Solicitar al usuario que seleccione el pedido a eliminar
-        int seleccion;
-        cout << "Seleccione el numero del pedido a eliminar (1-" << pedidosLeidos.size() << "): ";
-        cin >> seleccion;
-
-        if (seleccion < 1 || seleccion > static_cast<int>(pedidosLeidos.size())) {
-            cout << "\nSelección invalida. Operacion cancelada." << endl;
-            return;
+        if (rutaSalida.empty()) {
+            rutaSalida = "-";
         }
 
-        // Eliminar el pedido seleccionado
-        lineas.erase(lineas.begin() + seleccion - 1);
-
-        // Guardar los cambios en el archivo
-        ofstream archivoSalida(nombreArchivo);
-        if (!archivoSalida.is_open()) {
-            cout << "\nError al abrir el archivo para guardar los cambios." << endl;
-            return;
+        auto inicio = chrono::steady_clock::now();
+        GestorPedidos gestor("", false);
+        ResultadoExportacion resultado = gestor.exportarGuardados(formato, filtro, rutaSalida);
+        double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+        if (resultado.estado == EstadoExportacion::SinArchivos) {
+            fprintf(stderr, "No se encontraron archivos de pedidos para exportar\n");
+            return 1;
+        }
+        if (resultado.estado == EstadoExportacion::ArchivoDanado) {
+            fprintf(stderr, "El respaldo o un segmento archivado esta danado o tiene una version no soportada\n");
+            return 1;
+        }
+        if (resultado.estado == EstadoExportacion::ErrorEscritura) {
+            fprintf(stderr, "No se pudo escribir %s\n", rutaSalida.c_str());
+            return 1;
         }
+        fprintf(stderr, "Exportados: %zu pedidos | %.1f MB | %.3f s | Segmentos saltados: %zu\n", resultado.filas,
+                resultado.bytes / 1e6, segundos, resultado.segmentosSaltados);
+        if (resultado.fechasInvalidas > 0) {
+            fprintf(stderr, "Aviso: %zu pedido(s) tienen una fecha que no se entiende y salieron con fecha 01/01/1970\n",
+                    resultado.fechasInvalidas);
+        }
+        return 0;
+    }
 
-        for (const string& l : lineas) {
-            archivoSalida << l << endl;
+    // --batch [archivo|-] [--journal] [--sucursales N]: comandos sin menu; sin
+    // --journal los cambios solo se guardan con el comando save. Con
+    // --sucursales cada sucursal usa sus propios archivos (sucursalN_pedidos.dat, ...).
+    // Sale con 1 si algun comando respondio error.
+    if (argc > 1 && string(argv[1]) == "--batch") {
+        string rutaComandos = "-";
+        bool usarJournal = false;
+        size_t cantidadSucursales = 0;
+        for (int i = 2; i < argc; i++) {
+            if (string(argv[i]) == "--journal") {
+                usarJournal = true;
+            }
+            else if (string(argv[i]) == "--sucursales" && i + 1 < argc && convertirNumero(string_view(argv[i + 1]), cantidadSucursales)) {
+                i++;
+            }
+            else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+                fprintf(stderr, "Opcion desconocida: %s\n", argv[i]);
+                return 1;
+            }
+            else {
+                rutaComandos = argv[i];
+            }
         }
 
-        archivoSalida.close();
+        string comandosEntrada;
+        optional<ArchivoMapeado> archivo;
+        string_view comandos;
+        if (rutaComandos == "-") {
+            comandosEntrada = leerEntradaEstandar();
+            comandos = comandosEntrada;
+        }
+        else {
+            archivo.emplace(rutaComandos);
+            if (!archivo->estaAbierto()) {
+                fprintf(stderr, "No se pudo abrir %s\n", rutaComandos.c_str());
+                return 1;
+            }
+            comandos = archivo->contenido();
+        }
 
-        cout << "\nPedido eliminado correctamente del archivo de pedidos " << tipoArchivo << "." << endl;
+        if (cantidadSucursales > 0) {
+            GestorSucursales sucursales(cantidadSucursales, "", usarJournal);
+            sucursales.configurarHistorial(maximoHistorial, edadMaximaHistorial);
+            sucursales.configurarRespaldo(respaldoAsincrono, cambiosPorRespaldo, segundosPorRespaldo);
+            return ejecutarModoLoteSucursales(sucursales, comandos) == 0 ? 0 : 1;
+        }
 
-        // Actualizar las estructuras en memoria si están cargadas
-        cargarPedidos();
+        GestorPedidos gestor("", usarJournal);
+        gestor.configurarHistorial(maximoHistorial, edadMaximaHistorial);
+        gestor.configurarRespaldo(respaldoAsincrono, cambiosPorRespaldo, segundosPorRespaldo);
+        return ejecutarModoLote(gestor, comandos) == 0 ? 0 : 1;
     }
-};
 
-// Función principal
-int main() {
     GestorPedidos gestor;
+    gestor.configurarHistorial(maximoHistorial, edadMaximaHistorial);
+    gestor.configurarRespaldo(respaldoAsincrono, cambiosPorRespaldo, segundosPorRespaldo);
     int opcion;
 
     cout << "\n=== Cafeteria el buen sabor ===\n";
 
+    // Recuperar lo que quedo guardado en la sesion anterior
+    if (gestor.hayDatosGuardados()) {
+        gestor.cargarPedidos();
+    }
+
     do {
         cout << "\nMenu Principal:\n";
         cout << "1. Agregar nuevo pedido\n";
@@ -754,7 +8629,11 @@ int main() {
         cout << "7. Guardar pedidos en archivos\n";
         cout << "8. Cargar pedidos desde archivos\n";
         cout << "9. Ver pedidos guardados en archivos\n";
-        cout << "10. Eliminar pedido guardado en archivo\n";
+        cout << "10. Eliminar pedido\n";
+        cout << "11. Exportar pedidos a archivos de texto\n";
+        cout << "12. Reporte por rango de fechas\n";
+        cout << "13. Analisis de ventas\n";
+        cout << "14. Buscar pedidos por cliente\n";
         cout << "0. Salir\n";
         cout << "Ingrese una opcion: ";
         cin >> opcion;
@@ -800,6 +8679,22 @@ int main() {
             gestor.eliminarPedido();
             break;
 
+        case 11:
+            gestor.exportarPedidosTexto();
+            break;
+
+        case 12:
+            gestor.generarReportePorFechas();
+            break;
+
+        case 13:
+            gestor.generarAnalisisVentas();
+            break;
+
+        case 14:
+            gestor.buscarPedidosPorCliente();
+            break;
+
         case 0:
             cout << "\n Gracias por su compra vuelve pronto a el buen sabor\n";
             break;
@@ -811,4 +8706,6 @@ int main() {
     } while (opcion != 0);
 
     return 0;
-}
\ No newline at end of file
+}
+
+#endif // PROYECTOPROGRA_SIN_MAIN
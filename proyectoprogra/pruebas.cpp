@@ -0,0 +1,695 @@
+// Pruebas que corre ctest. Cada una imprime lo que reviso y al final
+// "Resultado: OK" o "Resultado: FALLO", y sale con 0 solo si todo coincide:
+//   proyectoprogra_pruebas compactacion | clientes-archivados | sucursales |
+//                          huerfanos | tramos | horario | stress [hilos] [pedidos]
+#define PROYECTOPROGRA_SIN_MAIN
+#include "proyectoprogra.cpp"
+
+// Prueba del gestor por sucursales: cada pedido va a su sucursal, el mismo id
+// puede estar en dos sucursales, los reportes juntos son la suma de los de cada
+// una y el indicador de pendientes suma todas (y deja de contar a un gestor
+// cuando se destruye).
+int ejecutarPruebaSucursales() {
+    const string prefijo = "prueba_sucursales_";
+    const string prefijoAparte = "prueba_sucursales_aparte_";
+    const size_t SUCURSALES = 3;
+    const int PEDIDOS = 3000;
+    const int ID_COMPARTIDO = PEDIDOS + 1;
+    const CatalogoProductos& catalogo = CatalogoProductos::global();
+    bool correcto = true;
+    auto revisar = [&](bool condicion, const string& que) {
+        cout << "  " << que << ": " << (condicion ? "OK" : "FALLO") << endl;
+        correcto = correcto && condicion;
+    };
+    auto pedidoDePrueba = [&](int id) {
+        uint16_t idProducto = static_cast<uint16_t>(id % catalogo.tamanoMenu());
+        LineasPedido productos;
+        productos.push_back(Producto(idProducto, catalogo.precio(idProducto)));
+        return Pedido(id, "Cliente " + to_string(id % 40), move(productos), id % 10 == 0);
+    };
+    auto pendientesPublicados = [] {
+        for (const ValorMetrica& indicador : Metricas::global().instantanea().indicadores) {
+            if (indicador.nombre == string("pedidos_pendientes")) {
+                return indicador.valor;
+            }
+        }
+        return int64_t(-1);
+    };
+
+    {
+        GestorSucursales gestor(SUCURSALES, prefijo, false);
+
+        // Ruteo: el pedido id va a la sucursal id % SUCURSALES
+        bool registrados = true;
+        for (int id = 1; id <= PEDIDOS; id++) {
+            registrados = gestor.registrarPedido(static_cast<size_t>(id) % SUCURSALES, pedidoDePrueba(id)) && registrados;
+        }
+        bool ruteados = true;
+        for (size_t k = 0; k < SUCURSALES; k++) {
+            size_t pendientes = gestor.conSucursal(k, [](GestorPedidos& g) { return g.cantidadPendientes(); });
+            ruteados = ruteados && pendientes == PEDIDOS / SUCURSALES;
+            for (int id = 1; id <= 30; id++) {
+                bool esta = gestor.buscarPedido(k, id).has_value();
+                ruteados = ruteados && esta == (static_cast<size_t>(id) % SUCURSALES == k);
+            }
+        }
+        revisar(registrados && ruteados, "cada pedido en su sucursal");
+
+        // El mismo id en cada sucursal; repetido en la misma se rechaza
+        bool compartido = true;
+        for (size_t k = 0; k < SUCURSALES; k++) {
+            compartido = gestor.registrarPedido(k, pedidoDePrueba(ID_COMPARTIDO)) && compartido;
+        }
+        compartido = compartido && !gestor.registrarPedido(0, pedidoDePrueba(ID_COMPARTIDO));
+        for (size_t k = 0; k < SUCURSALES; k++) {
+            compartido = compartido && gestor.buscarPedido(k, ID_COMPARTIDO).has_value();
+        }
+        revisar(compartido, "mismo id en distintas sucursales");
+
+        // Cada sucursal procesa una cantidad distinta
+        for (size_t k = 0; k < SUCURSALES; k++) {
+            for (size_t i = 0; i < 300 * (k + 1); i++) {
+                gestor.procesarSiguiente(k);
+            }
+        }
+        ResumenFinanciero junto = gestor.generarResumen();
+        VentasPorGrupo productosJunto = gestor.ventasPorProducto();
+        VentasPorGrupo horasJunto = gestor.ventasPorHora();
+        ResumenFinanciero suma;
+        VentasPorGrupo productosSuma, horasSuma;
+        for (size_t k = 0; k < SUCURSALES; k++) {
+            gestor.conSucursal(k, [&](GestorPedidos& g) {
+                ResumenFinanciero deSucursal = g.generarResumen();
+                suma.cantidadPedidos += deSucursal.cantidadPedidos;
+                suma.ingresoTotal += deSucursal.ingresoTotal;
+                suma.unidadesVendidas.resize(max(suma.unidadesVendidas.size(), deSucursal.unidadesVendidas.size()), 0);
+                for (size_t id = 0; id < deSucursal.unidadesVendidas.size(); id++) {
+                    suma.unidadesVendidas[id] += deSucursal.unidadesVendidas[id];
+                }
+                sumarVentas(productosSuma, g.ventasPorProducto());
+                sumarVentas(horasSuma, g.ventasPorHora());
+            });
+        }
+        revisar(junto.cantidadPedidos == suma.cantidadPedidos && junto.cantidadPedidos == 1800 &&
+                    junto.ingresoTotal == suma.ingresoTotal && junto.unidadesVendidas == suma.unidadesVendidas &&
+                    productosJunto.cantidad == productosSuma.cantidad && productosJunto.ingreso == productosSuma.ingreso &&
+                    horasJunto.cantidad == horasSuma.cantidad && horasJunto.ingreso == horasSuma.ingreso,
+                "reporte junto igual a la suma de las sucursales");
+
+        // guardar publica los tamanos de cada gestor sin muestreo
+        if (METRICAS_ACTIVAS) {
+            revisar(gestor.guardar(), "guardar las sucursales");
+            int64_t pendientes = static_cast<int64_t>(gestor.cantidadPendientes());
+            revisar(pendientesPublicados() == pendientes, "indicador de pendientes con todas las sucursales");
+            {
+                GestorPedidos aparte(prefijoAparte, false);
+                for (int id = 1; id <= 25; id++) {
+                    aparte.registrarPedido(pedidoDePrueba(id));
+                }
+                aparte.guardar();
+                revisar(pendientesPublicados() == pendientes + 25, "indicador con un gestor mas");
+                remove((prefijoAparte + "pedidos.dat").c_str());
+            }
+            revisar(pendientesPublicados() == pendientes, "indicador al destruir ese gestor");
+        }
+    }
+    if (METRICAS_ACTIVAS) {
+        revisar(pendientesPublicados() == 0, "indicador al destruir las sucursales");
+    }
+
+    for (size_t k = 0; k < SUCURSALES; k++) {
+        string prefijoSucursal = GestorSucursales::prefijoSucursal(prefijo, k);
+        HistorialArchivado nombres(prefijoSucursal);
+        for (uint32_t numero : nombres.numerosEnDisco()) {
+            remove(nombres.rutaSegmento(numero).c_str());
+        }
+        remove((prefijoSucursal + "pedidos.dat").c_str());
+    }
+
+    cout << (correcto ? "Resultado: OK" : "Resultado: FALLO") << endl;
+    return correcto ? 0 : 1;
+}
+
+// Prueba de los totales por cliente de los segmentos: con pocos pedidos en
+// memoria, compara lo que dicen los resumenes de cada cliente (cantidad, gasto
+// y pedido mas reciente) con la cuenta hecha aparte, despues de archivar,
+// despues de eliminar archivados (tambien el mas reciente de cada cliente),
+// despues de guardar y volver a cargar y al archivar por edad con pedidos
+// recientes completados entre los viejos.
+int ejecutarPruebaClientesArchivados() {
+    const string prefijo = "prueba_clientes_";
+    const CatalogoProductos& catalogo = CatalogoProductos::global();
+    const int PEDIDOS = 1000;
+    const size_t CLIENTES = 11;
+    const int64_t INICIO = 1735725600; // 01/01/2025 10:00:00 UTC
+    bool correcto = true;
+
+    struct Registro {
+        size_t cliente;
+        Dinero total;
+        int64_t instante;
+        bool vivo;
+    };
+    vector<Registro> registros(PEDIDOS + 1);
+    vector<uint32_t> idsCliente(CLIENTES);
+    for (size_t k = 0; k < CLIENTES; k++) {
+        idsCliente[k] = RegistroClientes::global().registrar("Cliente archivado " + to_string(k));
+    }
+
+    auto revisar = [&](const GestorPedidos& gestor, const string& momento) {
+        const HistorialArchivado& archivo = gestor.historialArchivado();
+        VentasPorGrupo ventas = gestor.ventasPorCliente();
+        size_t distintos = 0;
+        for (size_t k = 0; k < CLIENTES; k++) {
+            ArchivadosCliente esperadoArchivo, esperadoTotal;
+            for (int id = 1; id <= PEDIDOS; id++) {
+                const Registro& r = registros[id];
+                if (r.cliente != k || !r.vivo) {
+                    continue;
+                }
+                ArchivadosCliente uno{ 1, r.total, id, r.instante };
+                esperadoTotal.juntar(uno);
+                if (archivo.contiene(id)) {
+                    esperadoArchivo.juntar(uno);
+                }
+            }
+            ArchivadosCliente archivados = archivo.deCliente(idsCliente[k]);
+            uint32_t idCliente = idsCliente[k];
+            long long cantidad = idCliente < ventas.cantidad.size() ? ventas.cantidad[idCliente] : 0;
+            Dinero ingreso = idCliente < ventas.ingreso.size() ? ventas.ingreso[idCliente] : Dinero();
+            ResumenCliente resumen = gestor.resumenCliente(idCliente);
+            bool igual = archivados.cantidad == esperadoArchivo.cantidad && archivados.gasto == esperadoArchivo.gasto &&
+                         (esperadoArchivo.cantidad == 0 || archivados.ultimoId == esperadoArchivo.ultimoId) &&
+                         cantidad == static_cast<long long>(esperadoTotal.cantidad) && ingreso == esperadoTotal.gasto &&
+                         resumen.completados == esperadoTotal.cantidad && resumen.ultimoId == esperadoTotal.ultimoId;
+            distintos += !igual;
+        }
+        cout << "  " << momento << ": " << gestor.cantidadArchivados() << " archivados, " << distintos
+             << " cliente(s) distintos a lo esperado" << endl;
+        correcto = correcto && distintos == 0;
+    };
+
+    {
+        GestorPedidos gestor(prefijo, false);
+        gestor.configurarHistorial(50, 0);
+        for (int id = 1; id <= PEDIDOS; id++) {
+            size_t k = static_cast<size_t>(id) * 7 % CLIENTES;
+            uint16_t idProducto = static_cast<uint16_t>(id % catalogo.tamanoMenu());
+            LineasPedido productos;
+            productos.push_back(Producto(idProducto, catalogo.precio(idProducto)));
+            Dinero total = catalogo.precio(idProducto);
+            // Instantes desordenados, para que el mas reciente no sea el ultimo archivado
+            int64_t instante = INICIO + (id * 7919) % PEDIDOS * 60;
+            registros[id] = { k, total, instante, true };
+            gestor.registrarPedido(Pedido(id, idsCliente[k], move(productos), total, instante, false));
+            gestor.procesarSiguiente();
+        }
+        revisar(gestor, "al archivar");
+
+        // El archivado mas reciente de cada cliente y uno de cada siete del resto
+        for (size_t k = 0; k < CLIENTES; k++) {
+            int masReciente = 0;
+            for (int id = 1; id <= PEDIDOS; id++) {
+                if (registros[id].cliente == k && gestor.historialArchivado().contiene(id) &&
+                    (masReciente == 0 || registros[id].instante > registros[masReciente].instante)) {
+                    masReciente = id;
+                }
+            }
+            if (masReciente != 0 && gestor.eliminarPedidoPorId(masReciente)) {
+                registros[masReciente].vivo = false;
+            }
+        }
+        for (int id = 1; id <= PEDIDOS; id += 7) {
+            if (registros[id].vivo && gestor.historialArchivado().contiene(id) && gestor.eliminarPedidoPorId(id)) {
+                registros[id].vivo = false;
+            }
+        }
+        revisar(gestor, "al eliminar archivados");
+        correcto = gestor.guardar() && correcto;
+    }
+    {
+        GestorPedidos cargado(prefijo, false);
+        cargado.configurarHistorial(50, 0);
+        correcto = cargado.cargar().estado == EstadoCarga::Correcta && correcto;
+        revisar(cargado, "al cargar");
+    }
+
+    // Por edad: el historial va en orden de finalizacion, asi que un pedido
+    // reciente completado antes no debe frenar el archivo de los viejos
+    const string prefijoEdad = prefijo + "edad_";
+    {
+        GestorPedidos gestor(prefijoEdad, false);
+        gestor.configurarHistorial(0, 86400);
+        int64_t ahora = static_cast<int64_t>(time(nullptr));
+        for (int id = 1; id <= PEDIDOS; id++) {
+            size_t k = static_cast<size_t>(id) * 7 % CLIENTES;
+            uint16_t idProducto = static_cast<uint16_t>(id % catalogo.tamanoMenu());
+            LineasPedido productos;
+            productos.push_back(Producto(idProducto, catalogo.precio(idProducto)));
+            Dinero total = catalogo.precio(idProducto);
+            int64_t instante = id % 3 == 1 ? ahora : INICIO + id * 60;
+            registros[id] = { k, total, instante, true };
+            gestor.registrarPedido(Pedido(id, idsCliente[k], move(productos), total, instante, false));
+            gestor.procesarSiguiente();
+        }
+        correcto = gestor.guardar() && correcto;
+        size_t malUbicados = 0;
+        for (int id = 1; id <= PEDIDOS; id++) {
+            malUbicados += gestor.historialArchivado().contiene(id) != (registros[id].instante != ahora);
+        }
+        cout << "  al archivar por edad: " << malUbicados << " pedido(s) en memoria o en disco sin corresponder" << endl;
+        correcto = correcto && malUbicados == 0;
+        revisar(gestor, "al archivar por edad");
+    }
+
+    for (const string& p : { prefijo, prefijoEdad }) {
+        HistorialArchivado nombres(p);
+        for (uint32_t numero : nombres.numerosEnDisco()) {
+            remove(nombres.rutaSegmento(numero).c_str());
+        }
+        remove((p + "pedidos.dat").c_str());
+    }
+
+    cout << (correcto ? "Resultado: OK" : "Resultado: FALLO") << endl;
+    return correcto ? 0 : 1;
+}
+
+// Prueba de errores en procesarTramosEnOrden: una excepcion al producir o al
+// consumir un tramo tiene que llegar al que llama, con los hilos terminados y
+// solo los tramos anteriores consumidos, en orden. Tambien un trabajo en
+// segundo plano que lanza una excepcion: recoger() da false y el hilo sigue.
+int ejecutarPruebaTramos() {
+    const size_t TRAMOS = 200;
+    const size_t TRAMO_FALLIDO = 37;
+    bool correcto = true;
+
+    for (size_t hilos : { size_t(1), size_t(4) }) {
+        for (bool alConsumir : { false, true }) {
+            vector<size_t> consumidos;
+            string mensaje;
+            try {
+                procesarTramosEnOrden<size_t>(TRAMOS, hilos,
+                    [&](size_t tramo) {
+                        if (!alConsumir && tramo == TRAMO_FALLIDO) {
+                            throw runtime_error("tramo fallido");
+                        }
+                        return tramo;
+                    },
+                    [&](size_t tramo, size_t&& valor) {
+                        if (alConsumir && tramo == TRAMO_FALLIDO) {
+                            throw runtime_error("tramo fallido");
+                        }
+                        consumidos.push_back(valor);
+                    });
+            }
+            catch (const runtime_error& error) {
+                mensaje = error.what();
+            }
+
+            bool enOrden = true;
+            for (size_t i = 0; i < consumidos.size(); i++) {
+                enOrden = enOrden && consumidos[i] == i;
+            }
+            // Al producir, el consumidor se puede detener antes de llegar al tramo fallido
+            bool cantidadValida = alConsumir ? consumidos.size() == TRAMO_FALLIDO : consumidos.size() <= TRAMO_FALLIDO;
+            bool bien = mensaje == "tramo fallido" && enOrden && cantidadValida;
+            cout << "Hilos: " << hilos << " | Falla al " << (alConsumir ? "consumir" : "producir")
+                 << " | Consumidos: " << consumidos.size() << " | " << (bien ? "bien" : "mal") << endl;
+            correcto = correcto && bien;
+        }
+    }
+
+    TrabajoEnSegundoPlano trabajo;
+    trabajo.lanzar([]() -> bool { throw bad_alloc(); });
+    bool fallido = !trabajo.recoger();
+    trabajo.lanzar([] { return true; });
+    bool siguiente = trabajo.recoger();
+    cout << "Segundo plano con excepcion: " << (fallido ? "falla" : "no falla") << " | siguiente trabajo "
+         << (siguiente ? "bien" : "mal") << endl;
+    correcto = correcto && fallido && siguiente;
+
+    cout << (correcto ? "Resultado: OK" : "Resultado: FALLO") << endl;
+    return correcto ? 0 : 1;
+}
+
+// Prueba del dia y la hora local: recorre dos anios cada 7 minutos y compara
+// diaDe y horaDelDia con localtime. Sirve con cualquier TZ; con una que tenga
+// horario de verano cubre los dos cambios de cada anio.
+int ejecutarPruebaHorario() {
+    const int64_t inicio = 1704067200; // 01/01/2024 00:00:00 UTC
+    const int64_t fin = inicio + 2 * 366 * 86400;
+    size_t revisados = 0;
+    size_t diasIncorrectos = 0;
+    size_t horasIncorrectas = 0;
+    for (int64_t instante = inicio; instante < fin; instante += 7 * 60) {
+        tm local = horaLocal(instante);
+        diasIncorrectos += diaDe(instante) != diasDesdeEpoca(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday);
+        horasIncorrectas += horaDelDia(instante) != static_cast<size_t>(local.tm_hour);
+        revisados++;
+    }
+
+    cout << "\n--- PRUEBA DE HORARIO LOCAL ---\n";
+    cout << "Instantes revisados: " << revisados << endl;
+    cout << "Dias incorrectos: " << diasIncorrectos << " | Horas incorrectas: " << horasIncorrectas << endl;
+    bool correcto = diasIncorrectos == 0 && horasIncorrectas == 0;
+    cout << (correcto ? "Resultado: OK" : "Resultado: FALLO") << endl;
+    return correcto ? 0 : 1;
+}
+
+// Prueba del journal: mezcla altas, procesados y eliminaciones hasta pasar
+// varias veces EVENTOS_POR_COMPACTACION, con el respaldo normal y en segundo
+// plano. Cada compactacion la dispara un tipo de cambio distinto y justo
+// despues se carga lo escrito: cada pedido tiene que quedar igual, tambien el
+// del cambio que disparo la compactacion. Al final se carga respaldo y journal.
+int ejecutarPruebaCompactacion() {
+    const string prefijo = "prueba_compactacion_";
+    const CatalogoProductos& catalogo = CatalogoProductos::global();
+    const size_t EVENTOS = 3 * EVENTOS_POR_COMPACTACION + 7;
+    bool correcto = true;
+
+    // ID -> 0 no existe, 1 pendiente, 2 completado
+    auto estadoDe = [](const GestorPedidos& gestor, int id) {
+        EstadoPedido estado;
+        if (gestor.obtenerPedido(id, &estado) == nullptr) {
+            return 0;
+        }
+        return (estado == EstadoPedido::Pendiente) ? 1 : 2;
+    };
+    auto compararConCargado = [&](const vector<uint8_t>& esperado, bool conJournal, const string& momento) {
+        GestorPedidos cargado(prefijo, conJournal);
+        ResultadoCarga resultado = cargado.cargar();
+        size_t distintos = 0;
+        for (size_t id = 1; id < esperado.size(); id++) {
+            distintos += (estadoDe(cargado, static_cast<int>(id)) != esperado[id]);
+        }
+        size_t existentes = esperado.size() - count(esperado.begin(), esperado.end(), 0);
+        bool iguales = resultado.estado == EstadoCarga::Correcta && distintos == 0 &&
+                       cargado.cantidadPendientes() + cargado.cantidadCompletados() == existentes;
+        cout << "  " << momento << ": " << existentes << " pedidos, " << distintos << " distintos al cargar" << endl;
+        correcto = correcto && iguales;
+    };
+
+    for (bool asincrono : { false, true }) {
+        cout << "Respaldo " << (asincrono ? "en segundo plano" : "normal") << endl;
+        vector<uint8_t> esperado(1, 0);
+        auto fotografiar = [&](const GestorPedidos& gestor) {
+            for (size_t id = 1; id < esperado.size(); id++) {
+                esperado[id] = static_cast<uint8_t>(estadoDe(gestor, static_cast<int>(id)));
+            }
+        };
+        {
+            GestorPedidos gestor(prefijo, true);
+            gestor.configurarRespaldo(asincrono, 0, 0);
+            mt19937 generador(12345);
+            size_t eventos = 0;
+            auto alta = [&] {
+                uint16_t idProducto = static_cast<uint16_t>(generador() % catalogo.tamanoMenu());
+                LineasPedido productos;
+                productos.push_back(Producto(idProducto, catalogo.precio(idProducto)));
+                int id = static_cast<int>(esperado.size());
+                esperado.push_back(0);
+                return gestor.registrarPedido(Pedido(id, "Cliente " + to_string(generador() % 100), move(productos), id % 2 == 0));
+            };
+
+            for (size_t i = 0; eventos < EVENTOS; i++) {
+                // El cambio numero EVENTOS_POR_COMPACTACION de cada vuelta dispara la compactacion
+                if (eventos % EVENTOS_POR_COMPACTACION == EVENTOS_POR_COMPACTACION - 1) {
+                    size_t vuelta = eventos / EVENTOS_POR_COMPACTACION;
+                    string momento;
+                    if (vuelta % 3 == 0) {
+                        eventos += alta();
+                        momento = "compactacion tras un alta";
+                    }
+                    else if (vuelta % 3 == 1) {
+                        eventos += gestor.procesarSiguiente();
+                        momento = "compactacion tras procesar";
+                    }
+                    else {
+                        eventos += gestor.eliminarPedidoPorId(gestor.siguientePendiente()->getId());
+                        momento = "compactacion tras eliminar";
+                    }
+                    correcto = gestor.esperarRespaldo() && correcto;
+                    fotografiar(gestor);
+                    // El journal quedo vacio; alcanza con el respaldo
+                    compararConCargado(esperado, false, momento);
+                    continue;
+                }
+
+                // Entran dos pedidos por cada uno que se procesa, asi la cola nunca se vacia
+                if (i % 4 < 2) {
+                    eventos += alta();
+                }
+                else if (i % 4 == 2) {
+                    eventos += gestor.procesarSiguiente();
+                }
+                else {
+                    eventos += gestor.eliminarPedidoPorId(1 + static_cast<int>(generador() % esperado.size()));
+                }
+            }
+            correcto = gestor.esperarRespaldo() && correcto;
+            fotografiar(gestor);
+        }
+        compararConCargado(esperado, true, "al final, con el journal");
+
+        remove((prefijo + "pedidos.dat").c_str());
+        remove((prefijo + "pedidos.journal").c_str());
+        remove((prefijo + "pedidos.journal.anterior").c_str());
+    }
+
+    cout << (correcto ? "Resultado: OK" : "Resultado: FALLO") << endl;
+    return correcto ? 0 : 1;
+}
+
+// Prueba de segmentos huerfanos: una sesion archiva pedidos que solo estan en
+// el journal y termina sin guardar; cada carga los vuelve a archivar. Despues
+// de cada carga en la carpeta tiene que haber solo los segmentos que se usan,
+// tambien si quedo uno suelto con un numero lejano.
+int ejecutarPruebaHuerfanos() {
+    const string prefijo = "prueba_huerfanos_";
+    const CatalogoProductos& catalogo = CatalogoProductos::global();
+    const size_t MAXIMO_EN_MEMORIA = 10;
+    bool correcto = true;
+
+    auto agregarYProcesar = [&](GestorPedidos& gestor, int desde, int hasta) {
+        for (int id = desde; id < hasta; id++) {
+            uint16_t idProducto = static_cast<uint16_t>(id % catalogo.tamanoMenu());
+            LineasPedido productos;
+            productos.push_back(Producto(idProducto, catalogo.precio(idProducto)));
+            gestor.registrarPedido(Pedido(id, "Cliente " + to_string(id % 7), move(productos), false));
+            gestor.procesarSiguiente();
+        }
+    };
+
+    {
+        GestorPedidos gestor(prefijo, true);
+        gestor.configurarRespaldo(false, 0, 0);
+        gestor.configurarHistorial(MAXIMO_EN_MEMORIA, 0);
+        agregarYProcesar(gestor, 1, 61);
+        correcto = gestor.guardar() && correcto;
+        agregarYProcesar(gestor, 61, 101);
+    }
+
+    vector<uint32_t> usados;
+    for (int carga = 1; carga <= 3; carga++) {
+        if (carga == 2) {
+            // Un segmento suelto despues de un hueco en la numeracion
+            FILE* suelto = fopen(HistorialArchivado(prefijo).rutaSegmento(999).c_str(), "wb");
+            if (suelto != nullptr) {
+                fclose(suelto);
+            }
+        }
+        GestorPedidos gestor(prefijo, true);
+        gestor.configurarRespaldo(false, 0, 0);
+        gestor.configurarHistorial(MAXIMO_EN_MEMORIA, 0);
+        bool cargado = gestor.cargar().estado == EstadoCarga::Correcta;
+        usados = gestor.historialArchivado().numeros();
+        size_t enDisco = gestor.historialArchivado().numerosEnDisco().size();
+        bool bien = cargado && gestor.cantidadCompletados() == 100 && enDisco == usados.size();
+        cout << "Carga " << carga << ": " << gestor.cantidadCompletados() << " completados, " << usados.size()
+             << " segmentos en uso, " << enDisco << " en la carpeta" << endl;
+        correcto = correcto && bien;
+    }
+
+    HistorialArchivado nombres(prefijo);
+    for (uint32_t numero : nombres.numerosEnDisco()) {
+        remove(nombres.rutaSegmento(numero).c_str());
+    }
+    remove((prefijo + "pedidos.dat").c_str());
+    remove((prefijo + "pedidos.journal").c_str());
+    remove((prefijo + "pedidos.journal.anterior").c_str());
+
+    cout << (correcto ? "Resultado: OK" : "Resultado: FALLO") << endl;
+    return correcto ? 0 : 1;
+}
+
+// Prueba de carga del gestor concurrente: varios hilos envian pedidos (y algunos
+// IDs repetidos a proposito) mientras otro hilo consulta reportes y busquedas.
+// Al final cada ID debe estar exactamente una vez en el historial, los pedidos
+// de cada hilo en el orden en que los envio, y un gestor con lugar para pocos
+// pedidos tiene que rechazar los que no entran.
+int ejecutarPruebaConcurrente(size_t cantidadHilos, size_t cantidadPedidos) {
+    auto inicio = chrono::steady_clock::now();
+
+    atomic<size_t> aceptados{ 0 };
+    atomic<size_t> rechazados{ 0 };
+    atomic<bool> enviando{ true };
+    size_t consultas = 0;
+    bool prefijoInconsistente = false;
+    size_t tamanoFinal = 0;
+    vector<unsigned char> vistos(cantidadPedidos, 0);
+    bool idInvalido = false;
+    bool fueraDeOrden = false;
+
+    {
+        GestorPedidosConcurrente gestor;
+
+        thread lector([&] {
+            size_t anterior = 0;
+            while (enviando.load()) {
+                ResumenFinanciero resumen = gestor.generarResumen();
+                if (resumen.cantidadPedidos < anterior) {
+                    prefijoInconsistente = true;
+                }
+                anterior = resumen.cantidadPedidos;
+
+                EstadoPedido estado;
+                bool existe;
+                gestor.buscarPedido(static_cast<int>(anterior / 2), estado, existe);
+                consultas++;
+            }
+        });
+
+        vector<thread> productores;
+        for (size_t h = 0; h < cantidadHilos; h++) {
+            productores.emplace_back([&, h] {
+                mt19937 generador(static_cast<unsigned int>(h + 1));
+                for (size_t id = h; id < cantidadPedidos; id += cantidadHilos) {
+                    Dinero total;
+                    LineasPedido productos = productosAlAzar(generador, total);
+                    Pedido pedido(static_cast<int>(id), "Cliente " + to_string(h), move(productos), total, 0, false);
+                    if (gestor.enviarPedido(move(pedido)) == ResultadoEnvio::Aceptado) {
+                        aceptados++;
+                    }
+
+                    // De vez en cuando repetir un ID que otro hilo pudo haber enviado
+                    if (generador() % 64 == 0) {
+                        size_t repetido = generador() % cantidadPedidos;
+                        if (repetido % cantidadHilos == h && repetido > id) {
+                            continue; // le toca a este hilo mas adelante
+                        }
+                        if (gestor.enviarPedido(Pedido(static_cast<int>(repetido), "Repetido", LineasPedido(), Dinero(), 0, false)) == ResultadoEnvio::Aceptado) {
+                            aceptados++;
+                        }
+                        else {
+                            rechazados++;
+                        }
+                    }
+                }
+            });
+        }
+
+        for (thread& t : productores) {
+            t.join();
+        }
+        gestor.esperarProcesados();
+        enviando = false;
+        lector.join();
+
+        // Cliente de cada hilo productor, para revisar el orden de sus pedidos
+        unordered_map<uint32_t, int> ultimoPorCliente;
+        for (size_t h = 0; h < cantidadHilos; h++) {
+            uint32_t idCliente;
+            if (RegistroClientes::global().buscar("Cliente " + to_string(h), idCliente)) {
+                ultimoPorCliente[idCliente] = -1;
+            }
+        }
+
+        const HistorialConcurrente& historial = gestor.getHistorial();
+        tamanoFinal = historial.tamano();
+        for (size_t i = 0; i < tamanoFinal; i++) {
+            int id = historial[i].getId();
+            if (id < 0 || static_cast<size_t>(id) >= cantidadPedidos) {
+                idInvalido = true;
+                continue;
+            }
+            if (vistos[id] < 2) {
+                vistos[id]++;
+            }
+            auto ultimo = ultimoPorCliente.find(historial[i].getIdCliente());
+            if (ultimo != ultimoPorCliente.end()) {
+                fueraDeOrden |= id <= ultimo->second;
+                ultimo->second = id;
+            }
+        }
+    }
+
+    // Con lugar para 100 pedidos, los 20 que sobran se rechazan
+    size_t rechazadosPorLugar = 0;
+    size_t tamanoLimitado = 0;
+    {
+        GestorPedidosConcurrente limitado(cantidadHilos, 100);
+        for (int id = 0; id < 120; id++) {
+            if (limitado.enviarPedido(Pedido(id, "Limite", LineasPedido(), Dinero(), 0, false)) == ResultadoEnvio::HistorialLleno) {
+                rechazadosPorLugar++;
+            }
+        }
+        limitado.esperarProcesados();
+        tamanoLimitado = limitado.getHistorial().tamano();
+    }
+
+    double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+    size_t perdidos = count(vistos.begin(), vistos.end(), 0);
+    size_t duplicados = count(vistos.begin(), vistos.end(), 2);
+
+    cout << "\n--- PRUEBA CONCURRENTE ---\n";
+    cout << "Hilos productores: " << cantidadHilos << endl;
+    cout << "Pedidos enviados: " << cantidadPedidos << " (aceptados " << aceptados << ", IDs repetidos rechazados " << rechazados << ")" << endl;
+    cout << "Pedidos en el historial: " << tamanoFinal << endl;
+    cout << "Perdidos: " << perdidos << " | Duplicados: " << duplicados << endl;
+    cout << "Orden por hilo: " << (fueraDeOrden ? "alterado" : "respetado") << endl;
+    cout << "Historial limitado a 100: " << tamanoLimitado << " pedidos, " << rechazadosPorLugar << " rechazados" << endl;
+    cout << "Consultas concurrentes: " << consultas << endl;
+    cout << "Tiempo: " << fixed << setprecision(3) << segundos << " s ("
+         << setprecision(0) << (cantidadPedidos / segundos) << " pedidos/s)" << endl;
+
+    bool correcto = perdidos == 0 && duplicados == 0 && !idInvalido && !prefijoInconsistente && !fueraDeOrden &&
+                    tamanoFinal == cantidadPedidos && aceptados == cantidadPedidos &&
+                    tamanoLimitado == 100 && rechazadosPorLugar == 20;
+    cout << (correcto ? "Resultado: OK" : "Resultado: FALLO") << endl;
+    return correcto ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    string prueba = argc > 1 ? argv[1] : "";
+    if (prueba == "compactacion" && argc == 2) {
+        return ejecutarPruebaCompactacion();
+    }
+    if (prueba == "clientes-archivados" && argc == 2) {
+        return ejecutarPruebaClientesArchivados();
+    }
+    if (prueba == "sucursales" && argc == 2) {
+        return ejecutarPruebaSucursales();
+    }
+    if (prueba == "huerfanos" && argc == 2) {
+        return ejecutarPruebaHuerfanos();
+    }
+    if (prueba == "tramos" && argc == 2) {
+        return ejecutarPruebaTramos();
+    }
+    if (prueba == "horario" && argc == 2) {
+        return ejecutarPruebaHorario();
+    }
+    if (prueba == "stress" && argc <= 4) {
+        size_t hilos = 4;
+        size_t cantidad = 2000000;
+        if ((argc > 2 && !convertirNumero(string_view(argv[2]), hilos)) || (argc > 3 && !convertirNumero(string_view(argv[3]), cantidad))) {
+            fprintf(stderr, "Uso: %s stress [hilos] [pedidos]\n", argv[0]);
+            return 1;
+        }
+        return ejecutarPruebaConcurrente(max<size_t>(hilos, 1), cantidad);
+    }
+
+    fprintf(stderr, "Uso: %s compactacion|clientes-archivados|sucursales|huerfanos|tramos|horario|stress [hilos] [pedidos]\n",
+            argv[0]);
+    return 1;
+}